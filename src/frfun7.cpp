@@ -1,7 +1,11 @@
 #include <algorithm>
+#include <climits>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 #ifdef FRFUN7_X86
 #include <emmintrin.h>
@@ -10,20 +14,25 @@
 #include <VapourSynth.h>
 #include <VSHelper.h>
 
-
-#ifdef _WIN32
-#define AVS_FORCEINLINE __forceinline
-#else
-#define AVS_FORCEINLINE inline __attribute__((always_inline))
-#endif
+#include "frfun7.h"
 
 
 // SAD of 4x4 reference and 4x4 actual bytes
 // return value is in sad
+// fast: only rows 0 and 2
+template <bool fast = false>
 static void scalar_sad16(const uint8_t *ref, int ref_pitch, int offset, const uint8_t* rdst, int rdp_aka_pitch, int &sad)
 {
   sad = 0;
 
+  if constexpr (fast) {
+    for (int x = 0; x < 4; x++) {
+        sad += std::abs(rdst[x + offset] - ref[x]);
+        sad += std::abs(rdst[x + rdp_aka_pitch * 2 + offset] - ref[x + ref_pitch * 2]);
+    }
+    return;
+  }
+
   for (int x = 0; x < 4; x++) {
       int src0 = *(rdst + x + offset);
       int src1 = *(rdst + x + rdp_aka_pitch + offset);
@@ -82,6 +91,7 @@ static void scalar_acc16(int offset, const uint8_t *rdst, int rdp_aka_pitch, int
   scalar_acc4(mm7, rdst + 3 * rdp_aka_pitch + offset, mask_by_sadcomp);
 }
 
+template <bool fast = false>
 static void scalar_2x_check(const uint8_t *ref, int ref_pitch, int offset, const uint8_t* rdst, int rdp_aka_pitch, int racc[2], int threshold[2], int mm4[8], int mm5[8], int mm6[8], int mm7[8], int process[2] = nullptr)
 {
   int sad[2];
@@ -90,7 +100,7 @@ static void scalar_2x_check(const uint8_t *ref, int ref_pitch, int offset, const
       if (process && !process[i])
           continue;
 
-      scalar_sad16(ref + 4 * i, ref_pitch, offset, rdst + 4 * i, rdp_aka_pitch, sad[i]);
+      scalar_sad16<fast>(ref + 4 * i, ref_pitch, offset, rdst + 4 * i, rdp_aka_pitch, sad[i]);
 
       scalar_comp(sad[i], racc[i], threshold[i]);
 
@@ -98,6 +108,7 @@ static void scalar_2x_check(const uint8_t *ref, int ref_pitch, int offset, const
   }
 }
 
+template <bool fast = false>
 static void scalar_2x_acheck(const uint8_t *ref, int ref_pitch, int offset, const uint8_t* rdst, int rdp_aka_pitch, int racc[2], int threshold[2], int mm4[8], int mm5[8], int mm6[8], int mm7[8], int edx_sad_summing[2], int process[2] = nullptr)
 {
   int sad[2];
@@ -106,7 +117,7 @@ static void scalar_2x_acheck(const uint8_t *ref, int ref_pitch, int offset, cons
       if (process && !process[i])
           continue;
 
-      scalar_sad16(ref + 4 * i, ref_pitch, offset, rdst + 4 * i, rdp_aka_pitch, sad[i]);
+      scalar_sad16<fast>(ref + 4 * i, ref_pitch, offset, rdst + 4 * i, rdp_aka_pitch, sad[i]);
       edx_sad_summing[i] += sad[i];
       scalar_comp(sad[i], racc[i], threshold[i]);
       scalar_acc16(offset, rdst + 4 * i, rdp_aka_pitch, sad[i], mm4 + 4 * i, mm5 + 4 * i, mm6 + 4 * i, mm7 + 4 * i);
@@ -132,12 +143,18 @@ static void scalar_2x_stor4(uint8_t* esi, int mmA_array[8], int multiplier[2])
     scalar_stor4(esi + 4, mmA_array + 4, multiplier[1]);
 }
 
-template<int R> // radius; 3 or 0 is used
+template<int R, bool fast = false> // radius; 3 or 0 is used
 static void frcore_filter_b4r0or2or3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
 {
   // convert to upper left corner of the radius
   ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(0, 0)
 
+  // fast: the SADs only cover half the pixels
+  int thresh_fast[2] = { (thresh[0] + 1) >> 1, (thresh[1] + 1) >> 1 };
+  if constexpr (fast) {
+    thresh = thresh_fast;
+  }
+
   int weight_acc[2] = { 0 };
 
   // accumulators
@@ -153,55 +170,55 @@ static void frcore_filter_b4r0or2or3_scalar(const uint8_t* ptrr, int pitchr, con
     if constexpr (R >= 3)
     {
       // -3 // top line of y= -3..+3
-      scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-      scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-      scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+      scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
       ptra += pitcha; // next line
     }
 
     // -2
-    scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
     ptra += pitcha; // next line
 
     // -1
-    scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
     ptra += pitcha; // next line
   }
 
   //; 0
-  scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   if constexpr (R >= 2)
   {
-    scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
     if constexpr (R >= 3)
     {
-      scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-      scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+      scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+      scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
     }
   }
 
@@ -211,40 +228,40 @@ static void frcore_filter_b4r0or2or3_scalar(const uint8_t* ptrr, int pitchr, con
     ptra += pitcha;
 
     // +1
-    scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
 
     ptra += pitcha;
     // +2
-    scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
 
     if constexpr (R >= 3)
     {
       ptra += pitcha;
-      scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-      scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-      scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+      scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
 
   }
@@ -275,13 +292,32 @@ static void frcore_filter_b4r0_scalar(const uint8_t* ptrr, int pitchr, const uin
   frcore_filter_b4r0or2or3_scalar<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
 }
 
+// fast: the candidates are matched on rows 0 and 2 only
+static void frcore_filter_fast_b4r3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_scalar<3, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+static void frcore_filter_fast_b4r2_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_scalar<2, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
 // R == 2 or 3 (initially was: only 3)
-template<int R>
+template<int R, bool fast = false>
 static void frcore_filter_adapt_b4r2or3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
 {
   // convert to upper left corner of the radius
   ptra += -1 * pitcha - R; // cpln(-3, -1)
 
+  // fast: the SADs only cover half the pixels
+  int thresh_fast[2] = { (thresh[0] + 1) >> 1, (thresh[1] + 1) >> 1 };
+  if constexpr (fast) {
+    thresh = thresh_fast;
+    sThresh2 = (sThresh2 + 1) >> 1;
+    sThresh3 = (sThresh3 + 1) >> 1;
+  }
+
   int weight_acc[2] = { 0 }; // xor ecx, ecx
 
   // accumulators
@@ -295,21 +331,21 @@ static void frcore_filter_adapt_b4r2or3_scalar(const uint8_t* ptrr, int pitchr,
   int edx_sad_summing[2] = { 0 };
 
   // ; -1
-  scalar_2x_acheck(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  scalar_2x_acheck(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  scalar_2x_acheck(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
   ptra += pitcha; // next line
 
   // ; 0
-  scalar_2x_acheck(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  scalar_2x_acheck(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  scalar_2x_acheck(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
   ptra += pitcha; // next line
 
   // ; +1
-  scalar_2x_acheck(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  scalar_2x_acheck(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  scalar_2x_acheck(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  scalar_2x_acheck<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
 
   int process[2] = { edx_sad_summing[0] >= sThresh2, edx_sad_summing[1] >= sThresh2 };
 
@@ -319,34 +355,34 @@ static void frcore_filter_adapt_b4r2or3_scalar(const uint8_t* ptrr, int pitchr,
     ptra -= 3 * pitcha; // move to -2
 
     // ; -2
-    scalar_2x_acheck(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
     ptra += pitcha; // next line
 
     // ; -1
-    scalar_2x_acheck(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
     ptra += pitcha; // next line
 
     // ; 0
-    scalar_2x_acheck(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
     ptra += pitcha; // next line
 
     // ; +1
-    scalar_2x_acheck(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
     ptra += pitcha; // next line
 
     // ; +2
-    scalar_2x_acheck(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
-    scalar_2x_acheck(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
+    scalar_2x_acheck<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing, process);
 
     process[0] = process[0] && edx_sad_summing[0] >= sThresh3;
     process[1] = process[1] && edx_sad_summing[1] >= sThresh3;
@@ -360,48 +396,48 @@ static void frcore_filter_adapt_b4r2or3_scalar(const uint8_t* ptrr, int pitchr,
         // no more need for acheck.edx_sad_summing
 
         // ; -3
-        scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
         ptra += pitcha; // next line
 
         // ; -2
-        scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
         ptra += pitcha; // next line
 
         // ; -1
-        scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
         ptra += pitcha; // next line
 
         // ; 0
-        scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
         ptra += pitcha; // next line
 
         // ; +1
-        scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
         ptra += pitcha; // next line
 
         // ; +2
-        scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
         ptra += pitcha; // next line
 
         // ; +3
-        scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
-        scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
+        scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, process);
       }
     }
   }
@@ -427,6 +463,16 @@ static void frcore_filter_adapt_b4r2_scalar(const uint8_t* ptrr, int pitchr, con
   frcore_filter_adapt_b4r2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
 }
 
+static void frcore_filter_adapt_fast_b4r3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_scalar<3, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+static void frcore_filter_adapt_fast_b4r2_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_scalar<2, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
 static void scalar_blend_store4(uint8_t* esi, int mmA_array[4], int mm2_multiplier)
 {
     for (int x = 0; x < 4; x++) {
@@ -443,13 +489,77 @@ static void scalar_blend_store4(uint8_t* esi, int mmA_array[4], int mm2_multipli
     }
 }
 
+// Blends the scaled sums of the blocks selected by process_blocks into ptrb.
+static void scalar_2x_blend(uint8_t* ptrb, int pitchb, const int weight_acc[2], int mm4[8], int mm5[8], int mm6[8], int mm7[8], const int* inv_table, const int weight[2], const int process_blocks[2])
+{
+  // weight variable is a multi-purpose one, here we get a 32 bit value,
+  // which is really two 16 bit words
+  // lower 16 and upper 16 bit has separate meaning
+
+  // scale 4 - 7 by weight and store(here with blending)
+
+  if (process_blocks[0]) {
+      int weight_lo16 = weight[0] & 0xFFFF; // lower 16 bit
+      int weight_hi16 = weight[0] >> 16; // upper 16 bit
+
+      int weight_recip = inv_table[weight_acc[0]];
+
+      for (int x = 0; x < 4; x++) {
+          mm4[x] = (mm4[x] * weight_recip + 256) >> 9;
+          mm5[x] = (mm5[x] * weight_recip + 256) >> 9;
+          mm6[x] = (mm6[x] * weight_recip + 256) >> 9;
+          mm7[x] = (mm7[x] * weight_recip + 256) >> 9;
+
+          mm4[x] = (mm4[x] * weight_lo16) >> 16;
+          mm5[x] = (mm5[x] * weight_lo16) >> 16;
+          mm6[x] = (mm6[x] * weight_lo16) >> 16;
+          mm7[x] = (mm7[x] * weight_lo16) >> 16;
+      }
+
+      scalar_blend_store4(ptrb + 0 * pitchb, mm4, weight_hi16);
+      scalar_blend_store4(ptrb + 1 * pitchb, mm5, weight_hi16);
+      scalar_blend_store4(ptrb + 2 * pitchb, mm6, weight_hi16);
+      scalar_blend_store4(ptrb + 3 * pitchb, mm7, weight_hi16);
+  }
+
+  if (process_blocks[1]) {
+      int weight_lo16 = weight[1] & 0xFFFF; // lower 16 bit
+      int weight_hi16 = weight[1] >> 16; // upper 16 bit
+
+      int weight_recip = inv_table[weight_acc[1]];
+
+      for (int x = 4; x < 8; x++) {
+          mm4[x] = (mm4[x] * weight_recip + 256) >> 9;
+          mm5[x] = (mm5[x] * weight_recip + 256) >> 9;
+          mm6[x] = (mm6[x] * weight_recip + 256) >> 9;
+          mm7[x] = (mm7[x] * weight_recip + 256) >> 9;
+
+          mm4[x] = (mm4[x] * weight_lo16) >> 16;
+          mm5[x] = (mm5[x] * weight_lo16) >> 16;
+          mm6[x] = (mm6[x] * weight_lo16) >> 16;
+          mm7[x] = (mm7[x] * weight_lo16) >> 16;
+      }
+
+      scalar_blend_store4(ptrb + 4 + 0 * pitchb, mm4 + 4, weight_hi16);
+      scalar_blend_store4(ptrb + 4 + 1 * pitchb, mm5 + 4, weight_hi16);
+      scalar_blend_store4(ptrb + 4 + 2 * pitchb, mm6 + 4, weight_hi16);
+      scalar_blend_store4(ptrb + 4 + 3 * pitchb, mm7 + 4, weight_hi16);
+  }
+}
+
 // used in mode_temporal
 // R is 2 or 3
-template<int R>
+template<int R, bool fast = false>
 static void frcore_filter_overlap_b4r2or3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
 {
   ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(-2, -2)
 
+  // fast: the SADs only cover half the pixels
+  int thresh_fast[2] = { (thresh[0] + 1) >> 1, (thresh[1] + 1) >> 1 };
+  if constexpr (fast) {
+    thresh = thresh_fast;
+  }
+
   int weight_acc[2] = { 0 };
 
   // accumulators
@@ -463,158 +573,314 @@ static void frcore_filter_overlap_b4r2or3_scalar(const uint8_t* ptrr, int pitchr
   if constexpr (R >= 3)
   {
     // -3 // top line of y= -3..+3
-    scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
     ptra += pitcha; // next line
   }
   // -2
-  scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   if constexpr (R >= 3)
   {
-    scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   }
   ptra += pitcha; // next line
 
   // -1
-  scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   if constexpr (R >= 3)
   {
-    scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   }
   ptra += pitcha; // next line
 
   //; 0
-  scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   if constexpr (R >= 3)
   {
-    scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   }
   ptra += pitcha;
 
   // +1
-  scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   if constexpr (R >= 3)
   {
-    scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   }
 
   ptra += pitcha;
   // +2
-  scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   if constexpr (R >= 3)
   {
-    scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   }
 
   if constexpr (R >= 3)
   {
     ptra += pitcha;
-    scalar_2x_check(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    scalar_2x_check(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    scalar_2x_check<fast>(ptrr, pitchr, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   }
 
   // mm4 - mm7 has accumulated sum, weight is ready here
 
-  // weight variable is a multi-purpose one, here we get a 32 bit value,
-  // which is really two 16 bit words
-  // lower 16 and upper 16 bit has separate meaning
+  scalar_2x_blend(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table, weight, process_blocks);
+}
 
-  // scale 4 - 7 by weight and store(here with blending)
+static void frcore_filter_overlap_b4r3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
 
-  if (process_blocks[0]) {
-      int weight_lo16 = weight[0] & 0xFFFF; // lower 16 bit
-      int weight_hi16 = weight[0] >> 16; // upper 16 bit
+// used in adaptive overlapping
+// bottleneck in P = 1
+static void frcore_filter_overlap_b4r2_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
 
-      int weight_recip = inv_table[weight_acc[0]];
+static void frcore_filter_overlap_fast_b4r3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_scalar<3, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
 
-      for (int x = 0; x < 4; x++) {
-          mm4[x] = (mm4[x] * weight_recip + 256) >> 9;
-          mm5[x] = (mm5[x] * weight_recip + 256) >> 9;
-          mm6[x] = (mm6[x] * weight_recip + 256) >> 9;
-          mm7[x] = (mm7[x] * weight_recip + 256) >> 9;
+static void frcore_filter_overlap_fast_b4r2_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_scalar<2, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
 
-          mm4[x] = (mm4[x] * weight_lo16) >> 16;
-          mm5[x] = (mm5[x] * weight_lo16) >> 16;
-          mm6[x] = (mm6[x] * weight_lo16) >> 16;
-          mm7[x] = (mm7[x] * weight_lo16) >> 16;
-      }
+// Checks the candidates of the pattern, see SearchPattern.
+// ptra is the upper left corner of the radius, I goes over the (2R+1)x(2R+1) window row by row.
+// The other displacements generate no code.
+template<int R, int pattern, bool fast, int... I>
+AVS_FORCEINLINE void scalar_2x_check_pattern(std::integer_sequence<int, I...>, const uint8_t *ref, int ref_pitch, const uint8_t* ptra, int pitcha, int racc[2], int threshold[2], int mm4[8], int mm5[8], int mm6[8], int mm7[8])
+{
+  constexpr int W = 2 * R + 1;
 
-      scalar_blend_store4(ptrb + 0 * pitchb, mm4, weight_hi16);
-      scalar_blend_store4(ptrb + 1 * pitchb, mm5, weight_hi16);
-      scalar_blend_store4(ptrb + 2 * pitchb, mm6, weight_hi16);
-      scalar_blend_store4(ptrb + 3 * pitchb, mm7, weight_hi16);
+  ((pattern_has(pattern, R, I % W - R, I / W - R)
+    ? scalar_2x_check<fast>(ref, ref_pitch, I % W, ptra + I / W * pitcha, pitcha, racc, threshold, mm4, mm5, mm6, mm7)
+    : void()), ...);
+}
+
+// Sparse patterns, see SearchPattern
+// Same as frcore_filter_b4r0or2or3_scalar, with only the candidates of the pattern.
+template<int R, int pattern, bool fast = false>
+static void frcore_filter_sparse_b4_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  ptra += -R * pitcha - R;
+
+  int thresh_fast[2] = { (thresh[0] + 1) >> 1, (thresh[1] + 1) >> 1 };
+  if constexpr (fast) {
+    thresh = thresh_fast;
   }
 
-  if (process_blocks[1]) {
-      int weight_lo16 = weight[1] & 0xFFFF; // lower 16 bit
-      int weight_hi16 = weight[1] >> 16; // upper 16 bit
+  int weight_acc[2] = { 0 };
 
-      int weight_recip = inv_table[weight_acc[1]];
+  int mm4[8] = { 0 };
+  int mm5[8] = { 0 };
+  int mm6[8] = { 0 };
+  int mm7[8] = { 0 };
 
-      for (int x = 4; x < 8; x++) {
-          mm4[x] = (mm4[x] * weight_recip + 256) >> 9;
-          mm5[x] = (mm5[x] * weight_recip + 256) >> 9;
-          mm6[x] = (mm6[x] * weight_recip + 256) >> 9;
-          mm7[x] = (mm7[x] * weight_recip + 256) >> 9;
+  scalar_2x_check_pattern<R, pattern, fast>(std::make_integer_sequence<int, (2 * R + 1) * (2 * R + 1)>(),
+                                            ptrr, pitchr, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
 
-          mm4[x] = (mm4[x] * weight_lo16) >> 16;
-          mm5[x] = (mm5[x] * weight_lo16) >> 16;
-          mm6[x] = (mm6[x] * weight_lo16) >> 16;
-          mm7[x] = (mm7[x] * weight_lo16) >> 16;
-      }
+  int weight_recip[2] = { inv_table[weight_acc[0]], inv_table[weight_acc[1]] };
 
-      scalar_blend_store4(ptrb + 4 + 0 * pitchb, mm4 + 4, weight_hi16);
-      scalar_blend_store4(ptrb + 4 + 1 * pitchb, mm5 + 4, weight_hi16);
-      scalar_blend_store4(ptrb + 4 + 2 * pitchb, mm6 + 4, weight_hi16);
-      scalar_blend_store4(ptrb + 4 + 3 * pitchb, mm7 + 4, weight_hi16);
+  scalar_2x_stor4(ptrb + 0 * pitchb, mm4, weight_recip);
+  scalar_2x_stor4(ptrb + 1 * pitchb, mm5, weight_recip);
+  scalar_2x_stor4(ptrb + 2 * pitchb, mm6, weight_recip);
+  scalar_2x_stor4(ptrb + 3 * pitchb, mm7, weight_recip);
+}
+
+// Same as frcore_filter_overlap_b4r2or3_scalar, with only the candidates of the pattern.
+template<int R, int pattern, bool fast = false>
+static void frcore_filter_overlap_sparse_b4_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R;
+
+  int thresh_fast[2] = { (thresh[0] + 1) >> 1, (thresh[1] + 1) >> 1 };
+  if constexpr (fast) {
+    thresh = thresh_fast;
   }
+
+  int weight_acc[2] = { 0 };
+
+  int mm4[8] = { 0 };
+  int mm5[8] = { 0 };
+  int mm6[8] = { 0 };
+  int mm7[8] = { 0 };
+
+  scalar_2x_check_pattern<R, pattern, fast>(std::make_integer_sequence<int, (2 * R + 1) * (2 * R + 1)>(),
+                                            ptrr, pitchr, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+
+  scalar_2x_blend(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table, weight, process_blocks);
 }
 
-static void frcore_filter_overlap_b4r3_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+// Same as scalar_2x_check, also sets bit "bit" of mask[i] if the candidate was accepted for block i.
+template <bool fast = false>
+static void scalar_2x_mcheck(const uint8_t *ref, int ref_pitch, int offset, const uint8_t* rdst, int rdp_aka_pitch, int racc[2], int threshold[2], int mm4[8], int mm5[8], int mm6[8], int mm7[8], uint64_t mask[2], int bit)
 {
-  frcore_filter_overlap_b4r2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+  int sad[2];
+
+  for (int i = 0; i < 2; i++) {
+      scalar_sad16<fast>(ref + 4 * i, ref_pitch, offset, rdst + 4 * i, rdp_aka_pitch, sad[i]);
+
+      scalar_comp(sad[i], racc[i], threshold[i]);
+      mask[i] |= (uint64_t)(sad[i] & 1) << bit;
+
+      scalar_acc16(offset, rdst + 4 * i, rdp_aka_pitch, sad[i], mm4 + 4 * i, mm5 + 4 * i, mm6 + 4 * i, mm7 + 4 * i);
+  }
 }
 
-// used in adaptive overlapping
-// bottleneck in P = 1
-static void frcore_filter_overlap_b4r2_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+// Same as scalar_2x_check_pattern, with scalar_2x_mcheck. The bit of a candidate is I.
+template<int R, int pattern, bool fast, int... I>
+AVS_FORCEINLINE void scalar_2x_mcheck_pattern(std::integer_sequence<int, I...>, const uint8_t *ref, int ref_pitch, const uint8_t* ptra, int pitcha, int racc[2], int threshold[2], int mm4[8], int mm5[8], int mm6[8], int mm7[8], uint64_t mask[2])
 {
-  frcore_filter_overlap_b4r2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+  constexpr int W = 2 * R + 1;
+
+  ((pattern_has(pattern, R, I % W - R, I / W - R)
+    ? scalar_2x_mcheck<fast>(ref, ref_pitch, I % W, ptra + I / W * pitcha, pitcha, racc, threshold, mm4, mm5, mm6, mm7, mask, I)
+    : void()), ...);
+}
+
+// Joint chroma, luma plane (see JointMasks)
+// Same as frcore_filter_sparse_b4_scalar, also returns in mask[i] the candidates accepted
+// for block i: bit dy * (2R + 1) + dx, with dx and dy from 0 to 2R.
+template<int R, int pattern, bool fast = false>
+static void frcore_filter_joint_b4_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, uint64_t mask[2])
+{
+  ptra += -R * pitcha - R;
+
+  int thresh_fast[2] = { (thresh[0] + 1) >> 1, (thresh[1] + 1) >> 1 };
+  if constexpr (fast) {
+    thresh = thresh_fast;
+  }
+
+  int weight_acc[2] = { 0 };
+
+  int mm4[8] = { 0 };
+  int mm5[8] = { 0 };
+  int mm6[8] = { 0 };
+  int mm7[8] = { 0 };
+
+  uint64_t accepted[2] = { 0 };
+
+  scalar_2x_mcheck_pattern<R, pattern, fast>(std::make_integer_sequence<int, (2 * R + 1) * (2 * R + 1)>(),
+                                             ptrr, pitchr, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, accepted);
+
+  mask[0] = accepted[0];
+  mask[1] = accepted[1];
+
+  int weight_recip[2] = { inv_table[weight_acc[0]], inv_table[weight_acc[1]] };
+
+  scalar_2x_stor4(ptrb + 0 * pitchb, mm4, weight_recip);
+  scalar_2x_stor4(ptrb + 1 * pitchb, mm5, weight_recip);
+  scalar_2x_stor4(ptrb + 2 * pitchb, mm6, weight_recip);
+  scalar_2x_stor4(ptrb + 3 * pitchb, mm7, weight_recip);
+}
+
+// Joint chroma, chroma planes: averages the candidates set in mask[i] for block i
+// without matching them. The bits are the same as in frcore_filter_joint_b4_scalar,
+// the block itself must be one of them.
+template<int R>
+static void frcore_apply_b4_scalar(const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, const uint64_t mask[2], const int* inv_table)
+{
+  constexpr int W = 2 * R + 1;
+
+  ptra += -R * pitcha - R;
+
+  int weight_acc[2] = { 0 };
+
+  int mm4[8] = { 0 };
+  int mm5[8] = { 0 };
+  int mm6[8] = { 0 };
+  int mm7[8] = { 0 };
+
+  for (int i = 0; i < 2; i++) {
+      int accepted = 0xffffffff;
+
+      for (uint64_t m = mask[i]; m; m &= m - 1) {
+          int bit = __builtin_ctzll(m);
+          weight_acc[i]++;
+          scalar_acc16(bit % W, ptra + bit / W * pitcha + 4 * i, pitcha, accepted, mm4 + 4 * i, mm5 + 4 * i, mm6 + 4 * i, mm7 + 4 * i);
+      }
+  }
+
+  int weight_recip[2] = { inv_table[weight_acc[0]], inv_table[weight_acc[1]] };
+
+  scalar_2x_stor4(ptrb + 0 * pitchb, mm4, weight_recip);
+  scalar_2x_stor4(ptrb + 1 * pitchb, mm5, weight_recip);
+  scalar_2x_stor4(ptrb + 2 * pitchb, mm6, weight_recip);
+  scalar_2x_stor4(ptrb + 3 * pitchb, mm7, weight_recip);
+}
+
+// Several strengths: the candidates accepted for each of num_thresh pairs of thresholds,
+// with the SADs computed once. thresh[k * 2 + i] and mask[k * 2 + i] are for block i,
+// the bits are those of frcore_filter_joint_b4_scalar. Nothing is averaged, that is
+// left to frcore_apply_b4_scalar.
+template<int R, int pattern, bool fast = false>
+static void frcore_masks_b4_scalar(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, const int* thresh, int num_thresh, uint64_t* mask)
+{
+  constexpr int W = 2 * R + 1;
+
+  ptra += -R * pitcha - R;
+
+  int sads[2][W * W];
+
+  for (int bit = 0; bit < W * W; bit++) {
+      for (int i = 0; i < 2; i++) {
+          if (pattern_has(pattern, R, bit % W - R, bit / W - R))
+              scalar_sad16<fast>(ptrr + 4 * i, pitchr, bit % W, ptra + bit / W * pitcha + 4 * i, pitcha, sads[i][bit]);
+          else
+              sads[i][bit] = INT_MAX;
+      }
+  }
+
+  for (int k = 0; k < num_thresh * 2; k++) {
+      // fast: the SADs only cover half the pixels
+      const int t = fast ? (thresh[k] + 1) >> 1 : thresh[k];
+
+      uint64_t m = 0;
+      for (int bit = 0; bit < W * W; bit++)
+          m |= (uint64_t)(sads[k & 1][bit] < t) << bit;
+      mask[k] = m;
+  }
 }
 
 // mmA is input/output. In scalar_blend_store4 mmA in input only
@@ -757,18 +1023,19 @@ static void frcore_sad_2x_b4_scalar(const uint8_t* ptra, int pitcha, const uint8
 
 #ifdef FRFUN7_X86
 
-AVS_FORCEINLINE __m128i _mm_load_si32(const uint8_t* ptr) {
-  return _mm_castps_si128(_mm_load_ss((const float*)(ptr)));
-}
-
-AVS_FORCEINLINE __m128i _mm_load_si64(const uint8_t* ptr) {
-  return _mm_loadl_epi64((const __m128i*)(ptr));
-}
-
 // SAD of 2 4x4 blocks in parallel
 // return value is in sad
+// fast: only rows 0 and 2, ref01 holds those rows of the reference, ref23 is unused
+template <bool fast = false>
 AVS_FORCEINLINE void simd_2x_sad16(__m128i ref01, __m128i ref23, int offset, const uint8_t* rdst, int rdp_aka_pitch, __m128i &sad)
 {
+  if constexpr (fast) {
+    auto src0 = _mm_load_si64(rdst + offset);
+    auto src2 = _mm_load_si64(rdst + rdp_aka_pitch * 2 + offset);
+    sad = _mm_sad_epu8(_mm_unpacklo_epi32(src0, src2), ref01);
+    return;
+  }
+
   auto src0 = _mm_load_si64(rdst + offset);
   auto src1 = _mm_load_si64(rdst + rdp_aka_pitch + offset);
   auto src01 = _mm_unpacklo_epi32(src0, src1); // one block in low half of xmm, the other block in the high half
@@ -823,21 +1090,23 @@ AVS_FORCEINLINE void simd_2x_acc16(int offset, const uint8_t *rdst, int rdp_aka_
   simd_acc4(mm7, _mm_load_si64(rdst + 3 * rdp_aka_pitch + offset), mask_by_sadcomp);
 }
 
+template <bool fast = false>
 AVS_FORCEINLINE void simd_2x_check(__m128i ref01, __m128i ref23, int offset, const uint8_t* rdst, int rdp_aka_pitch, __m128i& racc, __m128i threshold,
   __m128i& mm4, __m128i& mm5, __m128i& mm6, __m128i& mm7)
 {
   __m128i sad;
-  simd_2x_sad16(ref01, ref23, offset, rdst, rdp_aka_pitch, sad);
+  simd_2x_sad16<fast>(ref01, ref23, offset, rdst, rdp_aka_pitch, sad);
   simd_comp(sad, racc, threshold);
   simd_2x_acc16(offset, rdst, rdp_aka_pitch, sad, mm4, mm5, mm6, mm7);
 }
 
+template <bool fast = false>
 AVS_FORCEINLINE void simd_2x_acheck(__m128i ref01, __m128i ref23, int offset, const uint8_t* rdst, int rdp_aka_pitch, __m128i& racc, __m128i threshold,
   __m128i& mm4, __m128i& mm5, __m128i& mm6, __m128i& mm7,
   __m128i &edx_sad_summing)
 {
   __m128i sad;
-  simd_2x_sad16(ref01, ref23, offset, rdst, rdp_aka_pitch, sad);
+  simd_2x_sad16<fast>(ref01, ref23, offset, rdst, rdp_aka_pitch, sad);
   edx_sad_summing = _mm_add_epi32(edx_sad_summing, sad);
   simd_comp(sad, racc, threshold);
   simd_2x_acc16(offset, rdst, rdp_aka_pitch, sad, mm4, mm5, mm6, mm7);
@@ -855,7 +1124,26 @@ AVS_FORCEINLINE void simd_2x_stor4(uint8_t* esi, __m128i& mmA, __m128i mm0_multi
   _mm_storel_epi64((__m128i *)esi, mm1);
 }
 
-template<int R> // radius; 3 or 0 is used
+// Scales the sums of two blocks by the reciprocal of their weights and stores them.
+AVS_FORCEINLINE void simd_2x_store(uint8_t* ptrb, int pitchb, __m128i weight_acc, __m128i mm4, __m128i mm5, __m128i mm6, __m128i mm7, const int* inv_table)
+{
+  auto zero = _mm_setzero_si128(); // packer zero
+  auto rounder_one = _mm_set1_epi16(1);
+
+  int weight_block1 = inv_table[_mm_extract_epi16(weight_acc, 0)];
+  int weight_block2 = inv_table[_mm_extract_epi16(weight_acc, 4)];
+
+  // scale 4 - 7 by weight
+  auto weight_recip = _mm_setr_epi16(weight_block1, weight_block1, weight_block1, weight_block1,
+                                     weight_block2, weight_block2, weight_block2, weight_block2);
+
+  simd_2x_stor4(ptrb + 0 * pitchb, mm4, weight_recip, rounder_one, zero);
+  simd_2x_stor4(ptrb + 1 * pitchb, mm5, weight_recip, rounder_one, zero);
+  simd_2x_stor4(ptrb + 2 * pitchb, mm6, weight_recip, rounder_one, zero);
+  simd_2x_stor4(ptrb + 3 * pitchb, mm7, weight_recip, rounder_one, zero);
+}
+
+template<int R, bool fast = false> // radius; 3 or 0 is used
 AVS_FORCEINLINE void frcore_filter_b4r0or2or3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table)
 {
   // convert to upper left corner of the radius
@@ -863,6 +1151,10 @@ AVS_FORCEINLINE void frcore_filter_b4r0or2or3_simd(const uint8_t* ptrr, int pitc
 
   auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
 
+  // fast: the SADs only cover half the pixels
+  if constexpr (fast)
+    thresh = _mm_srli_epi32(_mm_add_epi32(thresh, _mm_set1_epi32(1)), 1);
+
   auto weight_acc = _mm_setzero_si128();
 
   // reference pixels
@@ -873,6 +1165,8 @@ AVS_FORCEINLINE void frcore_filter_b4r0or2or3_simd(const uint8_t* ptrr, int pitc
 
   auto ref01 = _mm_unpacklo_epi32(m0, m1);
   auto ref23 = _mm_unpacklo_epi32(m2, m3);
+  if constexpr (fast)
+    ref01 = _mm_unpacklo_epi32(m0, m2); // rows 0 and 2 for the SADs
 
   // accumulators
   // each collects 8 words (weighted sums)
@@ -887,55 +1181,55 @@ AVS_FORCEINLINE void frcore_filter_b4r0or2or3_simd(const uint8_t* ptrr, int pitc
     if constexpr (R >= 3)
     {
       // -3 // top line of y= -3..+3
-      simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-      simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-      simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+      simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
       ptra += pitcha; // next line
     }
 
     // -2
-    simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
     ptra += pitcha; // next line
 
     // -1
-    simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
     ptra += pitcha; // next line
   }
 
   //; 0
-  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   if constexpr (R >= 2)
   {
-    simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
     if constexpr (R >= 3)
     {
-      simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-      simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+      simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+      simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
     }
   }
 
@@ -945,60 +1239,47 @@ AVS_FORCEINLINE void frcore_filter_b4r0or2or3_simd(const uint8_t* ptrr, int pitc
     ptra += pitcha;
 
     // +1
-    simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
 
     ptra += pitcha;
     // +2
-    simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-    simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-    simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-    simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-    simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
     if constexpr (R >= 3)
     {
-      simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
 
     if constexpr (R >= 3)
     {
       ptra += pitcha;
-      simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
-      simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
-      simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
-      simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
-      simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+      simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
     }
 
   }
 
   // mm4 - mm7 has accumulated sum, weight is ready here
 
-  auto zero = _mm_setzero_si128(); // packer zero
-  auto rounder_one = _mm_set1_epi16(1);
-
-  int weight_block1 = inv_table[_mm_extract_epi16(weight_acc, 0)];
-  int weight_block2 = inv_table[_mm_extract_epi16(weight_acc, 4)];
-
-  // scale 4 - 7 by weight
-  auto weight_recip = _mm_setr_epi16(weight_block1, weight_block1, weight_block1, weight_block1,
-                                     weight_block2, weight_block2, weight_block2, weight_block2);
-
-  simd_2x_stor4(ptrb + 0 * pitchb, mm4, weight_recip, rounder_one, zero);
-  simd_2x_stor4(ptrb + 1 * pitchb, mm5, weight_recip, rounder_one, zero);
-  simd_2x_stor4(ptrb + 2 * pitchb, mm6, weight_recip, rounder_one, zero);
-  simd_2x_stor4(ptrb + 3 * pitchb, mm7, weight_recip, rounder_one, zero);
+  simd_2x_store(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table);
 }
 
 AVS_FORCEINLINE void frcore_filter_b4r3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
@@ -1016,8 +1297,19 @@ AVS_FORCEINLINE void frcore_filter_b4r0_simd(const uint8_t* ptrr, int pitchr, co
   frcore_filter_b4r0or2or3_simd<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
 }
 
+// fast: the candidates are matched on rows 0 and 2 only
+AVS_FORCEINLINE void frcore_filter_fast_b4r3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_simd<3, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+AVS_FORCEINLINE void frcore_filter_fast_b4r2_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_simd<2, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
 // R == 2 or 3 (initially was: only 3)
-template<int R>
+template<int R, bool fast = false>
 AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], int sThresh2, int sThresh3, const int* inv_table)
 {
   // convert to upper left corner of the radius
@@ -1025,6 +1317,14 @@ AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_simd(const uint8_t* ptrr, int p
 
   auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
 
+  // fast: the SADs only cover half the pixels
+  if constexpr (fast)
+    thresh = _mm_srli_epi32(_mm_add_epi32(thresh, _mm_set1_epi32(1)), 1);
+  if constexpr (fast) {
+    sThresh2 = (sThresh2 + 1) >> 1;
+    sThresh3 = (sThresh3 + 1) >> 1;
+  }
+
   auto weight_acc = _mm_setzero_si128();
 
   // reference pixels
@@ -1035,6 +1335,8 @@ AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_simd(const uint8_t* ptrr, int p
 
   auto ref01 = _mm_unpacklo_epi32(m0, m1);
   auto ref23 = _mm_unpacklo_epi32(m2, m3);
+  if constexpr (fast)
+    ref01 = _mm_unpacklo_epi32(m0, m2); // rows 0 and 2 for the SADs
 
   // accumulators
   // each collects 4 words (weighted sums)
@@ -1047,21 +1349,21 @@ AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_simd(const uint8_t* ptrr, int p
   auto edx_sad_summing = _mm_setzero_si128();
 
   // ; -1
-  simd_2x_acheck(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  simd_2x_acheck(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  simd_2x_acheck(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
   ptra += pitcha; // next line
 
   // ; 0
-  simd_2x_acheck(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  simd_2x_acheck(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  simd_2x_acheck(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
   ptra += pitcha; // next line
 
   // ; +1
-  simd_2x_acheck(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  simd_2x_acheck(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-  simd_2x_acheck(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  simd_2x_acheck<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
 
   // Subtracting 1 because the comparison needs to be >=
   auto sad_sum_gte_th2 = _mm_cmpgt_epi32(edx_sad_summing, _mm_set1_epi64x(sThresh2 - 1));
@@ -1080,34 +1382,34 @@ AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_simd(const uint8_t* ptrr, int p
     ptra -= 3 * pitcha; // move to -2
 
     // ; -2
-    simd_2x_acheck(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
     ptra += pitcha; // next line
 
     // ; -1
-    simd_2x_acheck(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
     ptra += pitcha; // next line
 
     // ; 0
-    simd_2x_acheck(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
     ptra += pitcha; // next line
 
     // ; +1
-    simd_2x_acheck(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
     ptra += pitcha; // next line
 
     // ; +2
-    simd_2x_acheck(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
-    simd_2x_acheck(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    simd_2x_acheck<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
 
     weight_acc = _mm_and_si128(weight_acc, sad_sum_gte_th2);
     mm4 = _mm_and_si128(mm4, sad_sum_gte_th2);
@@ -1152,48 +1454,48 @@ AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_simd(const uint8_t* ptrr, int p
         // no more need for acheck.edx_sad_summing
 
         // ; -3
-        simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
         ptra += pitcha; // next line
 
         // ; -2
-        simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
         ptra += pitcha; // next line
 
         // ; -1
-        simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
         ptra += pitcha; // next line
 
         // ; 0
-        simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
         ptra += pitcha; // next line
 
         // ; +1
-        simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
         ptra += pitcha; // next line
 
         // ; +2
-        simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
         ptra += pitcha; // next line
 
         // ; +3
-        simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-        simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
 
         weight_acc = _mm_and_si128(weight_acc, sad_sum_gte_th3);
         mm4 = _mm_and_si128(mm4, sad_sum_gte_th3);
@@ -1221,20 +1523,7 @@ AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_simd(const uint8_t* ptrr, int p
 
   // mm4 - mm7 has accumulated sum, weight is ready here
 
-  auto zero = _mm_setzero_si128(); // packer zero
-  auto rounder_one = _mm_set1_epi16(1);
-
-  int weight_block1 = inv_table[_mm_extract_epi16(weight_acc, 0)];
-  int weight_block2 = inv_table[_mm_extract_epi16(weight_acc, 4)];
-
-  // scale 4 - 7 by weight
-  auto weight_recip = _mm_setr_epi16(weight_block1, weight_block1, weight_block1, weight_block1,
-                                     weight_block2, weight_block2, weight_block2, weight_block2);
-
-  simd_2x_stor4(ptrb + 0 * pitchb, mm4, weight_recip, rounder_one, zero);
-  simd_2x_stor4(ptrb + 1 * pitchb, mm5, weight_recip, rounder_one, zero);
-  simd_2x_stor4(ptrb + 2 * pitchb, mm6, weight_recip, rounder_one, zero);
-  simd_2x_stor4(ptrb + 3 * pitchb, mm7, weight_recip, rounder_one, zero);
+  simd_2x_store(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table);
 }
 
 AVS_FORCEINLINE void frcore_filter_adapt_b4r3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
@@ -1247,6 +1536,16 @@ AVS_FORCEINLINE void frcore_filter_adapt_b4r2_simd(const uint8_t* ptrr, int pitc
   frcore_filter_adapt_b4r2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
 }
 
+AVS_FORCEINLINE void frcore_filter_adapt_fast_b4r3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_simd<3, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+AVS_FORCEINLINE void frcore_filter_adapt_fast_b4r2_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_simd<2, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
 AVS_FORCEINLINE void simd_blend_store4(uint8_t* esi, __m128i mmA, __m128i mm2_multiplier, __m128i mm1_rounder, __m128i mm0_zero)
 {
   auto mm3 = _mm_unpacklo_epi8(_mm_load_si32(esi), mm0_zero);
@@ -1262,125 +1561,9 @@ AVS_FORCEINLINE void simd_blend_store4(uint8_t* esi, __m128i mmA, __m128i mm2_mu
   *(uint32_t*)(esi) = _mm_cvtsi128_si32(mmA);
 }
 
-// used in mode_temporal
-// R is 2 or 3
-template<int R>
-AVS_FORCEINLINE void frcore_filter_overlap_b4r2or3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2], int process_blocks[2])
+// Blends the scaled sums of the blocks selected by process_blocks into ptrb.
+AVS_FORCEINLINE void simd_2x_blend(uint8_t* ptrb, int pitchb, __m128i weight_acc, __m128i mm4, __m128i mm5, __m128i mm6, __m128i mm7, const int* inv_table, const int weight[2], const int process_blocks[2])
 {
-  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(-2, -2)
-
-  auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
-
-  auto weight_acc = _mm_setzero_si128();
-
-  // reference pixels
-  auto m0 = _mm_load_si64(ptrr); // 4 bytes
-  auto m1 = _mm_load_si64(ptrr + pitchr * 1);
-  auto m2 = _mm_load_si64(ptrr + pitchr * 2);
-  auto m3 = _mm_load_si64(ptrr + pitchr * 3);
-
-  // 4x4 pixels to 2x8 bytes
-  auto ref01 = _mm_unpacklo_epi32(m0, m1);
-  auto ref23 = _mm_unpacklo_epi32(m2, m3);
-
-  // accumulators
-  // each collects 4 words (weighted sums)
-  // which will be finally scaled back and stored as 4 bytes
-  auto mm4 = _mm_setzero_si128();
-  auto mm5 = _mm_setzero_si128();
-  auto mm6 = _mm_setzero_si128();
-  auto mm7 = _mm_setzero_si128();
-
-  if constexpr (R >= 3)
-  {
-    // -3 // top line of y= -3..+3
-    simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    ptra += pitcha; // next line
-  }
-  // -2
-  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  if constexpr (R >= 3)
-  {
-    simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  }
-  ptra += pitcha; // next line
-
-  // -1
-  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  if constexpr (R >= 3)
-  {
-    simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  }
-  ptra += pitcha; // next line
-
-  //; 0
-  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  if constexpr (R >= 3)
-  {
-    simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  }
-  ptra += pitcha;
-
-  // +1
-  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  if constexpr (R >= 3)
-  {
-    simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  }
-
-  ptra += pitcha;
-  // +2
-  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  if constexpr (R >= 3)
-  {
-    simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  }
-
-  if constexpr (R >= 3)
-  {
-    ptra += pitcha;
-    simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-    simd_2x_check(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  }
-
-  // mm4 - mm7 has accumulated sum, weight is ready here
-
   // weight variable is a multi-purpose one, here we get a 32 bit value,
   // which is really two 16 bit words
   // lower 16 and upper 16 bit has separate meaning
@@ -1471,6 +1654,134 @@ AVS_FORCEINLINE void frcore_filter_overlap_b4r2or3_simd(const uint8_t* ptrr, int
   }
 }
 
+// used in mode_temporal
+// R is 2 or 3
+template<int R, bool fast = false>
+AVS_FORCEINLINE void frcore_filter_overlap_b4r2or3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(-2, -2)
+
+  auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
+
+  // fast: the SADs only cover half the pixels
+  if constexpr (fast)
+    thresh = _mm_srli_epi32(_mm_add_epi32(thresh, _mm_set1_epi32(1)), 1);
+
+  auto weight_acc = _mm_setzero_si128();
+
+  // reference pixels
+  auto m0 = _mm_load_si64(ptrr); // 4 bytes
+  auto m1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto m2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto m3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  // 4x4 pixels to 2x8 bytes
+  auto ref01 = _mm_unpacklo_epi32(m0, m1);
+  auto ref23 = _mm_unpacklo_epi32(m2, m3);
+  if constexpr (fast)
+    ref01 = _mm_unpacklo_epi32(m0, m2); // rows 0 and 2 for the SADs
+
+  // accumulators
+  // each collects 4 words (weighted sums)
+  // which will be finally scaled back and stored as 4 bytes
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  if constexpr (R >= 3)
+  {
+    // -3 // top line of y= -3..+3
+    simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    ptra += pitcha; // next line
+  }
+  // -2
+  simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+  ptra += pitcha; // next line
+
+  // -1
+  simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+  ptra += pitcha; // next line
+
+  //; 0
+  simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+  ptra += pitcha;
+
+  // +1
+  simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+
+  ptra += pitcha;
+  // +2
+  simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+
+  if constexpr (R >= 3)
+  {
+    ptra += pitcha;
+    simd_2x_check<fast>(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    simd_2x_check<fast>(ref01, ref23, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  simd_2x_blend(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table, weight, process_blocks);
+}
+
 AVS_FORCEINLINE void frcore_filter_overlap_b4r3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
 {
   frcore_filter_overlap_b4r2or3_simd<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
@@ -1483,58 +1794,303 @@ AVS_FORCEINLINE void frcore_filter_overlap_b4r2_simd(const uint8_t* ptrr, int pi
   frcore_filter_overlap_b4r2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
 }
 
-// mmA is input/output. In simd_blend_store4 mmA in input only
-AVS_FORCEINLINE void simd_2x_blend_diff4(uint8_t* esi, __m128i &mmA, __m128i mm2_multiplier, __m128i mm1_rounder, __m128i mm0_zero)
+AVS_FORCEINLINE void frcore_filter_overlap_fast_b4r3_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
 {
-  auto mm3 = _mm_unpacklo_epi8(_mm_load_si64(esi), mm0_zero);
-  auto mm3_unpacked = mm3;
-  // tmp= ((esi << 6) * multiplier) >> 16  ( == [esi]/1024 * multiplier)
-  // mmA = (mmA + tmp + rounder_16) / 32
-  // ((((mm1 << 2) * multiplier) >> 16 ) + 1) >> 1
-  mm3 = _mm_slli_epi16(mm3, 6);
-  mm3 = _mm_mulhi_epi16(mm3, mm2_multiplier); // pmulhw, signed
-  mmA = _mm_adds_epu16(mmA, mm3);
-  mmA = _mm_adds_epu16(mmA, mm1_rounder);
-  mmA = _mm_srli_epi16(mmA, 5);
+  frcore_filter_overlap_b4r2or3_simd<3, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
 
-  auto mmA_unpacked = mmA;
+AVS_FORCEINLINE void frcore_filter_overlap_fast_b4r2_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_simd<2, true>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
 
-  mmA = _mm_packus_epi16(mmA, mm0_zero); // 4 words to 4 bytes
-  _mm_storel_epi64((__m128i *)esi, mmA);
+// Same as scalar_2x_check_pattern
+template<int R, int pattern, bool fast, int... I>
+AVS_FORCEINLINE void simd_2x_check_pattern(std::integer_sequence<int, I...>, __m128i ref01, __m128i ref23, const uint8_t* ptra, int pitcha, __m128i& racc, __m128i threshold,
+  __m128i& mm4, __m128i& mm5, __m128i& mm6, __m128i& mm7)
+{
+  constexpr int W = 2 * R + 1;
 
-  mmA = _mm_sad_epu8(mmA_unpacked, mm3_unpacked); // this is the only difference from simd_blend_store4
+  ((pattern_has(pattern, R, I % W - R, I / W - R)
+    ? simd_2x_check<fast>(ref01, ref23, I % W, ptra + I / W * pitcha, pitcha, racc, threshold, mm4, mm5, mm6, mm7)
+    : void()), ...);
 }
 
-AVS_FORCEINLINE void frcore_filter_diff_b4r1_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2])
+// Sparse patterns, see SearchPattern
+// Same as frcore_filter_b4r0or2or3_simd, with only the candidates of the pattern.
+template<int R, int pattern, bool fast = false>
+static void frcore_filter_sparse_b4_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table)
 {
-
-  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+  ptra += -R * pitcha - R;
 
   auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
+  if constexpr (fast)
+    thresh = _mm_srli_epi32(_mm_add_epi32(thresh, _mm_set1_epi32(1)), 1);
 
   auto weight_acc = _mm_setzero_si128();
 
-  // reference pixels
-  auto m0 = _mm_load_si64(ptrr); // 4 bytes
+  auto m0 = _mm_load_si64(ptrr);
   auto m1 = _mm_load_si64(ptrr + pitchr * 1);
   auto m2 = _mm_load_si64(ptrr + pitchr * 2);
   auto m3 = _mm_load_si64(ptrr + pitchr * 3);
 
-  // 4x4 pixels to 2x8 bytes
   auto ref01 = _mm_unpacklo_epi32(m0, m1);
   auto ref23 = _mm_unpacklo_epi32(m2, m3);
+  if constexpr (fast)
+    ref01 = _mm_unpacklo_epi32(m0, m2);
 
-  // accumulators
-  // each collects 4 words (weighted sums)
-  // which will be finally scaled back and stored as 4 bytes
   auto mm4 = _mm_setzero_si128();
   auto mm5 = _mm_setzero_si128();
   auto mm6 = _mm_setzero_si128();
   auto mm7 = _mm_setzero_si128();
 
-  // -1
-  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
-  simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check_pattern<R, pattern, fast>(std::make_integer_sequence<int, (2 * R + 1) * (2 * R + 1)>(),
+                                          ref01, ref23, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+
+  simd_2x_store(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table);
+}
+
+// Same as frcore_filter_overlap_b4r2or3_simd, with only the candidates of the pattern.
+template<int R, int pattern, bool fast = false>
+static void frcore_filter_overlap_sparse_b4_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
+  if constexpr (fast)
+    thresh = _mm_srli_epi32(_mm_add_epi32(thresh, _mm_set1_epi32(1)), 1);
+
+  auto weight_acc = _mm_setzero_si128();
+
+  auto m0 = _mm_load_si64(ptrr);
+  auto m1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto m2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto m3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  auto ref01 = _mm_unpacklo_epi32(m0, m1);
+  auto ref23 = _mm_unpacklo_epi32(m2, m3);
+  if constexpr (fast)
+    ref01 = _mm_unpacklo_epi32(m0, m2);
+
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  simd_2x_check_pattern<R, pattern, fast>(std::make_integer_sequence<int, (2 * R + 1) * (2 * R + 1)>(),
+                                          ref01, ref23, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+
+  simd_2x_blend(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table, weight, process_blocks);
+}
+
+// Same as simd_2x_check, also sets bit "bit" of the 64 bit half i of mask if the candidate was accepted for block i.
+template <bool fast = false>
+AVS_FORCEINLINE void simd_2x_mcheck(__m128i ref01, __m128i ref23, int offset, const uint8_t* rdst, int rdp_aka_pitch, __m128i& racc, __m128i threshold,
+  __m128i& mm4, __m128i& mm5, __m128i& mm6, __m128i& mm7, __m128i& mask, int bit)
+{
+  __m128i sad;
+  simd_2x_sad16<fast>(ref01, ref23, offset, rdst, rdp_aka_pitch, sad);
+  simd_comp(sad, racc, threshold);
+  mask = _mm_or_si128(mask, _mm_and_si128(sad, _mm_set1_epi64x((long long)1 << bit)));
+  simd_2x_acc16(offset, rdst, rdp_aka_pitch, sad, mm4, mm5, mm6, mm7);
+}
+
+// Same as simd_2x_check_pattern, with simd_2x_mcheck. The bit of a candidate is I.
+template<int R, int pattern, bool fast, int... I>
+AVS_FORCEINLINE void simd_2x_mcheck_pattern(std::integer_sequence<int, I...>, __m128i ref01, __m128i ref23, const uint8_t* ptra, int pitcha, __m128i& racc, __m128i threshold,
+  __m128i& mm4, __m128i& mm5, __m128i& mm6, __m128i& mm7, __m128i& mask)
+{
+  constexpr int W = 2 * R + 1;
+
+  ((pattern_has(pattern, R, I % W - R, I / W - R)
+    ? simd_2x_mcheck<fast>(ref01, ref23, I % W, ptra + I / W * pitcha, pitcha, racc, threshold, mm4, mm5, mm6, mm7, mask, I)
+    : void()), ...);
+}
+
+// Same as frcore_filter_joint_b4_scalar
+template<int R, int pattern, bool fast = false>
+static void frcore_filter_joint_b4_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, uint64_t mask[2])
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
+  if constexpr (fast)
+    thresh = _mm_srli_epi32(_mm_add_epi32(thresh, _mm_set1_epi32(1)), 1);
+
+  auto weight_acc = _mm_setzero_si128();
+
+  auto m0 = _mm_load_si64(ptrr);
+  auto m1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto m2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto m3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  auto ref01 = _mm_unpacklo_epi32(m0, m1);
+  auto ref23 = _mm_unpacklo_epi32(m2, m3);
+  if constexpr (fast)
+    ref01 = _mm_unpacklo_epi32(m0, m2);
+
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  auto accepted = _mm_setzero_si128();
+
+  simd_2x_mcheck_pattern<R, pattern, fast>(std::make_integer_sequence<int, (2 * R + 1) * (2 * R + 1)>(),
+                                           ref01, ref23, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, accepted);
+
+  _mm_storeu_si128((__m128i *)mask, accepted);
+
+  simd_2x_store(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table);
+}
+
+// Same as frcore_apply_b4_scalar
+template<int R>
+static void frcore_apply_b4_simd(const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, const uint64_t mask[2], const int* inv_table)
+{
+  constexpr int W = 2 * R + 1;
+
+  ptra += -R * pitcha - R;
+
+  auto weight_acc = _mm_setzero_si128();
+
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  auto masks = _mm_loadu_si128((const __m128i *)mask);
+
+  // Usually only a few candidates are set, the others are skipped.
+  for (uint64_t any = mask[0] | mask[1]; any; any &= any - 1) {
+      int bit = __builtin_ctzll(any);
+
+      // bit "bit" of each half to all 0 or all FF, like simd_comp does with the sads
+      auto accepted = _mm_srai_epi32(_mm_sll_epi64(masks, _mm_cvtsi32_si128(63 - bit)), 31);
+      accepted = _mm_shuffle_epi32(accepted, _MM_SHUFFLE(3, 3, 1, 1));
+      weight_acc = _mm_sub_epi32(weight_acc, accepted);
+      simd_2x_acc16(bit % W, ptra + bit / W * pitcha, pitcha, accepted, mm4, mm5, mm6, mm7);
+  }
+
+  simd_2x_store(ptrb, pitchb, weight_acc, mm4, mm5, mm6, mm7, inv_table);
+}
+
+// Stores the SADs of simd_2x_sad16 at sads[0] and sads[64].
+template <bool fast = false>
+AVS_FORCEINLINE void simd_2x_sads(__m128i ref01, __m128i ref23, int offset, const uint8_t* rdst, int rdp_aka_pitch, int16_t* sads)
+{
+  __m128i sad;
+  simd_2x_sad16<fast>(ref01, ref23, offset, rdst, rdp_aka_pitch, sad);
+  sads[0] = (int16_t)_mm_cvtsi128_si32(sad);
+  sads[64] = (int16_t)_mm_extract_epi16(sad, 4);
+}
+
+template<int R, int pattern, bool fast, int... I>
+AVS_FORCEINLINE void simd_2x_sads_pattern(std::integer_sequence<int, I...>, __m128i ref01, __m128i ref23, const uint8_t* ptra, int pitcha, int16_t* sads)
+{
+  constexpr int W = 2 * R + 1;
+
+  ((pattern_has(pattern, R, I % W - R, I / W - R)
+    ? simd_2x_sads<fast>(ref01, ref23, I % W, ptra + I / W * pitcha, pitcha, sads + I)
+    : void()), ...);
+}
+
+// Same as frcore_masks_b4_scalar
+template<int R, int pattern, bool fast = false>
+static void frcore_masks_b4_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, const int* thresh, int num_thresh, uint64_t* mask)
+{
+  constexpr int W = 2 * R + 1;
+  constexpr int words = (W * W + 15) & ~15;
+
+  ptra += -R * pitcha - R;
+
+  // [i * 64 + bit], those the pattern leaves out and the padding are never accepted.
+  // A SAD is at most 16 * 255, so the thresholds are limited to 16 * 256.
+  alignas(16) int16_t sads[2 * 64];
+  for (int i = 0; i < 2 * 64; i++)
+    sads[i] = INT16_MAX;
+
+  auto m0 = _mm_load_si64(ptrr);
+  auto m1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto m2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto m3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  auto ref01 = _mm_unpacklo_epi32(m0, m1);
+  auto ref23 = _mm_unpacklo_epi32(m2, m3);
+  if constexpr (fast)
+    ref01 = _mm_unpacklo_epi32(m0, m2);
+
+  simd_2x_sads_pattern<R, pattern, fast>(std::make_integer_sequence<int, W * W>(),
+                                         ref01, ref23, ptra, pitcha, sads);
+
+  for (int k = 0; k < num_thresh * 2; k++) {
+      // fast: the SADs only cover half the pixels
+      const int t = fast ? (thresh[k] + 1) >> 1 : thresh[k];
+      const auto t16 = _mm_set1_epi16((short)std::min(t, 16 * 256));
+      const int16_t *s = sads + (k & 1) * 64;
+
+      uint64_t m = 0;
+      for (int bit = 0; bit < words; bit += 16) {
+          auto lo = _mm_cmplt_epi16(_mm_load_si128((const __m128i *)(s + bit)), t16);
+          auto hi = _mm_cmplt_epi16(_mm_load_si128((const __m128i *)(s + bit + 8)), t16);
+          m |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_packs_epi16(lo, hi)) << bit;
+      }
+      mask[k] = m;
+  }
+}
+
+// mmA is input/output. In simd_blend_store4 mmA in input only
+AVS_FORCEINLINE void simd_2x_blend_diff4(uint8_t* esi, __m128i &mmA, __m128i mm2_multiplier, __m128i mm1_rounder, __m128i mm0_zero)
+{
+  auto mm3 = _mm_unpacklo_epi8(_mm_load_si64(esi), mm0_zero);
+  auto mm3_unpacked = mm3;
+  // tmp= ((esi << 6) * multiplier) >> 16  ( == [esi]/1024 * multiplier)
+  // mmA = (mmA + tmp + rounder_16) / 32
+  // ((((mm1 << 2) * multiplier) >> 16 ) + 1) >> 1
+  mm3 = _mm_slli_epi16(mm3, 6);
+  mm3 = _mm_mulhi_epi16(mm3, mm2_multiplier); // pmulhw, signed
+  mmA = _mm_adds_epu16(mmA, mm3);
+  mmA = _mm_adds_epu16(mmA, mm1_rounder);
+  mmA = _mm_srli_epi16(mmA, 5);
+
+  auto mmA_unpacked = mmA;
+
+  mmA = _mm_packus_epi16(mmA, mm0_zero); // 4 words to 4 bytes
+  _mm_storel_epi64((__m128i *)esi, mmA);
+
+  mmA = _mm_sad_epu8(mmA_unpacked, mm3_unpacked); // this is the only difference from simd_blend_store4
+}
+
+AVS_FORCEINLINE void frcore_filter_diff_b4r1_simd(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2])
+{
+
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  auto thresh = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
+
+  auto weight_acc = _mm_setzero_si128();
+
+  // reference pixels
+  auto m0 = _mm_load_si64(ptrr); // 4 bytes
+  auto m1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto m2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto m3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  // 4x4 pixels to 2x8 bytes
+  auto ref01 = _mm_unpacklo_epi32(m0, m1);
+  auto ref23 = _mm_unpacklo_epi32(m2, m3);
+
+  // accumulators
+  // each collects 4 words (weighted sums)
+  // which will be finally scaled back and stored as 4 bytes
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  // -1
+  simd_2x_check(ref01, ref23, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  simd_2x_check(ref01, ref23, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   simd_2x_check(ref01, ref23, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
   ptra += pitcha; // next line
 
@@ -1678,77 +2234,1701 @@ AVS_FORCEINLINE void frcore_sad_2x_b4_simd(const uint8_t* ptra, int pitcha, cons
   sad[1] = _mm_cvtsi128_si32(_mm_srli_si128(sad1, 8));
 }
 
-#else // not x86
+#else // not x86
+
+#define frcore_dev_2x_b4_simd                frcore_dev_2x_b4_scalar
+#define frcore_sad_2x_b4_simd                frcore_sad_2x_b4_scalar
+#define frcore_filter_b4r0_simd              frcore_filter_b4r0_scalar
+#define frcore_filter_overlap_b4r2_simd      frcore_filter_overlap_b4r2_scalar
+#define frcore_filter_overlap_b4r3_simd      frcore_filter_overlap_b4r3_scalar
+#define frcore_filter_adapt_b4r2_simd        frcore_filter_adapt_b4r2_scalar
+#define frcore_filter_adapt_b4r3_simd        frcore_filter_adapt_b4r3_scalar
+#define frcore_filter_b4r2_simd              frcore_filter_b4r2_scalar
+#define frcore_filter_b4r3_simd              frcore_filter_b4r3_scalar
+#define frcore_filter_diff_b4r1_simd         frcore_filter_diff_b4r1_scalar
+#define frcore_filter_fast_b4r2_simd         frcore_filter_fast_b4r2_scalar
+#define frcore_filter_fast_b4r3_simd         frcore_filter_fast_b4r3_scalar
+#define frcore_filter_adapt_fast_b4r2_simd   frcore_filter_adapt_fast_b4r2_scalar
+#define frcore_filter_adapt_fast_b4r3_simd   frcore_filter_adapt_fast_b4r3_scalar
+#define frcore_filter_overlap_fast_b4r2_simd frcore_filter_overlap_fast_b4r2_scalar
+#define frcore_filter_overlap_fast_b4r3_simd frcore_filter_overlap_fast_b4r3_scalar
+#define frcore_filter_sparse_b4_simd         frcore_filter_sparse_b4_scalar
+#define frcore_filter_overlap_sparse_b4_simd frcore_filter_overlap_sparse_b4_scalar
+#define frcore_filter_joint_b4_simd          frcore_filter_joint_b4_scalar
+#define frcore_apply_b4_simd                 frcore_apply_b4_scalar
+#define frcore_masks_b4_simd                 frcore_masks_b4_scalar
+
+#endif
+
+
+AVS_FORCEINLINE int clipb(int weight) {
+  return weight < 0 ? 0 : weight > 255 ? 255 : weight;
+}
+
+
+
+enum SIMD_or_scalar {
+    Auto = -1,
+    Scalar = 0,
+    SIMD = 1,
+    SSE41 = 2,
+    AVX2 = 3,
+    Vector = 4 // portable, GCC/Clang vector extensions
+};
+
+
+// pixel_t: uint8_t, uint16_t for 9 to 16 bit video, or float.
+// sad_t is the type of the SADs, thresholds, weights and reciprocals of its kernels.
+// t, tuv, tp1 and the adaptive radius thresholds are in 8 bit units, from_8bit and
+// to_8bit convert them. sad_shift: bits per sample - 8, 0 for float.
+template <typename pixel_t>
+struct PixelTraits {
+    typedef int sad_t;
+
+    static int from_8bit(int value, int sad_shift) { return value << sad_shift; }
+    static int to_8bit(int sad, int sad_shift) { return sad >> sad_shift; }
+
+    static int weight(int k) { return get_weight(k); } // two 16 bit values inside
+
+    // Only the candidates identical to the block pass this one.
+    static constexpr int thresh_min = 1;
+
+    static int thresh(int dev, int lambda, int tmax) {
+        int64_t t = ((int64_t)dev * lambda) >> 10; // dev is up to 16 * 65535
+        int thresh = (t > tmax) ? tmax : (int)t;
+        return thresh < thresh_min ? thresh_min : thresh;
+    }
+};
+
+// Float video is between 0 and 1 (-0.5 and 0.5 for chroma), so 1 in 8 bit units is 1 / 255.
+template <>
+struct PixelTraits<float> {
+    typedef float sad_t;
+
+    static float from_8bit(int value, int) { return value * (1.0f / 255); }
+    static int to_8bit(float sad, int) { return sad * 255 < 255 ? (int)(sad * 255) : 255; }
+
+    static float weight(int k) { return (float)k; } // the weight of the old pixels, see scalarf_2x_blend
+
+    // The lower limit is there for the same reason as 1 with integers: every block matches itself.
+    static constexpr float thresh_min = 1.0f / 65536;
+
+    static float thresh(float dev, int lambda, float tmax) {
+        float thresh = dev * lambda * (1.0f / 1024);
+        thresh = (thresh > tmax) ? tmax : thresh;
+        return thresh < thresh_min ? thresh_min : thresh;
+    }
+};
+
+template <typename pixel_t> using SadType = typename PixelTraits<pixel_t>::sad_t;
+
+template <typename pixel_t> using DevFunc = void (*)(const pixel_t* ptra, int pitcha, SadType<pixel_t>* dev);
+template <typename pixel_t> using SadFunc = void (*)(const pixel_t* ptra, int pitcha, const pixel_t* ptrb, int pitchb, SadType<pixel_t>* sad);
+template <typename pixel_t> using FilterFunc = void (*)(const pixel_t* ptrr, int pitchr, const pixel_t* ptra, int pitcha, pixel_t* ptrb, int pitchb, SadType<pixel_t>* thresh, const SadType<pixel_t>* inv_table);
+template <typename pixel_t> using AdaptFunc = void (*)(const pixel_t* ptrr, int pitchr, const pixel_t* ptra, int pitcha, pixel_t* ptrb, int pitchb, SadType<pixel_t>* thresh, SadType<pixel_t> sThresh2, SadType<pixel_t> sThresh3, const SadType<pixel_t>* inv_table);
+template <typename pixel_t> using OverlapFunc = void (*)(const pixel_t* ptrr, int pitchr, const pixel_t* ptra, int pitcha, pixel_t* ptrb, int pitchb, SadType<pixel_t>* thresh, const SadType<pixel_t>* inv_table, SadType<pixel_t>* weight, int* process_blocks);
+template <typename pixel_t> using DiffFunc = void (*)(const pixel_t* ptrr, int pitchr, const pixel_t* ptra, int pitcha, pixel_t* ptrb, int pitchb, SadType<pixel_t>* thresh, const SadType<pixel_t>* inv_table, SadType<pixel_t>* weight);
+typedef void (*JointFunc)(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int* thresh, const int* inv_table, uint64_t* mask);
+typedef void (*ApplyFunc)(const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, const uint64_t* mask, const int* inv_table);
+typedef void (*MasksFunc)(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, const int* thresh, int num_thresh, uint64_t* mask);
+typedef void (*DevUVFunc)(const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, int* dev);
+typedef void (*FilterUVFunc)(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int* thresh, const int* inv_table);
+typedef void (*AdaptUVFunc)(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int* thresh, int sThresh2, int sThresh3, const int* inv_table);
+
+// The kernels for one step of horizontally adjacent blocks.
+// The arrays are indexed by radius - 2.
+template <typename pixel_t>
+struct BlockKernels {
+    DevFunc<pixel_t> dev;
+    SadFunc<pixel_t> sad;
+    FilterFunc<pixel_t> filter_b4r0;
+    FilterFunc<pixel_t> filter[2];
+    AdaptFunc<pixel_t> filter_adapt[2];
+    OverlapFunc<pixel_t> filter_overlap[2];
+    DiffFunc<pixel_t> filter_diff_b4r1;
+    bool copy_at_thresh_min; // see process_blocks_1stpass
+};
+
+// The first pass kernels for one step of two horizontally adjacent blocks
+// in the U plane and the same two in the V plane. dev and thresh are U0, U1, V0, V1.
+typedef struct UVKernels {
+    DevUVFunc dev;
+    FilterUVFunc filter[2];
+    AdaptUVFunc filter_adapt[2];
+} UVKernels;
+
+// Picked once in frfun7Create. With uint16_t and float only the BlockKernels are used,
+// and narrow_rows16 is the same as narrow.
+template <typename pixel_t>
+struct Frfun7Kernels {
+    bool has_wide; // AVX2
+    BlockKernels<pixel_t> wide; // four blocks
+    BlockKernels<pixel_t> narrow; // two blocks, anywhere in the plane
+    BlockKernels<pixel_t> narrow_rows16; // two blocks, only where 16 bytes read from cpln(sx - R, *) stay inside the plane
+    bool has_uv; // AVX2, both chroma planes in the first pass
+    UVKernels uv; // anywhere in the planes
+    bool fast; // the candidates are matched on rows 0 and 2 only
+    int pattern; // SearchPattern of the filter and filter_overlap kernels
+    JointFunc filter_joint[2]; // two blocks, joint chroma first pass of the luma plane
+    ApplyFunc apply[2]; // two blocks, joint chroma first pass of the chroma planes, and that of several strengths
+    MasksFunc masks[2]; // two blocks, first pass of several strengths
+};
+
+// Joint chroma: the candidates accepted in the first pass of the luma plane,
+// which the first pass of the chroma planes averages without matching its own.
+typedef struct JointMasks {
+    uint64_t *masks; // see frcore_filter_joint_b4_scalar, [y / 4 * stride + x / 4] for the block of the step at (x, y)
+    int stride; // number of steps per row * 2
+    int rows;
+    int luma_x, luma_y; // size of the luma plane
+    int sub_x, sub_y; // 1 << subsampling of the chroma planes
+} JointMasks;
+
+enum JointRole {
+    JointOff = 0,
+    JointLuma = 1, // records JointMasks
+    JointChroma = 2 // reads JointMasks
+};
+
+// Temporal mode with r1 2 or 3: the SADs between the blocks of the first pass and the same
+// blocks of the previous and the next frame, [y / 4 * stride + x / 4] for the block of the
+// step at (x, y) of process_plane_1stpass. They are computed there unless prev_known or next_known.
+template <typename sad_t>
+struct TemporalSads {
+    sad_t *prev;
+    sad_t *next;
+    int stride; // number of steps per row * 2
+    bool prev_known;
+    bool next_known;
+};
+
+// The SADs of TemporalSads between two frames are the same from either of them,
+// so whichever is processed first leaves its map here and the other one takes it out.
+// Maps nobody takes, because the frames were requested out of order or both computed
+// them at the same time, are dropped oldest first beyond max_maps.
+class SadCache {
+public:
+    ~SadCache() {
+        for (const Entry &e : entries)
+            vs_aligned_free(e.map);
+    }
+
+    // first: the lower of the two frame numbers. Returns nullptr if the map isn't there.
+    void *take(int first, int plane, int format_id, size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            const Entry &e = entries[i];
+            if (e.first == first && e.plane == plane && e.format_id == format_id && e.size == size) {
+                void *map = e.map;
+                entries.erase(entries.begin() + i);
+                return map;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Takes ownership of map.
+    void put(int first, int plane, int format_id, size_t size, void *map) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        for (const Entry &e : entries) {
+            if (e.first == first && e.plane == plane && e.format_id == format_id && e.size == size) {
+                vs_aligned_free(map);
+                return;
+            }
+        }
+
+        if (entries.size() == max_maps) {
+            vs_aligned_free(entries.front().map);
+            entries.erase(entries.begin());
+        }
+
+        entries.push_back({ first, plane, format_id, size, map });
+    }
+
+private:
+    static constexpr size_t max_maps = 24; // 8 pairs of frames with 3 planes
+
+    struct Entry {
+        int first, plane, format_id;
+        size_t size;
+        void *map;
+    };
+
+    std::mutex lock;
+    std::vector<Entry> entries; // oldest first
+};
+
+// Static block reuse: the 4x4 blocks of a plane whose source within reuse_radius pixels
+// is identical to that of a frame processed earlier, so their output is too. It is copied
+// from that frame's output, and the steps of process_plane_1stpass and process_plane_overlap
+// which only write such blocks are skipped. Not in temporal mode, where the maps of
+// TemporalSads must be complete.
+// With a mask these are instead the blocks outside of it, whose output is the source.
+typedef struct StaticBlocks {
+    uint8_t *blocks; // 1 if static, [y / 4 * stride + x / 4]
+    int stride;
+    int width, height; // in blocks
+} StaticBlocks;
+
+// True if every 4x4 block touched by the w x h pixels at (x, y) is static.
+// Without static block reuse sb is nullptr.
+static AVS_FORCEINLINE bool is_static(const StaticBlocks *sb, int x, int y, int w, int h) {
+    if (!sb)
+        return false;
+
+    const int bx0 = std::max(x, 0) / 4;
+    const int by0 = std::max(y, 0) / 4;
+    const int bx1 = std::min((x + w - 1) / 4, sb->width - 1);
+    const int by1 = std::min((y + h - 1) / 4, sb->height - 1);
+
+    for (int by = by0; by <= by1; by++)
+        for (int bx = bx0; bx <= bx1; bx++)
+            if (!sb->blocks[by * sb->stride + bx])
+                return false;
+
+    return true;
+}
+
+// Static block reuse: the source and output of the last frames processed.
+// Without the temporal mode the output of a block only depends on the source around it
+// in the same frame, so any frame will do, not just the previous one.
+class ReuseCache {
+public:
+    // Returns new references to the frames stored nearest to n, or false if there are none.
+    bool get(int n, const VSFrameRef **src, const VSFrameRef **dst, const VSAPI *vsapi) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        const Entry *best = nullptr;
+        for (const Entry &e : entries)
+            if (e.src && (!best || std::abs(e.n - n) < std::abs(best->n - n)))
+                best = &e;
+
+        if (!best)
+            return false;
+
+        *src = vsapi->cloneFrameRef(best->src);
+        *dst = vsapi->cloneFrameRef(best->dst);
+        return true;
+    }
+
+    // Keeps new references to src and dst in place of the oldest frames.
+    void put(int n, const VSFrameRef *src, const VSFrameRef *dst, const VSAPI *vsapi) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        for (const Entry &e : entries)
+            if (e.src && e.n == n)
+                return;
+
+        Entry &e = entries[next];
+        next = (next + 1) % max_frames;
+
+        vsapi->freeFrame(e.src);
+        vsapi->freeFrame(e.dst);
+        e.n = n;
+        e.src = vsapi->cloneFrameRef(src);
+        e.dst = vsapi->cloneFrameRef(dst);
+    }
+
+    // The frames can't be freed in the destructor, it has no VSAPI.
+    void clear(const VSAPI *vsapi) {
+        for (Entry &e : entries) {
+            vsapi->freeFrame(e.src);
+            vsapi->freeFrame(e.dst);
+            e.src = e.dst = nullptr;
+        }
+    }
+
+private:
+    static constexpr int max_frames = 2;
+
+    struct Entry {
+        int n;
+        const VSFrameRef *src;
+        const VSFrameRef *dst;
+    };
+
+    std::mutex lock;
+    Entry entries[max_frames] = {};
+    int next = 0; // oldest entry
+};
+
+// Several strengths: each output of the filter is one strength, and all of them are
+// computed together. The frames of the outputs other than the requested one wait here
+// until they are requested too. Those nobody takes, because the outputs are requested
+// far apart, are dropped oldest first beyond max_frames and computed again if needed.
+class StrengthCache {
+public:
+    // Returns the frame of output index, or nullptr if it isn't there.
+    const VSFrameRef *take(int n, int index) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            const Entry &e = entries[i];
+            if (e.n == n && e.index == index) {
+                const VSFrameRef *frame = e.frame;
+                entries.erase(entries.begin() + i);
+                return frame;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Takes ownership of frame.
+    void put(int n, int index, const VSFrameRef *frame, const VSAPI *vsapi) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        for (const Entry &e : entries) {
+            if (e.n == n && e.index == index) {
+                vsapi->freeFrame(frame);
+                return;
+            }
+        }
+
+        if (entries.size() == max_frames) {
+            vsapi->freeFrame(entries.front().frame);
+            entries.erase(entries.begin());
+        }
+
+        entries.push_back({ n, index, frame });
+    }
+
+    // The frames can't be freed in the destructor, it has no VSAPI.
+    void clear(const VSAPI *vsapi) {
+        for (const Entry &e : entries)
+            vsapi->freeFrame(e.frame);
+        entries.clear();
+    }
+
+private:
+    static constexpr size_t max_frames = 32;
+
+    struct Entry {
+        int n, index;
+        const VSFrameRef *frame;
+    };
+
+    std::mutex lock;
+    std::vector<Entry> entries; // oldest first
+};
+
+// tmax is in 8 bit units, see PixelTraits.
+template <typename pixel_t>
+using PlaneFunc = void (*)(const Frfun7Kernels<pixel_t> &kernels,
+                           const pixel_t *srcp_orig, int src_pitch,
+                           const pixel_t *srcp_prev_orig, int src_prev_pitch,
+                           const pixel_t *srcp_next_orig, int src_next_pitch,
+                           pixel_t *dstp_orig, int dstp_pitch,
+                           int dim_x, int dim_y,
+                           int R_1stpass, int lambda, int P1_param, int tmax, int sad_shift,
+                           const SadType<pixel_t> *inv_table,
+                           uint8_t *wpln, int wp_stride,
+                           const JointMasks *jm,
+                           const TemporalSads<SadType<pixel_t>> *sads,
+                           const StaticBlocks *sb);
+
+typedef void (*PlanesUVFunc)(const Frfun7Kernels<uint8_t> &kernels,
+                             const uint8_t *srcp_u, const uint8_t *srcp_v, int src_pitch,
+                             uint8_t *dstp_u, uint8_t *dstp_v, int dstp_pitch,
+                             int dim_x, int dim_y,
+                             int lambda, int P1_param, int tmax,
+                             const int *inv_table,
+                             uint8_t *wpln, int wp_stride);
+
+// Several strengths, see process_plane_strengths. dstps, dstp_pitches, lambdas, and tmaxes
+// have num_strengths elements.
+typedef void (*StrengthsFunc)(const Frfun7Kernels<uint8_t> &kernels,
+                              const uint8_t *srcp_orig, int src_pitch,
+                              uint8_t *const *dstps, const int *dstp_pitches,
+                              int dim_x, int dim_y,
+                              int num_strengths, const int *lambdas, const int *tmaxes, int P1_param,
+                              const int *inv_table,
+                              uint8_t *wpln, int wp_stride);
+
+
+// The most values of l and t, see StrengthCache.
+constexpr int MaxStrengths = 8;
+
+
+typedef struct Frfun7Data {
+    VSNodeRef *clip;
+    const VSVideoInfo *vi;
+
+    int process[3];
+
+    int inv_table[1024];
+    int inv_table16[1024]; // see frcore_filter_u16_b4r2_scalar
+    float inv_table_float[1024]; // 1 / x
+    int lambda, Thresh_luma, Thresh_chroma;
+    int P;
+    int P1_param;
+    int R_1stpass; // Radius of first pass, originally 3, can be 2 to 7
+    int opt;
+    Frfun7Kernels<uint8_t> kernels;
+    Frfun7Kernels<uint16_t> kernels16; // more than 8 bits
+    Frfun7Kernels<float> kernels_float;
+    PlaneFunc<uint8_t> plane_func; // see select_process_plane
+    PlaneFunc<uint8_t> plane_func_chroma; // the same except with joint
+    PlaneFunc<uint16_t> plane_func16; // more than 8 bits, every plane, see select_process_plane_hbd
+    PlaneFunc<float> plane_func_float; // float, every plane
+    bool joint; // luma-guided first pass of the chroma planes, see JointMasks
+    PlanesUVFunc planes_uv_func; // both chroma planes at once instead of plane_func_chroma, or nullptr. See select_process_planes_uv
+    SadCache *sad_cache; // temporal mode with r1 2 or 3, otherwise nullptr
+    ReuseCache *reuse_cache; // static block reuse, otherwise nullptr
+    int num_strengths; // number of outputs, more than 1 if l or t has several values
+    int lambdas[MaxStrengths]; // lambda and Thresh_luma of each output, the first ones are lambda and Thresh_luma
+    int Thresh_lumas[MaxStrengths];
+    StrengthsFunc strengths_func; // with several strengths, every plane, see process_plane_strengths
+    StrengthCache *strength_cache; // with several strengths, otherwise nullptr
+    int iterations; // times each frame is processed, the output of one being the source of the next
+    VSNodeRef *mask; // 8 bit, the blocks where it is 0 keep the source, or nullptr. See find_masked_blocks
+} Frfun7Data;
+
+
+static void VS_CC frfun7Init(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    (void)in;
+    (void)out;
+    (void)core;
+
+    Frfun7Data *d = (Frfun7Data *) *instanceData;
+
+    VSVideoInfo vi[MaxStrengths];
+    for (int i = 0; i < d->num_strengths; i++)
+        vi[i] = *d->vi;
+
+    vsapi->setVideoInfo(vi, d->num_strengths, node);
+}
+
+
+static bool cpu_supports(int opt) {
+    if (opt == Scalar || opt == Vector)
+        return true;
+
+#ifdef FRFUN7_X86
+    __builtin_cpu_init();
+    if (opt == SIMD)
+        return __builtin_cpu_supports("sse2");
+    if (opt == SSE41)
+        return __builtin_cpu_supports("sse4.1");
+    if (opt == AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+
+    return false;
+}
+
+// The fastest implementation this CPU supports.
+static int detect_cpu_opt() {
+    for (int opt : { AVX2, SSE41, SIMD })
+        if (cpu_supports(opt))
+            return opt;
+
+    return Vector;
+}
+
+
+template <int pattern, bool fast>
+static void fill_sparse_kernels(BlockKernels<uint8_t> *k, bool simd) {
+    if (simd) {
+        k->filter[0] = frcore_filter_sparse_b4_simd<2, pattern, fast>;
+        k->filter[1] = frcore_filter_sparse_b4_simd<3, pattern, fast>;
+        k->filter_overlap[0] = frcore_filter_overlap_sparse_b4_simd<2, pattern, fast>;
+        k->filter_overlap[1] = frcore_filter_overlap_sparse_b4_simd<3, pattern, fast>;
+    } else {
+        k->filter[0] = frcore_filter_sparse_b4_scalar<2, pattern, fast>;
+        k->filter[1] = frcore_filter_sparse_b4_scalar<3, pattern, fast>;
+        k->filter_overlap[0] = frcore_filter_overlap_sparse_b4_scalar<2, pattern, fast>;
+        k->filter_overlap[1] = frcore_filter_overlap_sparse_b4_scalar<3, pattern, fast>;
+    }
+}
+
+template <int pattern>
+static void fill_sparse_kernels(BlockKernels<uint8_t> *k, bool simd, bool fast) {
+    if (fast)
+        fill_sparse_kernels<pattern, true>(k, simd);
+    else
+        fill_sparse_kernels<pattern, false>(k, simd);
+}
+
+template <int pattern, bool fast>
+static void fill_joint_kernels(Frfun7Kernels<uint8_t> *kernels, bool simd) {
+    if (simd) {
+        kernels->filter_joint[0] = frcore_filter_joint_b4_simd<2, pattern, fast>;
+        kernels->filter_joint[1] = frcore_filter_joint_b4_simd<3, pattern, fast>;
+        kernels->apply[0] = frcore_apply_b4_simd<2>;
+        kernels->apply[1] = frcore_apply_b4_simd<3>;
+        kernels->masks[0] = frcore_masks_b4_simd<2, pattern, fast>;
+        kernels->masks[1] = frcore_masks_b4_simd<3, pattern, fast>;
+    } else {
+        kernels->filter_joint[0] = frcore_filter_joint_b4_scalar<2, pattern, fast>;
+        kernels->filter_joint[1] = frcore_filter_joint_b4_scalar<3, pattern, fast>;
+        kernels->apply[0] = frcore_apply_b4_scalar<2>;
+        kernels->apply[1] = frcore_apply_b4_scalar<3>;
+        kernels->masks[0] = frcore_masks_b4_scalar<2, pattern, fast>;
+        kernels->masks[1] = frcore_masks_b4_scalar<3, pattern, fast>;
+    }
+}
+
+template <int pattern>
+static void fill_joint_kernels(Frfun7Kernels<uint8_t> *kernels, bool simd, bool fast) {
+    if (fast)
+        fill_joint_kernels<pattern, true>(kernels, simd);
+    else
+        fill_joint_kernels<pattern, false>(kernels, simd);
+}
+
+static void fill_kernels(Frfun7Kernels<uint8_t> *kernels, int opt, bool fast, int pattern) {
+    if (opt == Scalar) {
+        kernels->narrow = {
+            frcore_dev_2x_b4_scalar,
+            frcore_sad_2x_b4_scalar,
+            frcore_filter_b4r0_scalar,
+            { frcore_filter_b4r2_scalar, frcore_filter_b4r3_scalar },
+            { frcore_filter_adapt_b4r2_scalar, frcore_filter_adapt_b4r3_scalar },
+            { frcore_filter_overlap_b4r2_scalar, frcore_filter_overlap_b4r3_scalar },
+            frcore_filter_diff_b4r1_scalar,
+            false
+        };
+    } else if (opt == Vector) {
+        kernels->narrow = {
+            frcore_dev_2x_b4_vec,
+            frcore_sad_2x_b4_vec,
+            frcore_filter_b4r0_vec,
+            { frcore_filter_b4r2_vec, frcore_filter_b4r3_vec },
+            { frcore_filter_adapt_b4r2_vec, frcore_filter_adapt_b4r3_vec },
+            { frcore_filter_overlap_b4r2_vec, frcore_filter_overlap_b4r3_vec },
+            frcore_filter_diff_b4r1_vec,
+            false
+        };
+    } else {
+        kernels->narrow = {
+            frcore_dev_2x_b4_simd,
+            frcore_sad_2x_b4_simd,
+            frcore_filter_b4r0_simd,
+            { frcore_filter_b4r2_simd, frcore_filter_b4r3_simd },
+            { frcore_filter_adapt_b4r2_simd, frcore_filter_adapt_b4r3_simd },
+            { frcore_filter_overlap_b4r2_simd, frcore_filter_overlap_b4r3_simd },
+            frcore_filter_diff_b4r1_simd,
+            false
+        };
+    }
+
+    kernels->narrow_rows16 = kernels->narrow;
+    kernels->has_wide = false;
+    kernels->has_uv = false;
+
+#ifdef FRFUN7_X86
+    if (opt == SSE41 || opt == AVX2) {
+        BlockKernels<uint8_t> &k = kernels->narrow_rows16;
+        k.filter[0] = frcore_filter_b4r2_sse41;
+        k.filter[1] = frcore_filter_b4r3_sse41;
+        k.filter_adapt[0] = frcore_filter_adapt_b4r2_sse41;
+        k.filter_adapt[1] = frcore_filter_adapt_b4r3_sse41;
+        k.filter_overlap[0] = frcore_filter_overlap_b4r2_sse41;
+        k.filter_overlap[1] = frcore_filter_overlap_b4r3_sse41;
+    }
+
+    if (opt == AVX2) {
+        kernels->has_wide = true;
+        kernels->wide = {
+            frcore_dev_4x_b4_avx2,
+            frcore_sad_4x_b4_avx2,
+            frcore_filter_b4r0_avx2,
+            { frcore_filter_b4r2_avx2, frcore_filter_b4r3_avx2 },
+            { frcore_filter_adapt_b4r2_avx2, frcore_filter_adapt_b4r3_avx2 },
+            { frcore_filter_overlap_b4r2_avx2, frcore_filter_overlap_b4r3_avx2 },
+            frcore_filter_diff_b4r1_avx2,
+            false
+        };
+
+        kernels->has_uv = true;
+        kernels->uv = {
+            frcore_dev_uv_b4_avx2,
+            { frcore_filter_uv_b4r2_avx2, frcore_filter_uv_b4r3_avx2 },
+            { frcore_filter_adapt_uv_b4r2_avx2, frcore_filter_adapt_uv_b4r3_avx2 }
+        };
+    }
+#endif
+
+    // Only the plain C++ and the SSE2 kernels have the subsampled matching,
+    // frfun7Create allows no other opt with it.
+    kernels->fast = fast;
+
+    if (fast) {
+        BlockKernels<uint8_t> &k = kernels->narrow;
+
+        if (opt == Scalar) {
+            k.filter[0] = frcore_filter_fast_b4r2_scalar;
+            k.filter[1] = frcore_filter_fast_b4r3_scalar;
+            k.filter_adapt[0] = frcore_filter_adapt_fast_b4r2_scalar;
+            k.filter_adapt[1] = frcore_filter_adapt_fast_b4r3_scalar;
+            k.filter_overlap[0] = frcore_filter_overlap_fast_b4r2_scalar;
+            k.filter_overlap[1] = frcore_filter_overlap_fast_b4r3_scalar;
+        } else {
+            k.filter[0] = frcore_filter_fast_b4r2_simd;
+            k.filter[1] = frcore_filter_fast_b4r3_simd;
+            k.filter_adapt[0] = frcore_filter_adapt_fast_b4r2_simd;
+            k.filter_adapt[1] = frcore_filter_adapt_fast_b4r3_simd;
+            k.filter_overlap[0] = frcore_filter_overlap_fast_b4r2_simd;
+            k.filter_overlap[1] = frcore_filter_overlap_fast_b4r3_simd;
+        }
+
+        kernels->narrow_rows16 = k;
+    }
+
+    // Same for the sparse patterns. The adaptive radius kernels always check every candidate.
+    kernels->pattern = pattern;
+
+    bool simd = !(opt == Scalar || opt == Vector);
+
+    if (pattern != PatternDense) {
+        BlockKernels<uint8_t> &k = kernels->narrow;
+
+        if (pattern == PatternDiamond)
+            fill_sparse_kernels<PatternDiamond>(&k, simd, fast);
+        else if (pattern == PatternStar)
+            fill_sparse_kernels<PatternStar>(&k, simd, fast);
+        else
+            fill_sparse_kernels<PatternChecker>(&k, simd, fast);
+
+        kernels->narrow_rows16 = k;
+    }
+
+    // The fast and sparse matching may not find the block itself, see process_blocks_1stpass.
+    const bool copy = !fast && pattern == PatternDense;
+    kernels->narrow.copy_at_thresh_min = copy;
+    kernels->narrow_rows16.copy_at_thresh_min = copy;
+    kernels->wide.copy_at_thresh_min = copy;
+
+    // And for the joint chroma kernels, which only the first pass with joint=True and that of several strengths use.
+    if (pattern == PatternDiamond)
+        fill_joint_kernels<PatternDiamond>(kernels, simd, fast);
+    else if (pattern == PatternStar)
+        fill_joint_kernels<PatternStar>(kernels, simd, fast);
+    else if (pattern == PatternChecker)
+        fill_joint_kernels<PatternChecker>(kernels, simd, fast);
+    else
+        fill_joint_kernels<PatternDense>(kernels, simd, fast);
+}
+
+// The kernels for more than 8 bits. There are no SSE4.1, fast, sparse, or joint ones,
+// the SSE4.1 and the portable versions use the SSE2 and the plain C++ kernels.
+static void fill_kernels16(Frfun7Kernels<uint16_t> *kernels, int opt) {
+    memset(kernels, 0, sizeof(*kernels));
+
+    kernels->narrow = {
+        frcore_dev_u16_2x_b4_scalar,
+        frcore_sad_u16_2x_b4_scalar,
+        frcore_filter_u16_b4r0_scalar,
+        { frcore_filter_u16_b4r2_scalar, frcore_filter_u16_b4r3_scalar },
+        { frcore_filter_adapt_u16_b4r2_scalar, frcore_filter_adapt_u16_b4r3_scalar },
+        { frcore_filter_overlap_u16_b4r2_scalar, frcore_filter_overlap_u16_b4r3_scalar },
+        frcore_filter_diff_u16_b4r1_scalar,
+        false
+    };
+
+#ifdef FRFUN7_X86
+    if (opt == SIMD || opt == SSE41 || opt == AVX2) {
+        kernels->narrow = {
+            frcore_dev_u16_2x_b4_simd,
+            frcore_sad_u16_2x_b4_simd,
+            frcore_filter_u16_b4r0_simd,
+            { frcore_filter_u16_b4r2_simd, frcore_filter_u16_b4r3_simd },
+            { frcore_filter_adapt_u16_b4r2_simd, frcore_filter_adapt_u16_b4r3_simd },
+            { frcore_filter_overlap_u16_b4r2_simd, frcore_filter_overlap_u16_b4r3_simd },
+            frcore_filter_diff_u16_b4r1_simd,
+            false
+        };
+    }
+
+    if (opt == AVX2) {
+        kernels->has_wide = true;
+        kernels->wide = {
+            frcore_dev_u16_4x_b4_avx2,
+            frcore_sad_u16_4x_b4_avx2,
+            frcore_filter_u16_b4r0_avx2,
+            { frcore_filter_u16_b4r2_avx2, frcore_filter_u16_b4r3_avx2 },
+            { frcore_filter_adapt_u16_b4r2_avx2, frcore_filter_adapt_u16_b4r3_avx2 },
+            { frcore_filter_overlap_u16_b4r2_avx2, frcore_filter_overlap_u16_b4r3_avx2 },
+            frcore_filter_diff_u16_b4r1_avx2,
+            false
+        };
+    }
+#else
+    (void)opt;
+#endif
+
+    kernels->narrow.copy_at_thresh_min = true;
+    kernels->wide.copy_at_thresh_min = true;
+    kernels->narrow_rows16 = kernels->narrow;
+}
+
+// The same for float. The portable version uses the plain C++ kernels.
+static void fill_kernels_float(Frfun7Kernels<float> *kernels, int opt) {
+    memset(kernels, 0, sizeof(*kernels));
+
+    kernels->narrow = {
+        frcore_dev_float_2x_b4_scalar,
+        frcore_sad_float_2x_b4_scalar,
+        frcore_filter_float_b4r0_scalar,
+        { frcore_filter_float_b4r2_scalar, frcore_filter_float_b4r3_scalar },
+        { frcore_filter_adapt_float_b4r2_scalar, frcore_filter_adapt_float_b4r3_scalar },
+        { frcore_filter_overlap_float_b4r2_scalar, frcore_filter_overlap_float_b4r3_scalar },
+        frcore_filter_diff_float_b4r1_scalar,
+        false
+    };
+
+#ifdef FRFUN7_X86
+    if (opt == SIMD || opt == SSE41 || opt == AVX2) {
+        kernels->narrow = {
+            frcore_dev_float_2x_b4_simd,
+            frcore_sad_float_2x_b4_simd,
+            frcore_filter_float_b4r0_simd,
+            { frcore_filter_float_b4r2_simd, frcore_filter_float_b4r3_simd },
+            { frcore_filter_adapt_float_b4r2_simd, frcore_filter_adapt_float_b4r3_simd },
+            { frcore_filter_overlap_float_b4r2_simd, frcore_filter_overlap_float_b4r3_simd },
+            frcore_filter_diff_float_b4r1_simd,
+            false
+        };
+    }
+
+    if (opt == AVX2) {
+        kernels->has_wide = true;
+        kernels->wide = {
+            frcore_dev_float_4x_b4_avx2,
+            frcore_sad_float_4x_b4_avx2,
+            frcore_filter_float_b4r0_avx2,
+            { frcore_filter_float_b4r2_avx2, frcore_filter_float_b4r3_avx2 },
+            { frcore_filter_adapt_float_b4r2_avx2, frcore_filter_adapt_float_b4r3_avx2 },
+            { frcore_filter_overlap_float_b4r2_avx2, frcore_filter_overlap_float_b4r3_avx2 },
+            frcore_filter_diff_float_b4r1_avx2,
+            false
+        };
+    }
+#else
+    (void)opt;
+#endif
+
+    kernels->narrow_rows16 = kernels->narrow;
+}
+
+
+// Processes N horizontally adjacent blocks with the given kernels (N == 4 only with AVX2).
+// srcp_s/dstp_s: cpln(sx, sy), srcp_b/dstp: cpln(bx, by)
+// sads_xy: index of the first block in the maps of sads, only in temporal mode
+template <int N, bool mode_temporal, int R, typename pixel_t>
+static AVS_FORCEINLINE void process_blocks_1stpass(const BlockKernels<pixel_t> &kernels,
+                                                   const pixel_t *srcp_s, const pixel_t *srcp_b, int src_pitch,
+                                                   const pixel_t *srcp_prev_s, int src_prev_pitch,
+                                                   const pixel_t *srcp_next_s, int src_next_pitch,
+                                                   pixel_t *dstp_s, pixel_t *dstp, int dstp_pitch,
+                                                   bool adaptive_radius_here,
+                                                   int lambda, SadType<pixel_t> tmax, int sad_shift,
+                                                   const SadType<pixel_t> *inv_table,
+                                                   const TemporalSads<SadType<pixel_t>> *sads, int sads_xy) {
+    typedef PixelTraits<pixel_t> Traits;
+
+    SadType<pixel_t> dev[N], devp[N], devn[N];
+    kernels.dev(srcp_s, src_pitch, dev);
+
+    if constexpr (mode_temporal)
+    {
+      // A missing neighbour (across a scene change or past the ends of the clip) is nullptr,
+      // and nothing is compared with it.
+      if (!srcp_prev_s) {
+      } else if (sads->prev_known) {
+        for (int i = 0; i < N; i++)
+          devp[i] = sads->prev[sads_xy + i];
+      } else {
+        kernels.sad(srcp_s, src_pitch, srcp_prev_s, src_prev_pitch, devp);
+        for (int i = 0; i < N; i++)
+          sads->prev[sads_xy + i] = devp[i];
+      }
+
+      if (!srcp_next_s) {
+      } else if (sads->next_known) {
+        for (int i = 0; i < N; i++)
+          devn[i] = sads->next[sads_xy + i];
+      } else {
+        kernels.sad(srcp_s, src_pitch, srcp_next_s, src_next_pitch, devn);
+        for (int i = 0; i < N; i++)
+          sads->next[sads_xy + i] = devn[i];
+      }
+
+      for (int i = 0; i < N; i++) {
+        if (srcp_next_s)
+          dev[i] = std::min(dev[i], devn[i]);
+        if (srcp_prev_s)
+          dev[i] = std::min(dev[i], devp[i]);
+      }
+    }
+
+    SadType<pixel_t> thresh[N];
+    for (int i = 0; i < N; i++)
+        thresh[i] = Traits::thresh(dev[i], lambda, tmax);
+
+
+    if constexpr (mode_temporal) {
+        kernels.filter_b4r0(srcp_b, src_pitch, srcp_b, src_pitch, dstp, dstp_pitch, thresh, inv_table);
+
+        int process_blocks[N];
+        SadType<pixel_t> weight[N];
+        int k[N];
+        int any = 0;
+
+        for (int i = 0; i < N; i++) {
+            process_blocks[i] = srcp_prev_s && devp[i] < thresh[i];
+            any |= process_blocks[i];
+            k[i] = 1;
+        }
+
+        if (any)
+        {
+            for (int i = 0; i < N; i++)
+                weight[i] = Traits::weight(k[i]);
+
+            kernels.filter_overlap[R - 2](srcp_s, src_pitch, srcp_prev_s, src_prev_pitch, dstp_s, dstp_pitch, thresh, inv_table, weight, process_blocks);
+
+            for (int i = 0; i < N; i++)
+                k[i] += process_blocks[i];
+        }
+
+        any = 0;
+        for (int i = 0; i < N; i++) {
+            process_blocks[i] = srcp_next_s && devn[i] < thresh[i];
+            any |= process_blocks[i];
+        }
+
+        if (any)
+        {
+            for (int i = 0; i < N; i++)
+                weight[i] = Traits::weight(k[i]);
+
+            kernels.filter_overlap[R - 2](srcp_s, src_pitch, srcp_next_s, src_next_pitch, dstp_s, dstp_pitch, thresh, inv_table, weight, process_blocks);
+        }
+    }
+    else
+    {
+      // not temporal
+      (void)sads;
+      (void)sads_xy;
+
+      // With every threshold at its minimum only the candidates identical to the block at
+      // (bx, by) are averaged, and that is among them, so the result is the block itself.
+      // Not with float, where the minimum isn't 0 and the average is rounded.
+      bool copy = kernels.copy_at_thresh_min;
+      for (int i = 0; i < N; i++)
+          copy = copy && thresh[i] == Traits::thresh_min;
+
+      if (copy) {
+          for (int y = 0; y < 4; y++)
+              memcpy(dstp + dstp_pitch * y, srcp_b + src_pitch * y, sizeof(pixel_t) * 4 * N);
+          return;
+      }
+
+      if (adaptive_radius_here) {
+        constexpr int thresh2 = 16 * 9; // First try with R=1 then if over threshold R=2 then R=3
+        constexpr int thresh3 = 16 * 25; // only when R=3
+        kernels.filter_adapt[R - 2](srcp_b, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, Traits::from_8bit(thresh2, sad_shift), Traits::from_8bit(thresh3, sad_shift), inv_table);
+      } else {
+        (void)sad_shift;
+        // Nothing or adaptive_overlapping or some case of adaptive_radius
+        kernels.filter[R - 2](srcp_b, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, inv_table);
+      }
+    }
+}
+
+
+// adaptive overlapping, first pass: srcp_s == cpln(sx, sy), srcp_xy == cpln(x, y)
+// The thresholds are also stored in tpln_xy, for pass 4.
+template <int N, typename pixel_t>
+static AVS_FORCEINLINE void process_blocks_diff(const BlockKernels<pixel_t> &kernels,
+                                                const pixel_t *srcp_s, const pixel_t *srcp_xy, int src_pitch,
+                                                pixel_t *dstp, int dstp_pitch,
+                                                int lambda, SadType<pixel_t> tmax, int sad_shift,
+                                                const SadType<pixel_t> *inv_table,
+                                                uint8_t *wpln_xy, SadType<pixel_t> *tpln_xy) {
+    typedef PixelTraits<pixel_t> Traits;
+
+    SadType<pixel_t> dev[N];
+    for (int i = 0; i < N; i++)
+        dev[i] = 10;
+    kernels.dev(srcp_s, src_pitch, dev);
+
+    SadType<pixel_t> thresh[N];
+
+    for (int i = 0; i < N; i++) {
+        thresh[i] = Traits::thresh(dev[i], lambda, tmax);
+        tpln_xy[i] = thresh[i];
+    }
+
+    SadType<pixel_t> weight[N];
+    for (int i = 0; i < N; i++)
+        weight[i] = Traits::weight(1);
+    kernels.filter_diff_b4r1(srcp_xy, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, inv_table, weight);
+
+    for (int i = 0; i < N; i++)
+        wpln_xy[i] = clipb(Traits::to_8bit(weight[i], sad_shift));
+}
+
+
+// adaptive overlapping, passes 1..8: srcp_s == cpln(sx, sy), srcp_xy == cpln(x, y)
+// tpln_xy: nullptr, or the thresholds the diff pass found for the same blocks
+template <int N, typename pixel_t>
+static AVS_FORCEINLINE void process_blocks_overlap(const BlockKernels<pixel_t> &kernels,
+                                                   const pixel_t *srcp_s, const pixel_t *srcp_xy, int src_pitch,
+                                                   pixel_t *dstp, int dstp_pitch,
+                                                   int k, int lambda, int P1_param, SadType<pixel_t> tmax,
+                                                   const SadType<pixel_t> *inv_table,
+                                                   const uint8_t *wpln_xy, const SadType<pixel_t> *tpln_xy) {
+    typedef PixelTraits<pixel_t> Traits;
+
+    int process_blocks[N];
+    int any = 0;
+    for (int i = 0; i < N; i++) {
+        process_blocks[i] = wpln_xy[i] >= P1_param;
+        any |= process_blocks[i];
+    }
+
+    if (!any)
+      return;
+
+    SadType<pixel_t> thresh[N];
+
+    if (tpln_xy) {
+        for (int i = 0; i < N; i++)
+            thresh[i] = tpln_xy[i];
+    } else {
+        SadType<pixel_t> dev[N];
+        for (int i = 0; i < N; i++)
+            dev[i] = 10;
+        kernels.dev(srcp_s, src_pitch, dev);
+
+        for (int i = 0; i < N; i++)
+            thresh[i] = Traits::thresh(dev[i], lambda, tmax);
+    }
+
+    SadType<pixel_t> weight[N];
+    for (int i = 0; i < N; i++)
+        weight[i] = Traits::weight(k);
+
+    kernels.filter_overlap[0](srcp_xy, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, inv_table, weight, process_blocks);
+}
+
+
+// Template parameter of process_plane: any radius above 3.
+// Those go through frcore_1stpass_plane, which takes the radius at run time.
+constexpr int RAny = 0;
+
+
+// First pass for the radii 2 and 3.
+// With AVX2 four blocks are processed per step, except where the search window
+// of either half would be clamped to the plane. Those steps use the two block kernels,
+// so the output is identical to the SSE2 path.
+// The SSE4.1 kernels read 16 bytes per candidate row, near the right edge of the
+// plane the SSE2 ones are used instead.
+// Only the leftmost and rightmost steps of a row clamp sx and bx, the steps
+// in between have sx == bx == x.
+// A step is only skipped if the blocks up to two to the left and right of it and one
+// above and below are static too: the diff pass reads the output of those.
+template <bool mode_temporal, bool mode_adaptive_radius, int R, bool wide, typename pixel_t>
+static void process_plane_1stpass(const Frfun7Kernels<pixel_t> &kernels,
+                                  const pixel_t *srcp_orig, int src_pitch,
+                                  const pixel_t *srcp_prev_orig, int src_prev_pitch,
+                                  const pixel_t *srcp_next_orig, int src_next_pitch,
+                                  pixel_t *dstp_orig, int dstp_pitch,
+                                  int dim_x, int dim_y,
+                                  int lambda, SadType<pixel_t> tmax, int sad_shift,
+                                  const SadType<pixel_t> *inv_table,
+                                  const TemporalSads<SadType<pixel_t>> *sads,
+                                  const StaticBlocks *sb) {
+    constexpr int B = 4;
+    constexpr int S = 4;
+
+    for (int y = 0; y < dim_y + B - 1; y += S)
+    {
+      int sy = y;
+      int by = y;
+      if (sy < R) sy = R;
+      if (sy > dim_y - R - B) sy = dim_y - R - B;
+      if (by > dim_y - B) by = dim_y - B;
+
+      pixel_t* dstp_curr_by = dstp_orig + dstp_pitch * by;
+      pixel_t* dstp_curr_sy = dstp_orig + dstp_pitch * sy;
+      const pixel_t* srcp_curr_sy = srcp_orig + src_pitch * sy; // cpln(sx, sy)
+      const pixel_t* srcp_curr_by = srcp_orig + src_pitch * by; // cpln(bx, by)
+
+      // only for temporal use, and only if there is such a neighbour
+      const pixel_t* srcp_prev_curr_sy = mode_temporal && srcp_prev_orig ? srcp_prev_orig + src_prev_pitch * sy : nullptr; // ppln(sx, sy)
+      const pixel_t* srcp_next_curr_sy = mode_temporal && srcp_next_orig ? srcp_next_orig + src_next_pitch * sy : nullptr; // npln(sx, sy)
+
+      const bool adaptive_radius_row = mode_adaptive_radius && sy == y;
+      // The adaptive kernels search up to 3 columns right of the blocks also with R=2. There
+      // the wide steps stop 1 column earlier, and the 2 blocks that end 2 columns before the
+      // right edge use the plain search.
+      const int reach = adaptive_radius_row ? 3 : R;
+
+      const int sads_y = mode_temporal ? sads->stride * (y / 4) : 0;
+
+      for (int x = 0; x < dim_x + B - 1; )
+      {
+        if (x >= R && x + B * 2 + R <= dim_x) {
+          // sx == bx == x from here until the right edge
+
+          if constexpr (wide) {
+            for (; x + B * 4 + reach <= dim_x; x += S * 4)
+              if (!is_static(sb, x - B * 2, by - B, B * 8, B * 3))
+                process_blocks_1stpass<4, mode_temporal, R>(kernels.wide,
+                                                            srcp_curr_sy + x, srcp_curr_by + x, src_pitch,
+                                                            srcp_prev_curr_sy ? srcp_prev_curr_sy + x : nullptr, src_prev_pitch,
+                                                            srcp_next_curr_sy ? srcp_next_curr_sy + x : nullptr, src_next_pitch,
+                                                            dstp_curr_sy + x, dstp_curr_by + x, dstp_pitch,
+                                                            adaptive_radius_row,
+                                                            lambda, tmax, sad_shift, inv_table,
+                                                            sads, sads_y + x / 4);
+          }
+
+          for (; x + B * 2 + R <= dim_x; x += S * 2)
+            if (!is_static(sb, x - B * 2, by - B, B * 6, B * 3))
+              process_blocks_1stpass<2, mode_temporal, R>(x - R + 16 <= dim_x ? kernels.narrow_rows16 : kernels.narrow,
+                                                          srcp_curr_sy + x, srcp_curr_by + x, src_pitch,
+                                                          srcp_prev_curr_sy ? srcp_prev_curr_sy + x : nullptr, src_prev_pitch,
+                                                          srcp_next_curr_sy ? srcp_next_curr_sy + x : nullptr, src_next_pitch,
+                                                          dstp_curr_sy + x, dstp_curr_by + x, dstp_pitch,
+                                                          adaptive_radius_row && x + B * 2 + 3 <= dim_x,
+                                                          lambda, tmax, sad_shift, inv_table,
+                                                          sads, sads_y + x / 4);
+
+          continue;
+        }
+
+        int sx = x;
+        int bx = x;
+        if (sx < R) sx = R;
+        if (sx > dim_x - R - B * 2) sx = dim_x - R - B * 2;
+        if (bx > dim_x - B * 2) bx = dim_x - B * 2;
+
+        if (!is_static(sb, bx - B * 2, by - B, B * 6, B * 3))
+          process_blocks_1stpass<2, mode_temporal, R>(sx - R + 16 <= dim_x ? kernels.narrow_rows16 : kernels.narrow,
+                                                      srcp_curr_sy + sx, srcp_curr_by + bx, src_pitch,
+                                                      srcp_prev_curr_sy ? srcp_prev_curr_sy + sx : nullptr, src_prev_pitch,
+                                                      srcp_next_curr_sy ? srcp_next_curr_sy + sx : nullptr, src_next_pitch,
+                                                      dstp_curr_sy + sx, dstp_curr_by + bx, dstp_pitch,
+                                                      sx == x && adaptive_radius_row && x + B * 2 + 3 <= dim_x,
+                                                      lambda, tmax, sad_shift, inv_table,
+                                                      sads, sads_y + x / 4);
+        x += S * 2;
+      }
+    }
+}
+
+
+// First pass of both chroma planes at once, for the radii 2 and 3 and without the
+// temporal mode. Each step processes the two blocks of process_plane_1stpass in U
+// and the same two in V, U in the low half of the AVX2 registers and V in the high half,
+// each plane with its own thresholds. The kernels only read the search window of the two
+// blocks, so every step uses them, including those where the window is clamped.
+// The output is identical to process_plane_1stpass on each plane.
+template <bool mode_adaptive_radius, int R>
+static void process_planes_1stpass_uv(const Frfun7Kernels<uint8_t> &kernels,
+                                      const uint8_t *srcp_u, const uint8_t *srcp_v, int src_pitch,
+                                      uint8_t *dstp_u, uint8_t *dstp_v, int dstp_pitch,
+                                      int dim_x, int dim_y,
+                                      int lambda, int tmax,
+                                      const int *inv_table) {
+    constexpr int B = 4;
+    constexpr int S = 4;
+
+    for (int y = 0; y < dim_y + B - 1; y += S)
+    {
+      int sy = y;
+      int by = y;
+      if (sy < R) sy = R;
+      if (sy > dim_y - R - B) sy = dim_y - R - B;
+      if (by > dim_y - B) by = dim_y - B;
+
+      uint8_t* dstp_u_by = dstp_u + dstp_pitch * by;
+      uint8_t* dstp_v_by = dstp_v + dstp_pitch * by;
+      const uint8_t* srcp_u_sy = srcp_u + src_pitch * sy; // cpln(sx, sy)
+      const uint8_t* srcp_v_sy = srcp_v + src_pitch * sy;
+      const uint8_t* srcp_u_by = srcp_u + src_pitch * by; // cpln(bx, by)
+      const uint8_t* srcp_v_by = srcp_v + src_pitch * by;
+
+      const bool adaptive_radius_row = mode_adaptive_radius && sy == y;
+
+      for (int x = 0; x < dim_x + B - 1; x += S * 2)
+      {
+        int sx = x;
+        int bx = x;
+        if (sx < R) sx = R;
+        if (sx > dim_x - R - B * 2) sx = dim_x - R - B * 2;
+        if (bx > dim_x - B * 2) bx = dim_x - B * 2;
+
+        int dev[4];
+        kernels.uv.dev(srcp_u_sy + sx, srcp_v_sy + sx, src_pitch, dev);
+
+        int thresh[4];
+        for (int i = 0; i < 4; i++)
+            thresh[i] = PixelTraits<uint8_t>::thresh(dev[i], lambda, tmax);
+
+        if (adaptive_radius_row && sx == x && x + B * 2 + 3 <= dim_x) {
+          constexpr int thresh2 = 16 * 9;
+          constexpr int thresh3 = 16 * 25;
+          kernels.uv.filter_adapt[R - 2](srcp_u_by + bx, srcp_v_by + bx, src_pitch,
+                                         srcp_u_sy + sx, srcp_v_sy + sx, src_pitch,
+                                         dstp_u_by + bx, dstp_v_by + bx, dstp_pitch,
+                                         thresh, thresh2, thresh3, inv_table);
+        } else {
+          kernels.uv.filter[R - 2](srcp_u_by + bx, srcp_v_by + bx, src_pitch,
+                                   srcp_u_sy + sx, srcp_v_sy + sx, src_pitch,
+                                   dstp_u_by + bx, dstp_v_by + bx, dstp_pitch,
+                                   thresh, inv_table);
+        }
+      }
+    }
+}
+
+
+// Joint chroma: the candidates of the chroma block at (bx, by), searched around (sx, sy),
+// which the luma block at the same place accepted for the same shift of the block.
+// (x, y) is the block's position before clamping, the same for every plane in 4:4:4,
+// where the luma mask is returned as is. With subsampled chroma the shifts are
+// scaled to luma pixels, those the luma block didn't try (further than R) are left out.
+// The chroma block itself is always kept, as the luma block itself is.
+template <int R>
+static uint64_t joint_chroma_mask(const JointMasks &jm, int x, int y, int bx, int by, int sx, int sy) {
+    constexpr int B = 4;
+    constexpr int W = 2 * R + 1;
+
+    // the luma block, same clamping as process_plane_1stpass_joint
+    int gx = std::min(x * jm.sub_x / B, jm.stride - 1);
+    int gy = std::min(y * jm.sub_y / B, jm.rows - 1);
+
+    int lx = gx / 2 * B * 2;
+    int lsx = lx;
+    int lbx = lx;
+    if (lsx < R) lsx = R;
+    if (lsx > jm.luma_x - R - B * 2) lsx = jm.luma_x - R - B * 2;
+    if (lbx > jm.luma_x - B * 2) lbx = jm.luma_x - B * 2;
+    lsx += (gx & 1) * B;
+    lbx += (gx & 1) * B;
+
+    int ly = gy * B;
+    int lsy = ly;
+    int lby = ly;
+    if (lsy < R) lsy = R;
+    if (lsy > jm.luma_y - R - B) lsy = jm.luma_y - R - B;
+    if (lby > jm.luma_y - B) lby = jm.luma_y - B;
+
+    const uint64_t luma_mask = jm.masks[gy * jm.stride + gx];
+
+    // luma displacement of the chroma displacement (0, 0)
+    const int ox = lbx - lsx + (sx - bx) * jm.sub_x;
+    const int oy = lby - lsy + (sy - by) * jm.sub_y;
+
+    if (jm.sub_x == 1 && jm.sub_y == 1 && ox == 0 && oy == 0)
+        return luma_mask;
+
+    uint64_t mask = 0;
+
+    for (int dy = -R; dy <= R; dy++) {
+        int ldy = oy + dy * jm.sub_y;
+        if (ldy < -R || ldy > R)
+            continue;
+
+        for (int dx = -R; dx <= R; dx++) {
+            int ldx = ox + dx * jm.sub_x;
+            if (ldx < -R || ldx > R)
+                continue;
+
+            mask |= ((luma_mask >> ((ldy + R) * W + ldx + R)) & 1) << ((dy + R) * W + dx + R);
+        }
+    }
+
+    return mask;
+}
+
+
+// First pass with joint=True, for the radii 2 and 3 and without the temporal and
+// adaptive radius modes. The luma plane goes first and records which candidates
+// it accepted, the chroma planes then average those (see joint_chroma_mask).
+// All steps use the two block kernels.
+template <int R, bool chroma>
+static void process_plane_1stpass_joint(const Frfun7Kernels<uint8_t> &kernels,
+                                        const uint8_t *srcp_orig, int src_pitch,
+                                        uint8_t *dstp_orig, int dstp_pitch,
+                                        int dim_x, int dim_y,
+                                        int lambda, int tmax,
+                                        const int *inv_table,
+                                        const JointMasks &jm) {
+    constexpr int B = 4;
+    constexpr int S = 4;
+
+    for (int y = 0; y < dim_y + B - 1; y += S)
+    {
+      int sy = y;
+      int by = y;
+      if (sy < R) sy = R;
+      if (sy > dim_y - R - B) sy = dim_y - R - B;
+      if (by > dim_y - B) by = dim_y - B;
+
+      uint8_t* dstp_curr_by = dstp_orig + dstp_pitch * by;
+      const uint8_t* srcp_curr_sy = srcp_orig + src_pitch * sy; // cpln(sx, sy)
+      const uint8_t* srcp_curr_by = srcp_orig + src_pitch * by; // cpln(bx, by)
+      uint64_t* masks_curr_y = jm.masks + jm.stride * (y / B);
+
+      for (int x = 0; x < dim_x + B - 1; x += S * 2)
+      {
+        int sx = x;
+        int bx = x;
+        if (sx < R) sx = R;
+        if (sx > dim_x - R - B * 2) sx = dim_x - R - B * 2;
+        if (bx > dim_x - B * 2) bx = dim_x - B * 2;
+
+        if constexpr (chroma) {
+          uint64_t mask[2];
+          for (int i = 0; i < 2; i++)
+            mask[i] = joint_chroma_mask<R>(jm, x + B * i, y, bx + B * i, by, sx + B * i, sy);
+
+          kernels.apply[R - 2](srcp_curr_sy + sx, src_pitch, dstp_curr_by + bx, dstp_pitch, mask, inv_table);
+        } else {
+          int dev[2];
+          kernels.narrow.dev(srcp_curr_sy + sx, src_pitch, dev);
+
+          int thresh[2];
+          for (int i = 0; i < 2; i++)
+              thresh[i] = PixelTraits<uint8_t>::thresh(dev[i], lambda, tmax);
+
+          kernels.filter_joint[R - 2](srcp_curr_by + bx, src_pitch, srcp_curr_sy + sx, src_pitch, dstp_curr_by + bx, dstp_pitch, thresh, inv_table, masks_curr_y + x / B);
+        }
+      }
+    }
+
+    if constexpr (chroma) {
+      (void)lambda;
+      (void)tmax;
+    }
+}
+
+
+// Adaptive overlapping, the diff pass and passes 1..8.
+// The passes look at the blocks in nine different positions, but the diff pass and pass 4
+// have the same blocks wherever the search window of pass 4 isn't clamped. The thresholds of
+// the diff pass are kept in tpln, one per block like wpln, and pass 4 reuses them.
+// Every step of passes 1..8 reads the weights of the same pair of blocks in wpln,
+// wpln[y / 4 * wp_stride + x / 4] with x / 4 even. With P1_param greater than 0 the pairs
+// with a weight of at least P1_param are listed row by row after the diff pass, and the
+// passes only go through those instead of every step.
+template <bool wide, typename pixel_t>
+static void process_plane_overlap(const Frfun7Kernels<pixel_t> &kernels,
+                                  const pixel_t *srcp_orig, int src_pitch,
+                                  pixel_t *dstp_orig, int dstp_pitch,
+                                  int dim_x, int dim_y,
+                                  int lambda, int P1_param, SadType<pixel_t> tmax, int sad_shift,
+                                  const SadType<pixel_t> *inv_table,
+                                  uint8_t *wpln, int wp_stride,
+                                  const StaticBlocks *sb) {
+    constexpr int B = 4;
+    constexpr int S = 4;
+
+    const int tp_stride = (dim_x / 4 + 7) & ~7;
+    SadType<pixel_t> *tpln = vs_aligned_malloc<SadType<pixel_t>>(sizeof(SadType<pixel_t>) * tp_stride * (dim_y / 4 + 1), 32);
+
+    // x and y start at 2 and stay below dim - B * 2 and dim - B,
+    // so the search window of radius 1 is never clamped: sx == x, sy == y.
+    for (int y = 2; y < dim_y - B; y += S)
+    {
+      const pixel_t* srcp_curr_y = srcp_orig + src_pitch * y; // cpln(x, y)
+      pixel_t* dstp_curr_y = dstp_orig + dstp_pitch * y ;
+      uint8_t* wpln_curr_y = wpln + wp_stride * (y / 4);
+      SadType<pixel_t>* tpln_curr_y = tpln + tp_stride * (y / 4);
+
+      int x = 2;
+
+      // A diff step is only skipped if the steps of passes 1..8 which read its weights
+      // and thresholds are too. Those start up to one pixel left of or above it.
+      if constexpr (wide) {
+        for (; x + S * 2 < dim_x - B * 2; x += S * 4)
+          if (!is_static(sb, x - 1, y - 1, B * 4 + 2, B + 2))
+            process_blocks_diff<4>(kernels.wide,
+                                   srcp_curr_y + x, srcp_curr_y + x, src_pitch,
+                                   dstp_curr_y + x, dstp_pitch,
+                                   lambda, tmax, sad_shift, inv_table,
+                                   wpln_curr_y + x / 4, tpln_curr_y + x / 4);
+      }
+
+      for (; x < dim_x - B * 2; x += S * 2)
+        if (!is_static(sb, x - 1, y - 1, B * 2 + 2, B + 2))
+          process_blocks_diff<2>(kernels.narrow,
+                                 srcp_curr_y + x, srcp_curr_y + x, src_pitch,
+                                 dstp_curr_y + x, dstp_pitch,
+                                 lambda, tmax, sad_shift, inv_table,
+                                 wpln_curr_y + x / 4, tpln_curr_y + x / 4);
+    }
+
+    // The pairs read by the steps of any pass: y starts at 1 to 3 and x at 1 to 3.
+    int *active = nullptr; // x / 8 of each pair, in order
+    int *active_rows = nullptr; // where the pairs of y / 4 start in active, and the end
+
+    if (P1_param > 0) {
+      const int rows = std::max((dim_y - B - 1 + S - 1) / S, 0);
+      const int pairs = std::max((dim_x - B * 2 - 1 + S * 2 - 1) / (S * 2), 0);
+
+      active = vs_aligned_malloc<int>(sizeof(int) * std::max(rows * pairs, 1), 32);
+      active_rows = vs_aligned_malloc<int>(sizeof(int) * (rows + 1), 32);
+
+      int num_active = 0;
+
+      for (int j = 0; j < rows; j++) {
+        const uint8_t* wpln_curr_y = wpln + wp_stride * j;
+
+        active_rows[j] = num_active;
+
+        for (int i = 0; i < pairs; i++)
+          if (wpln_curr_y[i * 2] >= P1_param || wpln_curr_y[i * 2 + 1] >= P1_param)
+            active[num_active++] = i;
+      }
+
+      active_rows[rows] = num_active;
+    }
+
+    for (int kk = 1; kk < 9; kk++)
+    {
+      constexpr int R = 2;
+
+      int k = kk;
+
+      for (int y = (k / 3) + 1; y < dim_y - B; y += S)
+      {
+        int sy = y;
+        if (sy < R) sy = R;
+        if (sy > dim_y - R - B) sy = dim_y - R - B;
+
+        const pixel_t* srcp_curr_sy = srcp_orig + src_pitch * sy;
+        const pixel_t* srcp_curr_y = srcp_orig + src_pitch * y;
+        pixel_t* dstp_curr_y = dstp_orig + dstp_pitch * y;
+        const uint8_t* wpln_curr_y = wpln + wp_stride * (y / 4);
+        // the blocks of the diff pass, x starts at 2 too
+        const SadType<pixel_t>* tpln_curr_y = (k == 4 && sy == y) ? tpln + tp_stride * (y / 4) : nullptr;
+
+        if (active) {
+          const int *a = active + active_rows[y / 4];
+          const int *a_end = active + active_rows[y / 4 + 1];
+
+          for (; a < a_end; a++) {
+            const int x = (k % 3) + 1 + *a * S * 2;
+            if (x >= dim_x - B * 2)
+              break;
+
+            if (is_static(sb, x, y, B * 2, B))
+              continue;
+
+            // Two neighbouring pairs, where the steps of the wide loop below would be.
+            if constexpr (wide) {
+              if (x >= R && a + 1 < a_end && a[1] == *a + 1 && x + S * 2 < dim_x - B * 2) {
+                process_blocks_overlap<4>(kernels.wide,
+                                          srcp_curr_sy + x, srcp_curr_y + x, src_pitch,
+                                          dstp_curr_y + x, dstp_pitch,
+                                          k, lambda, P1_param, tmax, inv_table,
+                                          wpln_curr_y + x / 4, tpln_curr_y ? tpln_curr_y + x / 4 : nullptr);
+                a++;
+                continue;
+              }
+            }
+
+            const int sx = std::max(x, R);
+
+            process_blocks_overlap<2>(sx - R + 16 <= dim_x ? kernels.narrow_rows16 : kernels.narrow,
+                                      srcp_curr_sy + sx, srcp_curr_y + x, src_pitch,
+                                      dstp_curr_y + x, dstp_pitch,
+                                      k, lambda, P1_param, tmax, inv_table,
+                                      wpln_curr_y + x / 4, tpln_curr_y ? tpln_curr_y + x / 4 : nullptr);
+          }
+
+          continue;
+        }
+
+        int x = (k % 3) + 1;
+
+        // Only the first step can have sx != x, the loop stops before the right edge needs clamping.
+        if (x < R && x < dim_x - B * 2) {
+          int sx = R;
+
+          if (!is_static(sb, x, y, B * 2, B)) {
+            process_blocks_overlap<2>(sx - R + 16 <= dim_x ? kernels.narrow_rows16 : kernels.narrow,
+                                      srcp_curr_sy + sx, srcp_curr_y + x, src_pitch,
+                                      dstp_curr_y + x, dstp_pitch,
+                                      k, lambda, P1_param, tmax, inv_table,
+                                      wpln_curr_y + x / 4, tpln_curr_y ? tpln_curr_y + x / 4 : nullptr);
+          }
+          x += S * 2;
+        }
+
+        if constexpr (wide) {
+          for (; x + S * 2 < dim_x - B * 2; x += S * 4)
+            if (!is_static(sb, x, y, B * 4, B))
+              process_blocks_overlap<4>(kernels.wide,
+                                        srcp_curr_sy + x, srcp_curr_y + x, src_pitch,
+                                        dstp_curr_y + x, dstp_pitch,
+                                        k, lambda, P1_param, tmax, inv_table,
+                                        wpln_curr_y + x / 4, tpln_curr_y ? tpln_curr_y + x / 4 : nullptr);
+        }
+
+        for (; x < dim_x - B * 2 && x - R + 16 <= dim_x; x += S * 2)
+          if (!is_static(sb, x, y, B * 2, B))
+            process_blocks_overlap<2>(kernels.narrow_rows16,
+                                      srcp_curr_sy + x, srcp_curr_y + x, src_pitch,
+                                      dstp_curr_y + x, dstp_pitch,
+                                      k, lambda, P1_param, tmax, inv_table,
+                                      wpln_curr_y + x / 4, tpln_curr_y ? tpln_curr_y + x / 4 : nullptr);
+
+        for (; x < dim_x - B * 2; x += S * 2)
+          if (!is_static(sb, x, y, B * 2, B))
+            process_blocks_overlap<2>(kernels.narrow,
+                                      srcp_curr_sy + x, srcp_curr_y + x, src_pitch,
+                                      dstp_curr_y + x, dstp_pitch,
+                                      k, lambda, P1_param, tmax, inv_table,
+                                      wpln_curr_y + x / 4, tpln_curr_y ? tpln_curr_y + x / 4 : nullptr);
+      }
+    }
+
+    vs_aligned_free(tpln);
+    if (active) {
+        vs_aligned_free(active);
+        vs_aligned_free(active_rows);
+    }
+}
+
 
-#define frcore_dev_2x_b4_simd               frcore_dev_2x_b4_scalar
-#define frcore_sad_2x_b4_simd               frcore_sad_2x_b4_scalar
-#define frcore_filter_b4r0_simd             frcore_filter_b4r0_scalar
-#define frcore_filter_overlap_b4r2_simd     frcore_filter_overlap_b4r2_scalar
-#define frcore_filter_overlap_b4r3_simd     frcore_filter_overlap_b4r3_scalar
-#define frcore_filter_adapt_b4r2_simd       frcore_filter_adapt_b4r2_scalar
-#define frcore_filter_adapt_b4r3_simd       frcore_filter_adapt_b4r3_scalar
-#define frcore_filter_b4r2_simd             frcore_filter_b4r2_scalar
-#define frcore_filter_b4r3_simd             frcore_filter_b4r3_scalar
-#define frcore_filter_diff_b4r1_simd        frcore_filter_diff_b4r1_scalar
+// P: the p parameter
+// R: 2, 3, or RAny
+// wide: the AVX2 kernels are used
+// joint: JointRole, only with P 0 and 1 and R 2 and 3. The first pass is then
+// process_plane_1stpass_joint, which doesn't use wide.
+template <typename pixel_t, int P, int R, bool wide, int joint>
+static void process_plane(const Frfun7Kernels<pixel_t> &kernels,
+                          const pixel_t *srcp_orig, int src_pitch,
+                          const pixel_t *srcp_prev_orig, int src_prev_pitch,
+                          const pixel_t *srcp_next_orig, int src_next_pitch,
+                          pixel_t *dstp_orig, int dstp_pitch,
+                          int dim_x, int dim_y,
+                          int R_1stpass, int lambda, int P1_param, int tmax, int sad_shift,
+                          const SadType<pixel_t> *inv_table,
+                          uint8_t *wpln, int wp_stride,
+                          const JointMasks *jm,
+                          const TemporalSads<SadType<pixel_t>> *sads,
+                          const StaticBlocks *sb) {
+    constexpr bool mode_adaptive_overlapping = P & 1;
+    constexpr bool mode_temporal = P & 2;
+    constexpr bool mode_adaptive_radius = P & 4;
+
+    static_assert(joint == JointOff || (!mode_temporal && !mode_adaptive_radius && R != RAny), "joint chroma needs the first pass of radius 2 or 3");
+    static_assert(sizeof(pixel_t) == 1 || (joint == JointOff && R != RAny), "only the radii 2 and 3 have 16 bit and float kernels");
+
+    const SadType<pixel_t> tmax_scaled = PixelTraits<pixel_t>::from_8bit(tmax, sad_shift);
+
+    if constexpr (joint != JointOff) {
+        (void)R_1stpass;
+        (void)sads;
+        (void)sb;
+        (void)srcp_prev_orig;
+        (void)src_prev_pitch;
+        (void)srcp_next_orig;
+        (void)src_next_pitch;
+
+        process_plane_1stpass_joint<R, joint == JointChroma>(kernels,
+                                                             srcp_orig, src_pitch,
+                                                             dstp_orig, dstp_pitch,
+                                                             dim_x, dim_y,
+                                                             lambda, tmax_scaled,
+                                                             inv_table,
+                                                             *jm);
+    } else if constexpr (R == RAny) {
+        (void)jm;
+        (void)sads;
+        (void)sb;
+
+        frcore_1stpass_plane(srcp_orig, src_pitch,
+                             srcp_prev_orig, src_prev_pitch,
+                             srcp_next_orig, src_next_pitch,
+                             dstp_orig, dstp_pitch,
+                             mode_temporal, mode_adaptive_radius, kernels.fast, kernels.pattern,
+                             dim_x, dim_y,
+                             R_1stpass, lambda, tmax_scaled,
+                             inv_table);
+    } else {
+        (void)R_1stpass;
+        (void)jm;
+
+        process_plane_1stpass<mode_temporal, mode_adaptive_radius, R, wide>(kernels,
+                                                                            srcp_orig, src_pitch,
+                                                                            srcp_prev_orig, src_prev_pitch,
+                                                                            srcp_next_orig, src_next_pitch,
+                                                                            dstp_orig, dstp_pitch,
+                                                                            dim_x, dim_y,
+                                                                            lambda, tmax_scaled, sad_shift,
+                                                                            inv_table,
+                                                                            sads, sb);
+    }
 
-#endif
+    if constexpr (mode_adaptive_overlapping) {
+        process_plane_overlap<wide>(kernels,
+                                    srcp_orig, src_pitch,
+                                    dstp_orig, dstp_pitch,
+                                    dim_x, dim_y,
+                                    lambda, P1_param, tmax_scaled, sad_shift,
+                                    inv_table,
+                                    wpln, wp_stride,
+                                    sb);
+    } else {
+        (void)P1_param;
+        (void)wpln;
+        (void)wp_stride;
+    }
+}
 
 
-AVS_FORCEINLINE int get_weight(int alpha)
-{
-  int a = ((alpha * (1 << 15)) / ((alpha + 1)));
-  int b = ((1 << 15) / ((alpha + 1)));
-  return (a << 16) | b;
+template <int P, int R, int joint>
+static PlaneFunc<uint8_t> select_process_plane(bool wide) {
+    return wide ? process_plane<uint8_t, P, R, true, joint> : process_plane<uint8_t, P, R, false, joint>;
 }
 
-AVS_FORCEINLINE int clipb(int weight) {
-  return weight < 0 ? 0 : weight > 255 ? 255 : weight;
+template <int P, int R>
+static PlaneFunc<uint8_t> select_process_plane(bool wide, int joint) {
+    if constexpr (!(P & 6) && R != RAny) {
+        if (joint == JointLuma)
+            return select_process_plane<P, R, JointLuma>(wide);
+        if (joint == JointChroma)
+            return select_process_plane<P, R, JointChroma>(wide);
+    } else {
+        (void)joint;
+    }
+    return select_process_plane<P, R, JointOff>(wide);
 }
 
+template <int P>
+static PlaneFunc<uint8_t> select_process_plane(int R, bool wide, int joint) {
+    if (R == 2)
+        return select_process_plane<P, 2>(wide, joint);
+    if (R == 3)
+        return select_process_plane<P, 3>(wide, joint);
+    return select_process_plane<P, RAny>(wide, joint);
+}
 
+// Picks the specialisation of process_plane for p and r1, once in frfun7Create.
+// joint: JointRole, frfun7Create only allows it where process_plane_1stpass_joint works.
+static PlaneFunc<uint8_t> select_process_plane(int P, int R, bool wide, int joint) {
+    switch (P) {
+    case 0: return select_process_plane<0>(R, wide, joint);
+    case 1: return select_process_plane<1>(R, wide, joint);
+    case 2: return select_process_plane<2>(R, wide, joint);
+    case 3: return select_process_plane<3>(R, wide, joint);
+    case 4: return select_process_plane<4>(R, wide, joint);
+    case 5: return select_process_plane<5>(R, wide, joint);
+    case 6: return select_process_plane<6>(R, wide, joint);
+    default: return select_process_plane<7>(R, wide, joint);
+    }
+}
 
-typedef struct Frfun7Data {
-    VSNodeRef *clip;
-    const VSVideoInfo *vi;
-
-    int process[3];
-
-    int inv_table[1024];
-    int lambda, Thresh_luma, Thresh_chroma;
-    int P;
-    int P1_param;
-    int R_1stpass; // Radius of first pass, originally 3, can be 2 as well
-    int opt;
-} Frfun7Data;
+template <typename pixel_t, int P>
+static PlaneFunc<pixel_t> select_process_plane_hbd(int R, bool wide) {
+    if (R == 2)
+        return wide ? process_plane<pixel_t, P, 2, true, JointOff> : process_plane<pixel_t, P, 2, false, JointOff>;
+    return wide ? process_plane<pixel_t, P, 3, true, JointOff> : process_plane<pixel_t, P, 3, false, JointOff>;
+}
 
+// The same for more than 8 bits (uint16_t) and float, where r1 is 2 or 3 and there is no joint.
+template <typename pixel_t>
+static PlaneFunc<pixel_t> select_process_plane_hbd(int P, int R, bool wide) {
+    switch (P) {
+    case 0: return select_process_plane_hbd<pixel_t, 0>(R, wide);
+    case 1: return select_process_plane_hbd<pixel_t, 1>(R, wide);
+    case 2: return select_process_plane_hbd<pixel_t, 2>(R, wide);
+    case 3: return select_process_plane_hbd<pixel_t, 3>(R, wide);
+    case 4: return select_process_plane_hbd<pixel_t, 4>(R, wide);
+    case 5: return select_process_plane_hbd<pixel_t, 5>(R, wide);
+    case 6: return select_process_plane_hbd<pixel_t, 6>(R, wide);
+    default: return select_process_plane_hbd<pixel_t, 7>(R, wide);
+    }
+}
 
-static void VS_CC frfun7Init(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
-    (void)in;
-    (void)out;
-    (void)core;
 
-    Frfun7Data *d = (Frfun7Data *) *instanceData;
+// Both chroma planes with the AVX2 kernels: the first pass of process_planes_1stpass_uv,
+// then adaptive overlapping on each plane like process_plane.
+template <int P, int R>
+static void process_planes_uv(const Frfun7Kernels<uint8_t> &kernels,
+                              const uint8_t *srcp_u, const uint8_t *srcp_v, int src_pitch,
+                              uint8_t *dstp_u, uint8_t *dstp_v, int dstp_pitch,
+                              int dim_x, int dim_y,
+                              int lambda, int P1_param, int tmax,
+                              const int *inv_table,
+                              uint8_t *wpln, int wp_stride) {
+    constexpr bool mode_adaptive_overlapping = P & 1;
+    constexpr bool mode_adaptive_radius = P & 4;
+
+    process_planes_1stpass_uv<mode_adaptive_radius, R>(kernels,
+                                                       srcp_u, srcp_v, src_pitch,
+                                                       dstp_u, dstp_v, dstp_pitch,
+                                                       dim_x, dim_y,
+                                                       lambda, tmax,
+                                                       inv_table);
+
+    if constexpr (mode_adaptive_overlapping) {
+        const uint8_t *srcp[2] = { srcp_u, srcp_v };
+        uint8_t *dstp[2] = { dstp_u, dstp_v };
 
-    vsapi->setVideoInfo(d->vi, 1, node);
+        for (int i = 0; i < 2; i++) {
+            process_plane_overlap<true>(kernels,
+                                        srcp[i], src_pitch,
+                                        dstp[i], dstp_pitch,
+                                        dim_x, dim_y,
+                                        lambda, P1_param, tmax, 0,
+                                        inv_table,
+                                        wpln, wp_stride,
+                                        nullptr);
+        }
+    } else {
+        (void)P1_param;
+        (void)wpln;
+        (void)wp_stride;
+    }
 }
 
+template <int P>
+static PlanesUVFunc select_process_planes_uv(int R) {
+    return R == 2 ? process_planes_uv<P, 2> : process_planes_uv<P, 3>;
+}
 
-enum SIMD_or_scalar {
-    Scalar = 0,
-    SIMD = 1
-};
+// The function for both chroma planes, or nullptr where they go through
+// plane_func_chroma one at a time: without the AVX2 kernels, in temporal mode,
+// with r1 greater than 3, and with joint.
+static PlanesUVFunc select_process_planes_uv(const Frfun7Kernels<uint8_t> &kernels, int P, int R, bool joint) {
+    if (!kernels.has_uv || (P & 2) || R > 3 || joint)
+        return nullptr;
+
+    switch (P) {
+    case 0: return select_process_planes_uv<0>(R);
+    case 1: return select_process_planes_uv<1>(R);
+    case 4: return select_process_planes_uv<4>(R);
+    default: return select_process_planes_uv<5>(R);
+    }
+}
 
 
-template <bool simd>
-static void process_plane(const uint8_t *srcp_orig, int src_pitch,
-                          const uint8_t *srcp_prev_orig, int src_prev_pitch,
-                          const uint8_t *srcp_next_orig, int src_next_pitch,
-                          uint8_t *dstp_orig, int dstp_pitch,
-                          bool mode_adaptive_overlapping, bool mode_temporal, bool mode_adaptive_radius,
-                          int dim_x, int dim_y,
-                          int R, int lambda, int P1_param, int tmax,
-                          const int *inv_table,
-                          uint8_t *wpln, int wp_stride) {
+// Several strengths: the first pass of process_plane_1stpass_joint's luma plane, except
+// the SADs of the candidates are computed once and each strength averages those below
+// its own thresholds into its own output. Then adaptive overlapping, once per output.
+template <bool mode_adaptive_overlapping, int R, bool wide>
+static void process_plane_strengths(const Frfun7Kernels<uint8_t> &kernels,
+                                    const uint8_t *srcp_orig, int src_pitch,
+                                    uint8_t *const *dstps, const int *dstp_pitches,
+                                    int dim_x, int dim_y,
+                                    int num_strengths, const int *lambdas, const int *tmaxes, int P1_param,
+                                    const int *inv_table,
+                                    uint8_t *wpln, int wp_stride) {
     constexpr int B = 4;
     constexpr int S = 4;
 
@@ -1760,12 +3940,10 @@ static void process_plane(const uint8_t *srcp_orig, int src_pitch,
       if (sy > dim_y - R - B) sy = dim_y - R - B;
       if (by > dim_y - B) by = dim_y - B;
 
-      uint8_t* dstp_curr_by = dstp_orig + dstp_pitch * by;
-      uint8_t* dstp_curr_sy = dstp_orig + dstp_pitch * sy;
       const uint8_t* srcp_curr_sy = srcp_orig + src_pitch * sy; // cpln(sx, sy)
       const uint8_t* srcp_curr_by = srcp_orig + src_pitch * by; // cpln(bx, by)
 
-      for (int x = 0; x < dim_x + B - 1; x += S*2)
+      for (int x = 0; x < dim_x + B - 1; x += S * 2)
       {
         int sx = x;
         int bx = x;
@@ -1773,201 +3951,182 @@ static void process_plane(const uint8_t *srcp_orig, int src_pitch,
         if (sx > dim_x - R - B * 2) sx = dim_x - R - B * 2;
         if (bx > dim_x - B * 2) bx = dim_x - B * 2;
 
-        uint8_t* dstp = dstp_curr_by + bx;
-        uint8_t* dstp_s = dstp_curr_sy + sx;
-        const uint8_t* srcp_s = srcp_curr_sy + sx; // cpln(sx, sy)
-        const uint8_t* srcp_b = srcp_curr_by + bx; // cpln(bx, by)
+        int dev[2];
+        kernels.narrow.dev(srcp_curr_sy + sx, src_pitch, dev);
 
-        int dev[2], devp[2], devn[2];
-        (simd ? frcore_dev_2x_b4_simd
-              : frcore_dev_2x_b4_scalar)(srcp_s, src_pitch, dev);
+        int thresh[MaxStrengths * 2];
+        for (int k = 0; k < num_strengths; k++) {
+          for (int i = 0; i < 2; i++)
+              thresh[k * 2 + i] = PixelTraits<uint8_t>::thresh(dev[i], lambdas[k], tmaxes[k]);
+        }
 
-        // only for temporal use
-        const uint8_t* srcp_next_s = nullptr;
-        const uint8_t* srcp_prev_s = nullptr;
+        uint64_t mask[MaxStrengths * 2];
+        kernels.masks[R - 2](srcp_curr_by + bx, src_pitch, srcp_curr_sy + sx, src_pitch, thresh, num_strengths, mask);
 
-        if (mode_temporal)
-        {
-          srcp_prev_s = srcp_prev_orig + src_prev_pitch * sy + sx; // ppln(sx, sy)
-          (simd ? frcore_sad_2x_b4_simd
-                : frcore_sad_2x_b4_scalar)(srcp_s, src_pitch, srcp_prev_s, src_prev_pitch, devp);
+        for (int k = 0; k < num_strengths; k++)
+          kernels.apply[R - 2](srcp_curr_sy + sx, src_pitch, dstps[k] + dstp_pitches[k] * by + bx, dstp_pitches[k], mask + k * 2, inv_table);
+      }
+    }
 
-          srcp_next_s = srcp_next_orig + src_next_pitch * sy + sx; // npln(sx, sy)
-          (simd ? frcore_sad_2x_b4_simd
-                : frcore_sad_2x_b4_scalar)(srcp_s, src_pitch, srcp_next_s, src_next_pitch, devn);
+    if constexpr (mode_adaptive_overlapping) {
+        for (int k = 0; k < num_strengths; k++)
+            process_plane_overlap<wide>(kernels,
+                                        srcp_orig, src_pitch,
+                                        dstps[k], dstp_pitches[k],
+                                        dim_x, dim_y,
+                                        lambdas[k], P1_param, tmaxes[k], 0,
+                                        inv_table,
+                                        wpln, wp_stride,
+                                        nullptr);
+    } else {
+        (void)P1_param;
+        (void)wpln;
+        (void)wp_stride;
+    }
+}
 
-          for (int i = 0; i < 2; i++) {
-            dev[i] = std::min(dev[i], devn[i]);
-            dev[i] = std::min(dev[i], devp[i]);
-          }
-        }
+template <bool mode_adaptive_overlapping, int R>
+static StrengthsFunc select_process_plane_strengths(bool wide) {
+    return wide ? process_plane_strengths<mode_adaptive_overlapping, R, true> : process_plane_strengths<mode_adaptive_overlapping, R, false>;
+}
 
-        int thresh[2];
-        for (int i = 0; i < 2; i++) {
-            thresh[i] = ((dev[i] * lambda) >> 10);
-            thresh[i] = (thresh[i] > tmax) ? tmax : thresh[i];
-            if (thresh[i] < 1) thresh[i] = 1;
-        }
+// frfun7Create only allows several strengths with p 0 and 1 and r1 2 and 3.
+static StrengthsFunc select_process_plane_strengths(int P, int R, bool wide) {
+    if (P & 1)
+        return R == 2 ? select_process_plane_strengths<true, 2>(wide) : select_process_plane_strengths<true, 3>(wide);
+    else
+        return R == 2 ? select_process_plane_strengths<false, 2>(wide) : select_process_plane_strengths<false, 3>(wide);
+}
 
 
-        if (mode_temporal) {
-          (simd ? frcore_filter_b4r0_simd
-                : frcore_filter_b4r0_scalar)(srcp_b, src_pitch, srcp_b, src_pitch, dstp, dstp_pitch, thresh, inv_table);
-
-            int process_blocks[2] = { devp[0] < thresh[0],
-                                      devp[1] < thresh[1] };
-
-            int weight[2];
-            int k[2] = { 1, 1 };
-
-            if (process_blocks[0] || process_blocks[1])
-            {
-                weight[0] = get_weight(k[0]); // two 16 bit values inside
-                weight[1] = get_weight(k[1]); // two 16 bit values inside
-
-                (R == 2 ? (simd ? frcore_filter_overlap_b4r2_simd
-                                : frcore_filter_overlap_b4r2_scalar)
-                        : (simd ? frcore_filter_overlap_b4r3_simd
-                                : frcore_filter_overlap_b4r3_scalar))(srcp_s, src_pitch, srcp_prev_s, src_prev_pitch, dstp_s, dstp_pitch, thresh, inv_table, weight, process_blocks);
-                k[0] += process_blocks[0];
-                k[1] += process_blocks[1];
-            }
+// Static block reuse: marks the 4x4 blocks of a plane whose source within radius pixels
+// is identical in the frame processed earlier, see StaticBlocks.
+// changed: scratch space for stride * height bytes
+static void find_static_blocks(StaticBlocks *sb, uint8_t *changed,
+                               const uint8_t *srcp, int src_pitch,
+                               const uint8_t *prevp, int prev_pitch,
+                               int dim_x, int dim_y, int bytes_per_sample, int radius) {
+    const int width = sb->width;
+    const int height = sb->height;
+    const int stride = sb->stride;
 
-            process_blocks[0] = devn[0] < thresh[0];
-            process_blocks[1] = devn[1] < thresh[1];
+    memset(changed, 0, stride * height);
 
-            if (process_blocks[0] || process_blocks[1])
-            {
-                weight[0] = get_weight(k[0]); // two 16 bit values inside
-                weight[1] = get_weight(k[1]); // two 16 bit values inside
+    for (int y = 0; y < dim_y; y++) {
+        const uint8_t *s = srcp + src_pitch * y;
+        const uint8_t *p = prevp + prev_pitch * y;
+        uint8_t *c = changed + stride * (y / 4);
 
-                (R == 2 ? (simd ? frcore_filter_overlap_b4r2_simd
-                                : frcore_filter_overlap_b4r2_scalar)
-                        : (simd ? frcore_filter_overlap_b4r3_simd
-                                : frcore_filter_overlap_b4r3_scalar))(srcp_s, src_pitch, srcp_next_s, src_next_pitch, dstp_s, dstp_pitch, thresh, inv_table, weight, process_blocks);
-            }
-        }
-        else
-        {
-          // not temporal
-          if (sx == x && sy == y && mode_adaptive_radius) {
-            constexpr int thresh2 = 16 * 9; // First try with R=1 then if over threshold R=2 then R=3
-            constexpr int thresh3 = 16 * 25; // only when R=3
-            (R == 2 ? (simd ? frcore_filter_adapt_b4r2_simd
-                            : frcore_filter_adapt_b4r2_scalar)
-                    : (simd ? frcore_filter_adapt_b4r3_simd
-                            : frcore_filter_adapt_b4r3_scalar))(srcp_b, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, thresh2, thresh3, inv_table);
-          } else {
-            // Nothing or adaptive_overlapping or some case of adaptive_radius
-            (R == 2 ? (simd ? frcore_filter_b4r2_simd
-                            : frcore_filter_b4r2_scalar)
-                    : (simd ? frcore_filter_b4r3_simd
-                            : frcore_filter_b4r3_scalar))(srcp_b, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, inv_table);
-          }
+        if (!memcmp(s, p, dim_x * bytes_per_sample))
+            continue;
+
+        for (int bx = 0; bx < width; bx++) {
+            const int w = std::min(4, dim_x - bx * 4) * bytes_per_sample;
+            c[bx] |= !!memcmp(s + bx * 4 * bytes_per_sample, p + bx * 4 * bytes_per_sample, w);
         }
+    }
 
-      }
+    // A block is static if no block within r of it changed, r covering radius pixels.
+    // The blocks within r in the row go to sb->blocks first, then those in the column back to changed.
+    const int r = (radius + 3) / 4;
+
+    for (int by = 0; by < height; by++) {
+        const uint8_t *c = changed + stride * by;
+        uint8_t *b = sb->blocks + stride * by;
+
+        for (int bx = 0; bx < width; bx++) {
+            uint8_t any = 0;
+            for (int xx = std::max(bx - r, 0); xx <= std::min(bx + r, width - 1); xx++)
+                any |= c[xx];
+            b[bx] = any;
+        }
     }
 
-    if (mode_adaptive_overlapping)
-    {
-      for (int y = 2; y < dim_y - B; y += S)
-      {
-        constexpr int R_shadow = 1; // renamed from R to silence a shadow warning
+    for (int by = 0; by < height; by++) {
+        uint8_t *c = changed + stride * by;
 
-        int sy = y;
-        if (sy < R_shadow) sy = R_shadow;
-        if (sy > dim_y - R_shadow - B) sy = dim_y - R_shadow - B;
+        for (int bx = 0; bx < width; bx++) {
+            uint8_t any = 0;
+            for (int yy = std::max(by - r, 0); yy <= std::min(by + r, height - 1); yy++)
+                any |= sb->blocks[stride * yy + bx];
+            c[bx] = any;
+        }
+    }
 
-        const uint8_t* srcp_curr_sy = srcp_orig + src_pitch * sy; // cpln(sx, sy)
-        const uint8_t* srcp_curr_y = srcp_orig + src_pitch * y; // cpln(x, y)
-        uint8_t* dstp_curr_y = dstp_orig + dstp_pitch * y ;
+    for (int by = 0; by < height; by++)
+        for (int bx = 0; bx < width; bx++)
+            sb->blocks[stride * by + bx] = !changed[stride * by + bx];
+}
 
-        for (int x = 2; x < dim_x - B * 2; x += S * 2)
-        {
-          int sx = x;
-          if (sx < R_shadow) sx = R_shadow;
-          if (sx > dim_x - R_shadow - B) sx = dim_x - R_shadow - B * 2;
 
-          int dev[2] = { 10, 10 };
-          const uint8_t* srcp_s = srcp_curr_sy + sx; // cpln(sx, sy)
-          (simd ? frcore_dev_2x_b4_simd
-                : frcore_dev_2x_b4_scalar)(srcp_s, src_pitch, dev);
+// Static block reuse: copies the output of the static blocks from that of the frame processed earlier.
+// With a mask prevp is the source instead.
+static void copy_static_blocks(const StaticBlocks &sb,
+                               const uint8_t *prevp, int prev_pitch,
+                               uint8_t *dstp, int dstp_pitch,
+                               int dim_x, int dim_y, int bytes_per_sample) {
+    for (int by = 0; by < sb.height; by++) {
+        const uint8_t *b = sb.blocks + sb.stride * by;
 
-          int thresh[2];
+        for (int bx = 0; bx < sb.width; ) {
+            if (!b[bx]) {
+                bx++;
+                continue;
+            }
 
-          for (int i = 0; i < 2; i++) {
-              thresh[i] = ((dev[i] * lambda) >> 10);
-              thresh[i] = (thresh[i] > tmax) ? tmax : thresh[i];
-              if (thresh[i] < 1) thresh[i] = 1;
-          }
+            // a run of static blocks
+            int end = bx + 1;
+            while (end < sb.width && b[end])
+                end++;
 
-          const uint8_t* srcp_xy = srcp_curr_y + x; // cpln(x, y)
-          uint8_t* dstp = dstp_curr_y + x;
+            const int x = bx * 4 * bytes_per_sample;
+            const int w = (std::min(end * 4, dim_x) - bx * 4) * bytes_per_sample;
 
-          int weight[2] = { get_weight(1), get_weight(1) };
-          (simd ? frcore_filter_diff_b4r1_simd
-                : frcore_filter_diff_b4r1_scalar)(srcp_xy, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, inv_table, weight);
+            for (int y = by * 4; y < std::min(by * 4 + 4, dim_y); y++)
+                memcpy(dstp + dstp_pitch * y + x, prevp + prev_pitch * y + x, w);
 
-          wpln[wp_stride * (y / 4) + (x / 4)] = clipb(weight[0]);
-          wpln[wp_stride * (y / 4) + (x / 4) + 1] = clipb(weight[1]);
+            bx = end;
         }
-      }
+    }
+}
 
-      for (int kk = 1; kk < 9; kk++)
-      {
-        constexpr int R_shadow = 2; // renamed from R to silence a shadow warning
 
-        int k = kk;
+// Mask: marks the 4x4 blocks of a plane whose pixels are all 0 in the mask, see StaticBlocks.
+// The mask plane can be 1 << shift_x by 1 << shift_y times as large as the plane,
+// when a gray mask covers subsampled chroma.
+static void find_masked_blocks(StaticBlocks *sb,
+                               const uint8_t *maskp, int mask_pitch,
+                               int mask_x, int mask_y, int shift_x, int shift_y) {
+    memset(sb->blocks, 1, sb->stride * sb->height);
 
-        for (int y = (k / 3) + 1; y < dim_y - B; y += S)
-        {
-          int sy = y;
-          if (sy < R_shadow) sy = R_shadow;
-          if (sy > dim_y - R_shadow - B) sy = dim_y - R_shadow - B;
-
-          const uint8_t* srcp_curr_sy = srcp_orig + src_pitch * sy;
-          const uint8_t* srcp_curr_y = srcp_orig + src_pitch * y;
-          uint8_t* dstp_curr_y = dstp_orig + dstp_pitch * y;
-
-          for (int x = (k % 3) + 1; x < dim_x - B * 2; x += S * 2)
-          {
-            int sx = x;
-            if (sx < R_shadow) sx = R_shadow;
-            if (sx > dim_x - R_shadow - B) sx = dim_x - R_shadow - B * 2;
-
-            int process_blocks[2] = {
-                wpln[wp_stride * (y / 4) + (x / 4)] >= P1_param,
-                wpln[wp_stride * (y / 4) + (x / 4) + 1] >= P1_param
-            };
-
-            if (!process_blocks[0] && !process_blocks[1])
-              continue;
+    // With odd dimensions the last row or column of the mask can be past the plane.
+    mask_x = std::min(mask_x, (sb->width * 4) << shift_x);
+    mask_y = std::min(mask_y, (sb->height * 4) << shift_y);
 
-            int dev[2] = { 10, 10 };
-            const uint8_t* srcp_s = srcp_curr_sy + sx; // cpln(sx, sy)
-            (simd ? frcore_dev_2x_b4_simd
-                  : frcore_dev_2x_b4_scalar)(srcp_s, src_pitch, dev);
+    for (int y = 0; y < mask_y; y++) {
+        const uint8_t *m = maskp + mask_pitch * y;
+        uint8_t *b = sb->blocks + sb->stride * ((y >> shift_y) / 4);
 
-            int thresh[2];
+        // Most rows of a mask are usually all 0 or all not.
+        uint8_t any = 0;
+        for (int x = 0; x < mask_x; x++)
+            any |= m[x];
 
-            for (int i = 0; i < 2; i++) {
-                thresh[i] = ((dev[i] * lambda) >> 10);
-                thresh[i] = (thresh[i] > tmax) ? tmax : thresh[i];
-                if (thresh[i] < 1) thresh[i] = 1;
-            }
+        if (!any)
+            continue;
 
-            uint8_t* dstp = dstp_curr_y + x;
-            const uint8_t* srcp_xy = srcp_curr_y + x; // cpln(x, y)
-            int weight[2] = { get_weight(k), get_weight(k) }; // two 16 bit words inside
+        // Only the blocks not yet known to be in the mask.
+        for (int bx = 0; bx < sb->width; bx++) {
+            if (!b[bx])
+                continue;
 
-            (simd ? frcore_filter_overlap_b4r2_simd
-                  : frcore_filter_overlap_b4r2_scalar)(srcp_xy, src_pitch, srcp_s, src_pitch, dstp, dstp_pitch, thresh, inv_table, weight, process_blocks);
-          }
-        }
+            const int x0 = (bx * 4) << shift_x;
+            const int x1 = std::min(((bx + 1) * 4) << shift_x, mask_x);
 
-      }
-    } // adaptive overlapping
+            for (int x = x0; x < x1; x++)
+                b[bx] &= !m[x];
+        }
+    }
 }
 
 
@@ -1986,23 +4145,51 @@ static const VSFrameRef *VS_CC frfun7GetFrame(int n, int activationReason, void
 
     const bool mode_adaptive_overlapping = P & 1;
     const bool mode_temporal = P & 2;
-    const bool mode_adaptive_radius = P & 4;
+
+    // Several strengths: the frame of this output may have been made with that of another one.
+    const int index = vsapi->getOutputIndex(frameCtx);
+
+    if (d->strength_cache && (activationReason == arInitial || activationReason == arAllFramesReady)) {
+        const VSFrameRef *f = d->strength_cache->take(n, index);
+        if (f)
+            return f;
+    }
 
     if (activationReason == arInitial) {
-        if (mode_temporal)
-            vsapi->requestFrameFilter(std::max(0, n - 1), d->clip, frameCtx);
+        // The scene change properties of frame n aren't known yet, so the neighbours
+        // are requested anyway, except past the ends of the clip.
+        if (mode_temporal && n > 0)
+            vsapi->requestFrameFilter(n - 1, d->clip, frameCtx);
 
         vsapi->requestFrameFilter(n, d->clip, frameCtx);
 
-        if (mode_temporal)
-            vsapi->requestFrameFilter(std::min(n + 1, d->vi->numFrames - 1), d->clip, frameCtx);
+        if (mode_temporal && n < d->vi->numFrames - 1)
+            vsapi->requestFrameFilter(n + 1, d->clip, frameCtx);
+
+        if (d->mask)
+            vsapi->requestFrameFilter(n, d->mask, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrameRef *cf = vsapi->getFrameFilter(n, d->clip, frameCtx);
 
         const VSFormat *fmt = vsapi->getFrameFormat(cf);
 
-        if (fmt->bitsPerSample > 8) {
-            vsapi->setFilterError("Frfun7: only 8 bit video is allowed", frameCtx);
+        if ((fmt->sampleType == stInteger && fmt->bitsPerSample > 16) ||
+            (fmt->sampleType == stFloat && fmt->bitsPerSample != 32)) {
+            vsapi->setFilterError("Frfun7: only 8 to 16 bit integer and 32 bit float video is allowed", frameCtx);
+            vsapi->freeFrame(cf);
+            return nullptr;
+        }
+
+        const bool high_bitdepth = fmt->bitsPerSample > 8;
+
+        if (high_bitdepth && (d->joint || d->kernels.fast || d->kernels.pattern != PatternDense || R_1stpass > 3)) {
+            vsapi->setFilterError("Frfun7: with more than 8 bits per sample joint, fast, and pattern are not supported, and r1 must be 2 or 3", frameCtx);
+            vsapi->freeFrame(cf);
+            return nullptr;
+        }
+
+        if (high_bitdepth && d->num_strengths > 1) {
+            vsapi->setFilterError("Frfun7: several strengths only work with 8 bit clips", frameCtx);
             vsapi->freeFrame(cf);
             return nullptr;
         }
@@ -2013,12 +4200,47 @@ static const VSFrameRef *VS_CC frfun7GetFrame(int n, int activationReason, void
             return nullptr;
         }
 
+        // The search window of the larger radii must fit in the smallest plane.
+        if (R_1stpass > 3 &&
+            (vsapi->getFrameWidth(cf, fmt->numPlanes - 1) < 2 * R_1stpass + 4 ||
+             vsapi->getFrameHeight(cf, fmt->numPlanes - 1) < 2 * R_1stpass + 4)) {
+            vsapi->setFilterError("Frfun7: with r1 greater than 3 every plane must be at least 2 * r1 + 4 pixels wide and tall", frameCtx);
+            vsapi->freeFrame(cf);
+            return nullptr;
+        }
+
+        const VSFrameRef *mf = nullptr; // mask
+
+        if (d->mask) {
+            mf = vsapi->getFrameFilter(n, d->mask, frameCtx);
+
+            const VSFormat *mfmt = vsapi->getFrameFormat(mf);
+            if (mfmt->colorFamily != cmGray &&
+                (mfmt->subSamplingW != fmt->subSamplingW || mfmt->subSamplingH != fmt->subSamplingH)) {
+                vsapi->setFilterError("Frfun7: a mask which isn't gray must have the same subsampling as clip", frameCtx);
+                vsapi->freeFrame(mf);
+                vsapi->freeFrame(cf);
+                return nullptr;
+            }
+        }
+
         const VSFrameRef *pf = nullptr; // previous
         const VSFrameRef *nf = nullptr; // next
 
+        // A neighbour across a scene change is left out like those past the ends of the clip.
+        bool has_neighbour[2] = { false, false }; // previous, next
+
         if (mode_temporal) {
-          pf = vsapi->getFrameFilter(std::max(0, n - 1), d->clip, frameCtx);
-          nf = vsapi->getFrameFilter(std::min(n + 1, d->vi->numFrames - 1), d->clip, frameCtx);
+          const VSMap *props = vsapi->getFramePropsRO(cf);
+          int err;
+
+          has_neighbour[0] = n > 0 && !vsapi->propGetInt(props, "_SceneChangePrev", 0, &err);
+          has_neighbour[1] = n < d->vi->numFrames - 1 && !vsapi->propGetInt(props, "_SceneChangeNext", 0, &err);
+
+          if (has_neighbour[0])
+            pf = vsapi->getFrameFilter(n - 1, d->clip, frameCtx);
+          if (has_neighbour[1])
+            nf = vsapi->getFrameFilter(n + 1, d->clip, frameCtx);
         }
 
         const VSFrameRef *frames[3] = {
@@ -2028,10 +4250,16 @@ static const VSFrameRef *VS_CC frfun7GetFrame(int n, int activationReason, void
         };
         int planes[3] = { 0, 1, 2 };
 
-        VSFrameRef *df = vsapi->newVideoFrame2(fmt,
-                                               vsapi->getFrameWidth(cf, 0),
-                                               vsapi->getFrameHeight(cf, 0),
-                                               frames, planes, cf, core);
+        // one per output, df is that of this one
+        VSFrameRef *dfs[MaxStrengths] = {};
+
+        for (int i = 0; i < d->num_strengths; i++)
+            dfs[i] = vsapi->newVideoFrame2(fmt,
+                                           vsapi->getFrameWidth(cf, 0),
+                                           vsapi->getFrameHeight(cf, 0),
+                                           frames, planes, cf, core);
+
+        VSFrameRef *df = dfs[index];
 
 
         uint8_t *wpln = nullptr; // weight buffer videosize_x/4,videosize_y/4
@@ -2040,59 +4268,344 @@ static const VSFrameRef *VS_CC frfun7GetFrame(int n, int activationReason, void
         const int ALIGN = 32;
         int wp_stride = (((wp_width)+(ALIGN)-1) & (~((ALIGN)-1)));
 
-        if (mode_adaptive_overlapping)
+        // Passes 1..8 can reach one step further right or down than the diff pass,
+        // those blocks read 0.
+        if (mode_adaptive_overlapping) {
             wpln = vs_aligned_malloc<uint8_t>(wp_stride * wp_height, ALIGN);
+            memset(wpln, 0, wp_stride * wp_height);
+        }
+
+        // candidates accepted by the luma first pass, for the chroma planes
+        JointMasks jm;
+        memset(&jm, 0, sizeof(jm));
+
+        if (d->joint && !high_bitdepth) {
+            jm.luma_x = vsapi->getFrameWidth(cf, 0);
+            jm.luma_y = vsapi->getFrameHeight(cf, 0);
+            jm.stride = (jm.luma_x + 3 + 7) / 8 * 2; // same steps as process_plane_1stpass_joint
+            jm.rows = (jm.luma_y + 3 + 3) / 4;
+            jm.sub_x = 1 << fmt->subSamplingW;
+            jm.sub_y = 1 << fmt->subSamplingH;
+            jm.masks = vs_aligned_malloc<uint64_t>(sizeof(uint64_t) * jm.stride * jm.rows, ALIGN);
+        }
+
+        // Temporal mode: the SAD maps of each plane against the previous [0] and the next [1] frame,
+        // taken from the cache if the other frame of the pair got there first. See TemporalSads.
+        void *sads[3][2] = {};
+        bool sads_known[3][2] = {};
+        int sads_stride[3] = {};
+        size_t sads_size[3] = {};
+        const int sads_first[2] = { n - 1, n }; // lower frame number of each pair
+
+        if (d->sad_cache) {
+            for (int plane = 0; plane < fmt->numPlanes; plane++) {
+                if (!d->process[plane])
+                    continue;
+
+                sads_stride[plane] = (vsapi->getFrameWidth(cf, plane) + 3 + 7) / 8 * 2; // same steps as process_plane_1stpass
+                sads_size[plane] = sizeof(int) * sads_stride[plane] * ((vsapi->getFrameHeight(cf, plane) + 3 + 3) / 4); // int or float
+
+                for (int i = 0; i < 2; i++) {
+                    if (!has_neighbour[i])
+                        continue;
+
+                    sads[plane][i] = d->sad_cache->take(sads_first[i], plane, fmt->id, sads_size[plane]);
+                    sads_known[plane][i] = sads[plane][i] != nullptr;
+                    if (!sads[plane][i])
+                        sads[plane][i] = vs_aligned_malloc<uint8_t>(sads_size[plane], ALIGN);
+                }
+            }
+        }
+
+        // Static block reuse: a frame processed earlier, and the blocks of each plane
+        // whose output is copied from it. See StaticBlocks.
+        const VSFrameRef *reuse_src = nullptr;
+        const VSFrameRef *reuse_dst = nullptr;
+        StaticBlocks sb[3];
+        memset(sb, 0, sizeof(sb));
+
+        if (d->reuse_cache && d->reuse_cache->get(n, &reuse_src, &reuse_dst, vsapi)) {
+            if (vsapi->getFrameFormat(reuse_src)->id == fmt->id &&
+                vsapi->getFrameWidth(reuse_src, 0) == vsapi->getFrameWidth(cf, 0) &&
+                vsapi->getFrameHeight(reuse_src, 0) == vsapi->getFrameHeight(cf, 0)) {
+                // The first pass reads up to 2 * r1 + 3 pixels away from the blocks it writes,
+                // adaptive overlapping up to 8 including the weights of the diff pass.
+                const int reuse_radius = 2 * R_1stpass + 8;
+
+                for (int plane = 0; plane < fmt->numPlanes; plane++) {
+                    if (!d->process[plane])
+                        continue;
+
+                    const int dim_x = vsapi->getFrameWidth(cf, plane);
+                    const int dim_y = vsapi->getFrameHeight(cf, plane);
+
+                    sb[plane].width = (dim_x + 3) / 4;
+                    sb[plane].height = (dim_y + 3) / 4;
+                    sb[plane].stride = (((sb[plane].width)+(ALIGN)-1) & (~((ALIGN)-1)));
+                    sb[plane].blocks = vs_aligned_malloc<uint8_t>(sb[plane].stride * sb[plane].height, ALIGN);
+
+                    uint8_t *changed = vs_aligned_malloc<uint8_t>(sb[plane].stride * sb[plane].height, ALIGN);
+
+                    find_static_blocks(&sb[plane], changed,
+                                       vsapi->getReadPtr(cf, plane), vsapi->getStride(cf, plane),
+                                       vsapi->getReadPtr(reuse_src, plane), vsapi->getStride(reuse_src, plane),
+                                       dim_x, dim_y, fmt->bytesPerSample, reuse_radius);
+
+                    vs_aligned_free(changed);
+                }
+            }
+        }
+
+        if (mf) {
+            const VSFormat *mfmt = vsapi->getFrameFormat(mf);
+
+            for (int plane = 0; plane < fmt->numPlanes; plane++) {
+                if (!d->process[plane])
+                    continue;
+
+                const int mask_plane = mfmt->numPlanes > plane ? plane : 0;
+                const int shift_x = mask_plane == plane ? 0 : fmt->subSamplingW;
+                const int shift_y = mask_plane == plane ? 0 : fmt->subSamplingH;
+
+                sb[plane].width = (vsapi->getFrameWidth(cf, plane) + 3) / 4;
+                sb[plane].height = (vsapi->getFrameHeight(cf, plane) + 3) / 4;
+                sb[plane].stride = (((sb[plane].width)+(ALIGN)-1) & (~((ALIGN)-1)));
+                sb[plane].blocks = vs_aligned_malloc<uint8_t>(sb[plane].stride * sb[plane].height, ALIGN);
+
+                find_masked_blocks(&sb[plane],
+                                   vsapi->getReadPtr(mf, mask_plane), vsapi->getStride(mf, mask_plane),
+                                   vsapi->getFrameWidth(mf, mask_plane), vsapi->getFrameHeight(mf, mask_plane),
+                                   shift_x, shift_y);
+            }
+        }
+
 
+        // Several iterations: all but the last one write to a scratch plane, which the next one reads.
+        // These have the strides of df.
+        uint8_t *scratch[2][3] = {};
+
+        for (int i = 0; i < 2 && i < d->iterations - 1; i++) {
+            for (int plane = 0; plane < fmt->numPlanes; plane++) {
+                if (d->process[plane])
+                    scratch[i][plane] = vs_aligned_malloc<uint8_t>(vsapi->getStride(df, plane) * vsapi->getFrameHeight(df, plane), ALIGN);
+            }
+        }
 
         const int num_of_planes = d->vi->format->numPlanes;
-        for (int plane = 0; plane < num_of_planes; plane++) { // PLANES LOOP
+        for (int iteration = 0; iteration < d->iterations; iteration++) { // ITERATIONS LOOP
+          const uint8_t *srcp_planes[3] = {};
+          int src_pitches[3] = {};
+          uint8_t *dstp_planes[3] = {};
+          int dst_pitches[3] = {};
+
+          for (int plane = 0; plane < num_of_planes; plane++) {
+            if (iteration == 0) {
+              srcp_planes[plane] = vsapi->getReadPtr(cf, plane);
+              src_pitches[plane] = vsapi->getStride(cf, plane);
+            } else {
+              srcp_planes[plane] = scratch[(iteration - 1) & 1][plane];
+              src_pitches[plane] = vsapi->getStride(df, plane);
+            }
 
-          if (!d->process[plane])
-            continue;
+            if (iteration == d->iterations - 1)
+              dstp_planes[plane] = vsapi->getWritePtr(df, plane);
+            else
+              dstp_planes[plane] = scratch[iteration & 1][plane];
+            dst_pitches[plane] = vsapi->getStride(df, plane);
+          }
 
-          const int dim_x = vsapi->getFrameWidth(cf, plane);
-          const int dim_y = vsapi->getFrameHeight(cf, plane);
+          // Like separate calls, every iteration starts with the weights at 0.
+          if (iteration > 0 && wpln)
+            memset(wpln, 0, wp_stride * wp_height);
 
-          // prev/next: only for temporal
-          const uint8_t* srcp_prev_orig = nullptr;
-          const uint8_t* srcp_next_orig = nullptr;
-          int src_prev_pitch = 0;
-          int src_next_pitch = 0;
+          for (int plane = 0; plane < num_of_planes; plane++) { // PLANES LOOP
+
+            if (!d->process[plane])
+              continue;
+
+            const int dim_x = vsapi->getFrameWidth(cf, plane);
+            const int dim_y = vsapi->getFrameHeight(cf, plane);
+
+            // prev/next: only for temporal
+            const uint8_t* srcp_prev_orig = nullptr;
+            const uint8_t* srcp_next_orig = nullptr;
+            int src_prev_pitch = 0;
+            int src_next_pitch = 0;
+
+            if (pf) {
+              srcp_prev_orig = vsapi->getReadPtr(pf, plane);
+              src_prev_pitch = vsapi->getStride(pf, plane);
+            }
+
+            if (nf) {
+              srcp_next_orig = vsapi->getReadPtr(nf, plane);
+              src_next_pitch = vsapi->getStride(nf, plane);
+            }
+
+            const uint8_t* srcp_orig = srcp_planes[plane];
+            const int src_pitch = src_pitches[plane];
+
+            uint8_t* dstp_orig = dstp_planes[plane];
+            const int dstp_pitch = dst_pitches[plane];
+
+            int tmax = Thresh_luma;
+            if (plane > 0) tmax = Thresh_chroma;
+
+            static_assert(sizeof(int) == sizeof(float), "the SAD maps hold either");
+            const TemporalSads<int> ts = { (int *)sads[plane][0], (int *)sads[plane][1], sads_stride[plane], sads_known[plane][0], sads_known[plane][1] };
+            const TemporalSads<float> ts_float = { (float *)sads[plane][0], (float *)sads[plane][1], sads_stride[plane], sads_known[plane][0], sads_known[plane][1] };
+
+            // The pitches are in pixels.
+            if (fmt->sampleType == stFloat) {
+              d->plane_func_float(d->kernels_float,
+                                  (const float *)srcp_orig, src_pitch / 4,
+                                  (const float *)srcp_prev_orig, src_prev_pitch / 4,
+                                  (const float *)srcp_next_orig, src_next_pitch / 4,
+                                  (float *)dstp_orig, dstp_pitch / 4,
+                                  dim_x, dim_y,
+                                  R_1stpass, lambda, P1_param, tmax, 0,
+                                  d->inv_table_float,
+                                  wpln, wp_stride,
+                                  nullptr,
+                                  d->sad_cache ? &ts_float : nullptr,
+                                  sb[plane].blocks ? &sb[plane] : nullptr);
+              continue;
+            }
+
+            if (high_bitdepth) {
+              const int sad_shift = fmt->bitsPerSample - 8;
+
+              d->plane_func16(d->kernels16,
+                              (const uint16_t *)srcp_orig, src_pitch / 2,
+                              (const uint16_t *)srcp_prev_orig, src_prev_pitch / 2,
+                              (const uint16_t *)srcp_next_orig, src_next_pitch / 2,
+                              (uint16_t *)dstp_orig, dstp_pitch / 2,
+                              dim_x, dim_y,
+                              R_1stpass, lambda, P1_param, tmax, sad_shift,
+                              d->inv_table16,
+                              wpln, wp_stride,
+                              nullptr,
+                              d->sad_cache ? &ts : nullptr,
+                              sb[plane].blocks ? &sb[plane] : nullptr);
+              continue;
+            }
+
+            if (d->strengths_func) {
+              uint8_t *dstps[MaxStrengths];
+              int dstp_pitches[MaxStrengths];
+              int tmaxes[MaxStrengths];
+
+              for (int i = 0; i < d->num_strengths; i++) {
+                dstps[i] = vsapi->getWritePtr(dfs[i], plane);
+                dstp_pitches[i] = vsapi->getStride(dfs[i], plane);
+                tmaxes[i] = plane > 0 ? Thresh_chroma : d->Thresh_lumas[i];
+              }
+
+              d->strengths_func(d->kernels,
+                                srcp_orig, src_pitch,
+                                dstps, dstp_pitches,
+                                dim_x, dim_y,
+                                d->num_strengths, d->lambdas, tmaxes, P1_param,
+                                inv_table,
+                                wpln, wp_stride);
+              continue;
+            }
 
-          if (mode_temporal) {
-            srcp_prev_orig = vsapi->getReadPtr(pf, plane);
-            src_prev_pitch = vsapi->getStride(pf, plane);
+            // U and V together, V is the last plane
+            if (plane == 1 && d->planes_uv_func &&
+                src_pitches[2] == src_pitch && dst_pitches[2] == dstp_pitch) {
+              d->planes_uv_func(d->kernels,
+                                srcp_orig, srcp_planes[2], src_pitch,
+                                dstp_orig, dstp_planes[2], dstp_pitch,
+                                dim_x, dim_y,
+                                lambda, P1_param, tmax,
+                                inv_table,
+                                wpln, wp_stride);
+              break;
+            }
 
-            srcp_next_orig = vsapi->getReadPtr(nf, plane);
-            src_next_pitch = vsapi->getStride(nf, plane);
+            PlaneFunc<uint8_t> plane_func = plane > 0 ? d->plane_func_chroma : d->plane_func;
+
+            plane_func(d->kernels,
+                       srcp_orig, src_pitch,
+                       srcp_prev_orig, src_prev_pitch,
+                       srcp_next_orig, src_next_pitch,
+                       dstp_orig, dstp_pitch,
+                       dim_x, dim_y,
+                       R_1stpass, lambda, P1_param, tmax, 0,
+                       inv_table,
+                       wpln, wp_stride,
+                       &jm,
+                       d->sad_cache ? &ts : nullptr,
+                       sb[plane].blocks ? &sb[plane] : nullptr);
+          } // PLANES LOOP
+
+          // Mask: the blocks outside of it keep the source of this iteration.
+          if (mf) {
+            for (int plane = 0; plane < num_of_planes; plane++) {
+              if (!sb[plane].blocks)
+                continue;
+
+              copy_static_blocks(sb[plane],
+                                 srcp_planes[plane], src_pitches[plane],
+                                 dstp_planes[plane], dst_pitches[plane],
+                                 vsapi->getFrameWidth(df, plane), vsapi->getFrameHeight(df, plane),
+                                 fmt->bytesPerSample);
+            }
           }
+        } // ITERATIONS LOOP
+
+        for (int i = 0; i < 2; i++) {
+            for (int plane = 0; plane < 3; plane++) {
+                if (scratch[i][plane])
+                    vs_aligned_free(scratch[i][plane]);
+            }
+        }
+
+        // The maps computed here go to the cache for the other frame of each pair.
+        for (int plane = 0; plane < 3; plane++) {
+            for (int i = 0; i < 2; i++) {
+                if (!sads[plane][i])
+                    continue;
+
+                if (!sads_known[plane][i])
+                    d->sad_cache->put(sads_first[i], plane, fmt->id, sads_size[plane], sads[plane][i]);
+                else
+                    vs_aligned_free(sads[plane][i]);
+            }
+        }
 
-          const uint8_t* srcp_orig = vsapi->getReadPtr(cf, plane);
-          const int src_pitch = vsapi->getStride(cf, plane);
+        for (int plane = 0; plane < 3; plane++) {
+            if (!sb[plane].blocks)
+                continue;
 
-          uint8_t* dstp_orig = vsapi->getWritePtr(df, plane);
-          const int dstp_pitch = vsapi->getStride(df, plane);
+            if (reuse_dst)
+                copy_static_blocks(sb[plane],
+                                   vsapi->getReadPtr(reuse_dst, plane), vsapi->getStride(reuse_dst, plane),
+                                   vsapi->getWritePtr(df, plane), vsapi->getStride(df, plane),
+                                   vsapi->getFrameWidth(df, plane), vsapi->getFrameHeight(df, plane),
+                                   fmt->bytesPerSample);
 
-          int tmax = Thresh_luma;
-          if (plane > 0) tmax = Thresh_chroma;
+            vs_aligned_free(sb[plane].blocks);
+        }
+
+        if (d->reuse_cache)
+            d->reuse_cache->put(n, cf, df, vsapi);
 
-          (d->opt ? process_plane<SIMD>
-                  : process_plane<Scalar>)(srcp_orig, src_pitch,
-                                          srcp_prev_orig, src_prev_pitch,
-                                          srcp_next_orig, src_next_pitch,
-                                          dstp_orig, dstp_pitch,
-                                          mode_adaptive_overlapping, mode_temporal, mode_adaptive_radius,
-                                          dim_x, dim_y,
-                                          R_1stpass, lambda, P1_param, tmax,
-                                          inv_table,
-                                          wpln, wp_stride);
-        } // PLANES LOOP
+        for (int i = 0; i < d->num_strengths; i++)
+            if (i != index)
+                d->strength_cache->put(n, i, dfs[i], vsapi);
 
         vsapi->freeFrame(cf);
         vsapi->freeFrame(pf);
         vsapi->freeFrame(nf);
+        vsapi->freeFrame(reuse_src);
+        vsapi->freeFrame(reuse_dst);
+        vsapi->freeFrame(mf);
         if (wpln)
             vs_aligned_free(wpln);
+        if (jm.masks)
+            vs_aligned_free(jm.masks);
 
         return df;
     }
@@ -2107,6 +4620,14 @@ static void VS_CC frfun7Free(void *instanceData, VSCore *core, const VSAPI *vsap
     Frfun7Data *d = (Frfun7Data *)instanceData;
 
     vsapi->freeNode(d->clip);
+    vsapi->freeNode(d->mask);
+    delete d->sad_cache;
+    if (d->reuse_cache)
+        d->reuse_cache->clear(vsapi);
+    delete d->reuse_cache;
+    if (d->strength_cache)
+        d->strength_cache->clear(vsapi);
+    delete d->strength_cache;
     free(d);
 }
 
@@ -2119,18 +4640,39 @@ static void VS_CC frfun7Create(const VSMap *in, VSMap *out, void *userData, VSCo
 
     int err;
 
-    double lambda = vsapi->propGetFloat(in, "l", 0, &err);
-    if (err)
-        lambda = 1.1;
+    // Several values of l or t make one output each. If one of them has a single value, it is used for every output.
+    const int num_l = vsapi->propNumElements(in, "l");
+    const int num_t = vsapi->propNumElements(in, "t");
+
+    d.num_strengths = std::max(1, std::max(num_l, num_t));
 
-    d.lambda = (int)(lambda * 1024); // 10 bit integer arithmetic
+    if (d.num_strengths > MaxStrengths) {
+        vsapi->setError(out, "Frfun7: l and t can have at most 8 values");
+        return;
+    }
+
+    if ((num_l > 1 && num_l != d.num_strengths) || (num_t > 1 && num_t != d.num_strengths)) {
+        vsapi->setError(out, "Frfun7: l and t must have the same number of values, unless one of them has only one");
+        return;
+    }
 
+    for (int i = 0; i < d.num_strengths; i++) {
+        double lambda = vsapi->propGetFloat(in, "l", num_l > 1 ? i : 0, &err);
+        if (err)
+            lambda = 1.1;
 
-    double t = vsapi->propGetFloat(in, "t", 0, &err);
-    if (err)
-        t = 6;
+        d.lambdas[i] = (int)(lambda * 1024); // 10 bit integer arithmetic
+
+
+        double t = vsapi->propGetFloat(in, "t", num_t > 1 ? i : 0, &err);
+        if (err)
+            t = 6;
 
-    d.Thresh_luma = (int)(t * 16); // internal subsampling is 4x4, probably x16 covers that
+        d.Thresh_lumas[i] = (int)(t * 16); // internal subsampling is 4x4, probably x16 covers that
+    }
+
+    d.lambda = d.lambdas[0];
+    d.Thresh_luma = d.Thresh_lumas[0];
 
 
     double tuv = vsapi->propGetFloat(in, "tuv", 0, &err);
@@ -2157,9 +4699,25 @@ static void VS_CC frfun7Create(const VSMap *in, VSMap *out, void *userData, VSCo
         d.R_1stpass = 3;
 
 
-    d.opt = !!vsapi->propGetInt(in, "opt", 0, &err);
+    d.opt = int64ToIntS(vsapi->propGetInt(in, "opt", 0, &err));
+    if (err)
+        d.opt = Auto;
+
+    bool fast = !!vsapi->propGetInt(in, "fast", 0, &err);
+
+    int pattern = int64ToIntS(vsapi->propGetInt(in, "pattern", 0, &err));
+    if (err)
+        pattern = PatternDense;
+
+    bool joint = !!vsapi->propGetInt(in, "joint", 0, &err);
+
+    bool reuse = !!vsapi->propGetInt(in, "reuse", 0, &err);
+
+    d.iterations = int64ToIntS(vsapi->propGetInt(in, "iterations", 0, &err));
     if (err)
-        d.opt = 1;
+        d.iterations = 1;
+
+    const bool masked = vsapi->propNumElements(in, "mask") > 0;
 
 
     d.process[0] = d.Thresh_luma != 0;
@@ -2167,25 +4725,162 @@ static void VS_CC frfun7Create(const VSMap *in, VSMap *out, void *userData, VSCo
     d.process[2] = d.process[1];
 
 
-    if (d.lambda < 0) {
-        vsapi->setError(out, "Frfun7: lambda cannot be negative");
+    for (int i = 0; i < d.num_strengths; i++) {
+        if (d.lambdas[i] < 0) {
+            vsapi->setError(out, "Frfun7: lambda cannot be negative");
+            return;
+        }
+
+        if (d.Thresh_lumas[i] < 0 || d.Thresh_chroma < 0) {
+            vsapi->setError(out, "Frfun7: threshold cannot be negative");
+            return;
+        }
+
+        // The luma plane is processed in every output or in none.
+        if ((d.Thresh_lumas[i] != 0) != d.process[0]) {
+            vsapi->setError(out, "Frfun7: t can only be 0 if all of its values are");
+            return;
+        }
+    }
+
+    if (d.R_1stpass < 2 || d.R_1stpass > 7) {
+        vsapi->setError(out, "Frfun7: r1 (1st pass radius) must be between 2 and 7 (inclusive)");
+        return;
+    }
+
+    if (d.opt < -1 || d.opt > 4) {
+        vsapi->setError(out, "Frfun7: opt must be between -1 and 4 (inclusive)");
+        return;
+    }
+
+    // The subsampled matching only has plain C++ and SSE2 kernels.
+    if (fast && d.opt != Auto && d.opt != Scalar && d.opt != SIMD) {
+        vsapi->setError(out, "Frfun7: fast only works with opt -1, 0, or 1");
+        return;
+    }
+
+    if (pattern < PatternDense || pattern > PatternChecker) {
+        vsapi->setError(out, "Frfun7: pattern must be between 0 and 3 (inclusive)");
+        return;
+    }
+
+    // The sparse matching only has plain C++ and SSE2 kernels too.
+    if (pattern != PatternDense && d.opt != Auto && d.opt != Scalar && d.opt != SIMD) {
+        vsapi->setError(out, "Frfun7: pattern only works with opt -1, 0, or 1");
+        return;
+    }
+
+    if (joint && ((d.P & 6) || d.R_1stpass > 3)) {
+        vsapi->setError(out, "Frfun7: joint only works with p=0 or p=1 and r1 up to 3");
+        return;
+    }
+
+    // And so does the joint first pass.
+    if (joint && d.opt != Auto && d.opt != Scalar && d.opt != SIMD) {
+        vsapi->setError(out, "Frfun7: joint only works with opt -1, 0, or 1");
+        return;
+    }
+
+    // The output of the temporal mode depends on the neighbouring frames too,
+    // and that of the joint chroma first pass on the luma plane.
+    if (reuse && ((d.P & 2) || joint)) {
+        vsapi->setError(out, "Frfun7: reuse doesn't work with p=2 or joint");
+        return;
+    }
+
+    // The first pass of several strengths is that of the joint luma plane.
+    if (d.num_strengths > 1 && ((d.P & 6) || d.R_1stpass > 3 || joint || reuse)) {
+        vsapi->setError(out, "Frfun7: several strengths only work with p=0 or p=1 and r1 up to 3, and not with joint or reuse");
+        return;
+    }
+
+    if (d.iterations < 1) {
+        vsapi->setError(out, "Frfun7: iterations must be at least 1");
+        return;
+    }
+
+    // Each iteration after the first one only has the output of the previous one,
+    // not that of the neighbouring frames, of the other strengths, or of an earlier frame.
+    if (d.iterations > 1 && ((d.P & 2) || reuse || d.num_strengths > 1)) {
+        vsapi->setError(out, "Frfun7: iterations don't work with p=2, reuse, or several strengths");
+        return;
+    }
+
+    // The other frame of each pair in temporal mode, and the earlier frame of reuse,
+    // may have a different mask. Several strengths don't skip any blocks.
+    if (masked && ((d.P & 2) || reuse || d.num_strengths > 1)) {
+        vsapi->setError(out, "Frfun7: mask doesn't work with p=2, reuse, or several strengths");
         return;
     }
 
-    if (d.Thresh_luma < 0 || d.Thresh_chroma < 0) {
-        vsapi->setError(out, "Frfun7: threshold cannot be negative");
+    if (joint && !d.process[0] && d.process[1]) {
+        vsapi->setError(out, "Frfun7: joint needs the luma plane to be processed (t greater than 0)");
         return;
     }
 
-    if (d.R_1stpass != 2 && d.R_1stpass != 3) {
-        vsapi->setError(out, "Frfun7: r1 (1st pass radius) must be 2 or 3");
+    if (d.opt == Auto)
+        d.opt = (fast || pattern != PatternDense || joint) ? (cpu_supports(SIMD) ? SIMD : Scalar) : detect_cpu_opt();
+
+    if (!cpu_supports(d.opt)) {
+        vsapi->setError(out, "Frfun7: the CPU doesn't support the instruction set selected with opt");
         return;
     }
 
+    fill_kernels(&d.kernels, d.opt, fast, pattern);
+
+    // Without chroma processing there is nothing to guide.
+    d.joint = joint && d.process[1];
+
+    d.plane_func = select_process_plane(d.P, d.R_1stpass, d.kernels.has_wide, d.joint ? JointLuma : JointOff);
+    d.plane_func_chroma = select_process_plane(d.P, d.R_1stpass, d.kernels.has_wide, d.joint ? JointChroma : JointOff);
+    // It would process every block of both planes, static or not.
+    d.planes_uv_func = (reuse || masked) ? nullptr : select_process_planes_uv(d.kernels, d.P, d.R_1stpass, d.joint);
+
+    if (d.num_strengths > 1)
+        d.strengths_func = select_process_plane_strengths(d.P, d.R_1stpass, d.kernels.has_wide);
+
+    fill_kernels16(&d.kernels16, d.opt);
+    fill_kernels_float(&d.kernels_float, d.opt);
+
+    if (d.R_1stpass <= 3) {
+        d.plane_func16 = select_process_plane_hbd<uint16_t>(d.P, d.R_1stpass, d.kernels16.has_wide);
+        d.plane_func_float = select_process_plane_hbd<float>(d.P, d.R_1stpass, d.kernels_float.has_wide);
+    }
+
 
     d.clip = vsapi->propGetNode(in, "clip", 0, nullptr);
     d.vi = vsapi->getVideoInfo(d.clip);
 
+    // Checked again in frfun7GetFrame for clips whose format can change.
+    if (d.vi->format && d.vi->format->bitsPerSample > 8 &&
+        (d.joint || fast || pattern != PatternDense || d.R_1stpass > 3)) {
+        vsapi->setError(out, "Frfun7: with more than 8 bits per sample joint, fast, and pattern are not supported, and r1 must be 2 or 3");
+        vsapi->freeNode(d.clip);
+        return;
+    }
+
+    if (d.vi->format && d.vi->format->bitsPerSample > 8 && d.num_strengths > 1) {
+        vsapi->setError(out, "Frfun7: several strengths only work with 8 bit clips");
+        vsapi->freeNode(d.clip);
+        return;
+    }
+
+    if (masked) {
+        d.mask = vsapi->propGetNode(in, "mask", 0, nullptr);
+
+        // A gray mask is used for every plane, otherwise each plane has its own.
+        const VSVideoInfo *mvi = vsapi->getVideoInfo(d.mask);
+        if (!isConstantFormat(mvi) || mvi->format->sampleType != stInteger || mvi->format->bitsPerSample != 8 ||
+            mvi->width != d.vi->width || mvi->height != d.vi->height || mvi->numFrames != d.vi->numFrames ||
+            (mvi->format->colorFamily != cmGray && d.vi->format &&
+             (mvi->format->subSamplingW != d.vi->format->subSamplingW || mvi->format->subSamplingH != d.vi->format->subSamplingH))) {
+            vsapi->setError(out, "Frfun7: mask must be an 8 bit clip of the same size and length as clip, either gray or with the same subsampling");
+            vsapi->freeNode(d.mask);
+            vsapi->freeNode(d.clip);
+            return;
+        }
+    }
+
 
     // pre-build reciprocial table
     for (int i = 1; i < 1024; i++) {
@@ -2194,6 +4889,22 @@ static void VS_CC frfun7Create(const VSMap *in, VSMap *out, void *userData, VSCo
     }
     d.inv_table[1] = 32767; // 2^15 - 1
 
+    // 2^30 / x rounded up, for the 32 bit sums of more than 8 bits
+    for (int i = 1; i < 1024; i++)
+      d.inv_table16[i] = (int)(((1 << 30) + i - 1) / i);
+
+    for (int i = 1; i < 1024; i++)
+      d.inv_table_float[i] = 1.0f / i;
+
+
+    if ((d.P & 2) && d.R_1stpass <= 3)
+        d.sad_cache = new SadCache;
+
+    if (reuse)
+        d.reuse_cache = new ReuseCache;
+
+    if (d.num_strengths > 1)
+        d.strength_cache = new StrengthCache;
 
     Frfun7Data *data = (Frfun7Data *)malloc(sizeof(d));
     *data = d;
@@ -2206,12 +4917,18 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
     configFunc("com.nodame.frfun7", "frfun7", "A spatial denoising filter", (3 << 16) | 5, 1, plugin);
     registerFunc("Frfun7",
                  "clip:clip;"
-                 "l:float:opt;"
-                 "t:float:opt;"
+                 "l:float[]:opt;"
+                 "t:float[]:opt;"
                  "tuv:float:opt;"
                  "p:int:opt;"
                  "tp1:int:opt;"
                  "r1:int:opt;"
                  "opt:int:opt;"
+                 "fast:int:opt;"
+                 "pattern:int:opt;"
+                 "joint:int:opt;"
+                 "reuse:int:opt;"
+                 "iterations:int:opt;"
+                 "mask:clip:opt;"
                  , frfun7Create, nullptr, plugin);
 }
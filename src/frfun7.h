@@ -0,0 +1,244 @@
+#ifndef FRFUN7_H
+#define FRFUN7_H
+
+#include <cstdint>
+
+#ifdef FRFUN7_X86
+#include <emmintrin.h>
+#endif
+
+
+#ifdef _WIN32
+#define AVS_FORCEINLINE __forceinline
+#else
+#define AVS_FORCEINLINE inline __attribute__((always_inline))
+#endif
+
+
+AVS_FORCEINLINE int get_weight(int alpha)
+{
+  int a = ((alpha * (1 << 15)) / ((alpha + 1)));
+  int b = ((1 << 15) / ((alpha + 1)));
+  return (a << 16) | b;
+}
+
+
+// Candidate sets of the block matching, the pattern parameter.
+// dx and dy are the displacement, between -R and R.
+enum SearchPattern {
+  PatternDense = 0,   // every displacement
+  PatternDiamond = 1, // |dx| + |dy| <= R
+  PatternStar = 2,    // the cross and the two diagonals
+  PatternChecker = 3, // every other displacement, dx + dy even
+};
+
+constexpr bool pattern_has(int pattern, int R, int dx, int dy)
+{
+  int ax = dx < 0 ? -dx : dx;
+  int ay = dy < 0 ? -dy : dy;
+
+  switch (pattern) {
+  case PatternDiamond:
+    return ax + ay <= R;
+  case PatternStar:
+    return ax == 0 || ay == 0 || ax == ay;
+  case PatternChecker:
+    return ((ax + ay) & 1) == 0;
+  default:
+    return true;
+  }
+}
+
+
+// Portable kernels, frfun7_vec.cpp
+// Same as the *_simd ones, written with GCC/Clang vector extensions.
+
+void frcore_filter_b4r0_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+void frcore_filter_b4r2_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+void frcore_filter_b4r3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+
+void frcore_filter_adapt_b4r2_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_filter_adapt_b4r3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+
+void frcore_filter_overlap_b4r2_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+void frcore_filter_overlap_b4r3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+
+void frcore_filter_diff_b4r1_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2]);
+
+void frcore_dev_2x_b4_vec(const uint8_t* ptra, int pitcha, int dev[2]);
+void frcore_sad_2x_b4_vec(const uint8_t* ptra, int pitcha, const uint8_t* ptrb, int pitchb, int sad[2]);
+
+
+// First pass for any radius, frfun7_plane.cpp
+// Goes over the whole plane, one displacement at a time for each row of blocks.
+// The output matches the first pass loop of process_plane with 4x4 blocks processed one at a time.
+// fast: the candidates are matched on rows 0 and 2 only, like the *_fast_* kernels.
+// pattern: the SearchPattern of the searches without adaptive radius.
+
+void frcore_1stpass_plane(const uint8_t* srcp, int src_pitch,
+                          const uint8_t* srcp_prev, int src_prev_pitch,
+                          const uint8_t* srcp_next, int src_next_pitch,
+                          uint8_t* dstp, int dst_pitch,
+                          bool mode_temporal, bool mode_adaptive_radius, bool fast, int pattern,
+                          int dim_x, int dim_y,
+                          int R, int lambda, int tmax,
+                          const int* inv_table);
+
+
+// 9 to 16 bit kernels, frfun7_u16.cpp
+// Same as the 8 bit ones with uint16_t pixels and the pitches in pixels.
+// inv_table is Frfun7Data::inv_table16, the SADs and thresh are in units of the bit depth.
+
+void frcore_filter_u16_b4r0_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+void frcore_filter_u16_b4r2_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+void frcore_filter_u16_b4r3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+
+void frcore_filter_adapt_u16_b4r2_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_filter_adapt_u16_b4r3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+
+void frcore_filter_overlap_u16_b4r2_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+void frcore_filter_overlap_u16_b4r3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+
+void frcore_filter_diff_u16_b4r1_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2]);
+
+void frcore_dev_u16_2x_b4_scalar(const uint16_t* ptra, int pitcha, int dev[2]);
+void frcore_sad_u16_2x_b4_scalar(const uint16_t* ptra, int pitcha, const uint16_t* ptrb, int pitchb, int sad[2]);
+
+
+// Float kernels, frfun7_float.cpp
+// Same as the 8 bit ones with float pixels, SADs, thresholds and reciprocals, and the pitches in pixels.
+// weight is the weight of the old pixels, which the diff kernel replaces with the mean
+// absolute difference between the old and the new pixels.
+
+void frcore_filter_float_b4r0_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table);
+void frcore_filter_float_b4r2_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table);
+void frcore_filter_float_b4r3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table);
+
+void frcore_filter_adapt_float_b4r2_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table);
+void frcore_filter_adapt_float_b4r3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table);
+
+void frcore_filter_overlap_float_b4r2_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2]);
+void frcore_filter_overlap_float_b4r3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2]);
+
+void frcore_filter_diff_float_b4r1_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2]);
+
+void frcore_dev_float_2x_b4_scalar(const float* ptra, int pitcha, float dev[2]);
+void frcore_sad_float_2x_b4_scalar(const float* ptra, int pitcha, const float* ptrb, int pitchb, float sad[2]);
+
+
+#ifdef FRFUN7_X86
+
+// 32 and 64 bit loads into the low bits of a register
+AVS_FORCEINLINE __m128i _mm_load_si32(const uint8_t* ptr) {
+  return _mm_castps_si128(_mm_load_ss((const float*)(ptr)));
+}
+
+AVS_FORCEINLINE __m128i _mm_load_si64(const uint8_t* ptr) {
+  return _mm_loadl_epi64((const __m128i*)(ptr));
+}
+
+void frcore_filter_u16_b4r0_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+void frcore_filter_u16_b4r2_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+void frcore_filter_u16_b4r3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+
+void frcore_filter_adapt_u16_b4r2_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_filter_adapt_u16_b4r3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+
+void frcore_filter_overlap_u16_b4r2_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+void frcore_filter_overlap_u16_b4r3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+
+void frcore_filter_diff_u16_b4r1_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2]);
+
+void frcore_dev_u16_2x_b4_simd(const uint16_t* ptra, int pitcha, int dev[2]);
+void frcore_sad_u16_2x_b4_simd(const uint16_t* ptra, int pitcha, const uint16_t* ptrb, int pitchb, int sad[2]);
+
+void frcore_filter_float_b4r0_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table);
+void frcore_filter_float_b4r2_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table);
+void frcore_filter_float_b4r3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table);
+
+void frcore_filter_adapt_float_b4r2_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table);
+void frcore_filter_adapt_float_b4r3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table);
+
+void frcore_filter_overlap_float_b4r2_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2]);
+void frcore_filter_overlap_float_b4r3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2]);
+
+void frcore_filter_diff_float_b4r1_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2]);
+
+void frcore_dev_float_2x_b4_simd(const float* ptra, int pitcha, float dev[2]);
+void frcore_sad_float_2x_b4_simd(const float* ptra, int pitcha, const float* ptrb, int pitchb, float sad[2]);
+
+// SSE4.1 kernels, frfun7_sse41.cpp
+// Same as the *_simd ones, but the SADs come from mpsadbw.
+// They read 16 bytes per row starting at ptra - R, which must stay inside the plane.
+
+void frcore_filter_b4r2_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+void frcore_filter_b4r3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table);
+
+void frcore_filter_adapt_b4r2_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_filter_adapt_b4r3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table);
+
+void frcore_filter_overlap_b4r2_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+void frcore_filter_overlap_b4r3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2]);
+
+// AVX2 kernels, frfun7_avx2.cpp
+// Same as the *_simd ones, but they process four horizontally adjacent 4x4 blocks (16 pixels) per call.
+// thresh, weight, process_blocks, dev and sad have four elements.
+
+void frcore_filter_b4r0_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table);
+void frcore_filter_b4r2_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table);
+void frcore_filter_b4r3_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table);
+
+void frcore_filter_adapt_b4r2_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_filter_adapt_b4r3_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table);
+
+void frcore_filter_overlap_b4r2_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4]);
+void frcore_filter_overlap_b4r3_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4]);
+
+void frcore_filter_diff_b4r1_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4]);
+
+void frcore_dev_4x_b4_avx2(const uint8_t* ptra, int pitcha, int dev[4]);
+void frcore_sad_4x_b4_avx2(const uint8_t* ptra, int pitcha, const uint8_t* ptrb, int pitchb, int sad[4]);
+
+// Two blocks of the U plane and the same two of the V plane, see process_planes_1stpass_uv.
+// dev and thresh are U0, U1, V0, V1.
+void frcore_filter_uv_b4r2_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], const int* inv_table);
+void frcore_filter_uv_b4r3_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], const int* inv_table);
+void frcore_filter_adapt_uv_b4r2_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_filter_adapt_uv_b4r3_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_dev_uv_b4_avx2(const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, int dev[4]);
+
+// 9 to 16 bit, see frfun7_u16.cpp
+void frcore_filter_u16_b4r0_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table);
+void frcore_filter_u16_b4r2_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table);
+void frcore_filter_u16_b4r3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table);
+
+void frcore_filter_adapt_u16_b4r2_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table);
+void frcore_filter_adapt_u16_b4r3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table);
+
+void frcore_filter_overlap_u16_b4r2_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4]);
+void frcore_filter_overlap_u16_b4r3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4]);
+
+void frcore_filter_diff_u16_b4r1_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4]);
+
+void frcore_dev_u16_4x_b4_avx2(const uint16_t* ptra, int pitcha, int dev[4]);
+void frcore_sad_u16_4x_b4_avx2(const uint16_t* ptra, int pitcha, const uint16_t* ptrb, int pitchb, int sad[4]);
+
+// float, see frfun7_float.cpp
+void frcore_filter_float_b4r0_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table);
+void frcore_filter_float_b4r2_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table);
+void frcore_filter_float_b4r3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table);
+
+void frcore_filter_adapt_float_b4r2_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], float sThresh2, float sThresh3, const float* inv_table);
+void frcore_filter_adapt_float_b4r3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], float sThresh2, float sThresh3, const float* inv_table);
+
+void frcore_filter_overlap_float_b4r2_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table, float weight[4], int process_blocks[4]);
+void frcore_filter_overlap_float_b4r3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table, float weight[4], int process_blocks[4]);
+
+void frcore_filter_diff_float_b4r1_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table, float weight[4]);
+
+void frcore_dev_float_4x_b4_avx2(const float* ptra, int pitcha, float dev[4]);
+void frcore_sad_float_4x_b4_avx2(const float* ptra, int pitcha, const float* ptrb, int pitchb, float sad[4]);
+
+#endif // FRFUN7_X86
+
+#endif // FRFUN7_H
@@ -0,0 +1,1532 @@
+#include <algorithm>
+
+#include <immintrin.h>
+
+#include "frfun7.h"
+
+
+// Four horizontally adjacent 4x4 blocks are processed at once.
+// Pixels are widened to words when loaded, so one row of the four blocks fills a ymm register,
+// and a vpsadbw on the words produces the SAD of one 4 pixel block row in each quadword
+// (the upper bytes are zero in both operands).
+// The quadword order matches the block order, which keeps everything inside the 128 bit lanes
+// except the final packing.
+
+static AVS_FORCEINLINE __m256i avx2_load_row16(const uint8_t* ptr) {
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)ptr));
+}
+
+static AVS_FORCEINLINE void avx2_store_row16(uint8_t* ptr, __m128i packed) {
+  _mm_storeu_si128((__m128i *)ptr, packed);
+}
+
+
+// The *_uv kernels process two horizontally adjacent blocks of the U plane and the
+// same two blocks of the V plane. U goes in the low 128 bit lane and V in the high one,
+// so the kernels below work unchanged on a pair of pointers that move together.
+template <typename T>
+struct Avx2UVPtr {
+  T* u;
+  T* v;
+
+  Avx2UVPtr operator+(int i) const { return { u + i, v + i }; }
+  Avx2UVPtr &operator+=(int i) { u += i; v += i; return *this; }
+  Avx2UVPtr &operator-=(int i) { u -= i; v -= i; return *this; }
+};
+
+static AVS_FORCEINLINE __m256i avx2_load_row16(Avx2UVPtr<const uint8_t> ptr) {
+  auto uv = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)ptr.u), _mm_loadl_epi64((const __m128i *)ptr.v));
+  return _mm256_cvtepu8_epi16(uv);
+}
+
+static AVS_FORCEINLINE void avx2_store_row16(Avx2UVPtr<uint8_t> ptr, __m128i packed) {
+  _mm_storel_epi64((__m128i *)ptr.u, packed);
+  _mm_storel_epi64((__m128i *)ptr.v, _mm_unpackhi_epi64(packed, packed));
+}
+
+// one threshold in the low dword of each quadword
+static AVS_FORCEINLINE __m256i avx2_load_thresh(const int threshold[4]) {
+  return _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)threshold));
+}
+
+// SAD of 4 4x4 blocks in parallel
+// return value is in sad, one quadword per block
+static AVS_FORCEINLINE void avx2_4x_sad16(__m256i ref0, __m256i ref1, __m256i ref2, __m256i ref3,
+  __m256i src0, __m256i src1, __m256i src2, __m256i src3, __m256i &sad)
+{
+  auto sad01 = _mm256_add_epi64(_mm256_sad_epu8(src0, ref0), _mm256_sad_epu8(src1, ref1));
+  auto sad23 = _mm256_add_epi64(_mm256_sad_epu8(src2, ref2), _mm256_sad_epu8(src3, ref3));
+  sad = _mm256_add_epi64(sad01, sad23);
+}
+
+// increments acc if rsad < threshold.
+// sad: sad input from prev. function sad16 (=sad4x4)
+// sad_acc: sad accumulator
+static AVS_FORCEINLINE void avx2_comp(__m256i &sad, __m256i &sad_acc, __m256i threshold)
+{
+  sad = _mm256_cmpgt_epi32(threshold, sad); // output mask, used in acc16
+  sad_acc = _mm256_sub_epi32(sad_acc, sad);
+
+  sad = _mm256_shuffle_epi32(sad, _MM_SHUFFLE(2, 2, 0, 0));
+}
+
+// fills mm4..mm7 with 4x 4 words
+static AVS_FORCEINLINE void avx2_4x_acc16(__m256i src0, __m256i src1, __m256i src2, __m256i src3, __m256i mask_by_sadcomp,
+  __m256i &mm4, __m256i &mm5, __m256i &mm6, __m256i &mm7)
+{
+  mm4 = _mm256_add_epi16(mm4, _mm256_and_si256(src0, mask_by_sadcomp));
+  mm5 = _mm256_add_epi16(mm5, _mm256_and_si256(src1, mask_by_sadcomp));
+  mm6 = _mm256_add_epi16(mm6, _mm256_and_si256(src2, mask_by_sadcomp));
+  mm7 = _mm256_add_epi16(mm7, _mm256_and_si256(src3, mask_by_sadcomp));
+}
+
+template <typename SrcPtr>
+static AVS_FORCEINLINE void avx2_4x_check(__m256i ref0, __m256i ref1, __m256i ref2, __m256i ref3, int offset, SrcPtr rdst, int rdp_aka_pitch,
+  __m256i &racc, __m256i threshold,
+  __m256i &mm4, __m256i &mm5, __m256i &mm6, __m256i &mm7)
+{
+  auto src0 = avx2_load_row16(rdst + offset);
+  auto src1 = avx2_load_row16(rdst + rdp_aka_pitch + offset);
+  auto src2 = avx2_load_row16(rdst + rdp_aka_pitch * 2 + offset);
+  auto src3 = avx2_load_row16(rdst + rdp_aka_pitch * 3 + offset);
+
+  __m256i sad;
+  avx2_4x_sad16(ref0, ref1, ref2, ref3, src0, src1, src2, src3, sad);
+  avx2_comp(sad, racc, threshold);
+  avx2_4x_acc16(src0, src1, src2, src3, sad, mm4, mm5, mm6, mm7);
+}
+
+template <typename SrcPtr>
+static AVS_FORCEINLINE void avx2_4x_acheck(__m256i ref0, __m256i ref1, __m256i ref2, __m256i ref3, int offset, SrcPtr rdst, int rdp_aka_pitch,
+  __m256i &racc, __m256i threshold,
+  __m256i &mm4, __m256i &mm5, __m256i &mm6, __m256i &mm7,
+  __m256i &edx_sad_summing)
+{
+  auto src0 = avx2_load_row16(rdst + offset);
+  auto src1 = avx2_load_row16(rdst + rdp_aka_pitch + offset);
+  auto src2 = avx2_load_row16(rdst + rdp_aka_pitch * 2 + offset);
+  auto src3 = avx2_load_row16(rdst + rdp_aka_pitch * 3 + offset);
+
+  __m256i sad;
+  avx2_4x_sad16(ref0, ref1, ref2, ref3, src0, src1, src2, src3, sad);
+  edx_sad_summing = _mm256_add_epi32(edx_sad_summing, sad);
+  avx2_comp(sad, racc, threshold);
+  avx2_4x_acc16(src0, src1, src2, src3, sad, mm4, mm5, mm6, mm7);
+}
+
+// 4 words of inv_table[weight_acc] per block
+static AVS_FORCEINLINE __m256i avx2_4x_weight_recip(__m256i weight_acc, const int* inv_table)
+{
+  alignas(32) int acc[8];
+  _mm256_store_si256((__m256i *)acc, weight_acc);
+
+  int w0 = inv_table[acc[0]];
+  int w1 = inv_table[acc[2]];
+  int w2 = inv_table[acc[4]];
+  int w3 = inv_table[acc[6]];
+
+  return _mm256_setr_epi16(w0, w0, w0, w0, w1, w1, w1, w1,
+                           w2, w2, w2, w2, w3, w3, w3, w3);
+}
+
+template <typename DstPtr>
+static AVS_FORCEINLINE void avx2_4x_stor4(DstPtr esi, __m256i mmA, __m256i mm0_multiplier)
+{
+  // ((((mm1 << 2) * multiplier) >> 16 ) + 1) >> 1
+  auto mm1 = _mm256_slli_epi16(mmA, 2);
+  mm1 = _mm256_mulhi_epu16(mm1, mm0_multiplier); // vpmulhuw, really unsigned
+  mm1 = _mm256_adds_epu16(mm1, _mm256_set1_epi16(1));
+  mm1 = _mm256_srli_epi16(mm1, 1);
+  auto packed = _mm_packus_epi16(_mm256_castsi256_si128(mm1), _mm256_extracti128_si256(mm1, 1)); // 16 words to 16 bytes
+  avx2_store_row16(esi, packed);
+}
+
+
+// Multipliers for the blending kernels.
+// unpacklo/unpackhi work inside the 128 bit lanes, so "lo" holds blocks 0 and 2, "hi" holds blocks 1 and 3.
+struct Avx2OverlapWeights {
+  __m256i recip_lo, recip_hi; // inv_table[weight_acc] + (1 << 16), for madd against (sum, 256)
+  __m256i lo16_lo, lo16_hi;   // lower 16 bit of the weights, as dwords
+  __m256i hi16;               // upper 16 bit of the weights, as words in block order
+};
+
+static AVS_FORCEINLINE Avx2OverlapWeights avx2_4x_overlap_weights(__m256i weight_acc, const int* inv_table, const int weight[4])
+{
+  alignas(32) int acc[8];
+  _mm256_store_si256((__m256i *)acc, weight_acc);
+
+  int r[4] = { inv_table[acc[0]] + (1 << 16), inv_table[acc[2]] + (1 << 16),
+               inv_table[acc[4]] + (1 << 16), inv_table[acc[6]] + (1 << 16) };
+  int lo[4] = { weight[0] & 0xFFFF, weight[1] & 0xFFFF, weight[2] & 0xFFFF, weight[3] & 0xFFFF };
+  short hi[4] = { (short)(weight[0] >> 16), (short)(weight[1] >> 16), (short)(weight[2] >> 16), (short)(weight[3] >> 16) };
+
+  Avx2OverlapWeights w;
+  w.recip_lo = _mm256_setr_epi32(r[0], r[0], r[0], r[0], r[2], r[2], r[2], r[2]);
+  w.recip_hi = _mm256_setr_epi32(r[1], r[1], r[1], r[1], r[3], r[3], r[3], r[3]);
+  w.lo16_lo = _mm256_setr_epi32(lo[0], lo[0], lo[0], lo[0], lo[2], lo[2], lo[2], lo[2]);
+  w.lo16_hi = _mm256_setr_epi32(lo[1], lo[1], lo[1], lo[1], lo[3], lo[3], lo[3], lo[3]);
+  w.hi16 = _mm256_setr_epi16(hi[0], hi[0], hi[0], hi[0], hi[1], hi[1], hi[1], hi[1],
+                             hi[2], hi[2], hi[2], hi[2], hi[3], hi[3], hi[3], hi[3]);
+  return w;
+}
+
+// scale the accumulated sums by inv_table[weight_acc] and weight_lo16
+static AVS_FORCEINLINE __m256i avx2_4x_scale(__m256i mmA, const Avx2OverlapWeights &w)
+{
+  auto mmA_lo = _mm256_unpacklo_epi16(mmA, _mm256_set1_epi16(256));
+  auto mmA_hi = _mm256_unpackhi_epi16(mmA, _mm256_set1_epi16(256));
+
+  // We do this instead of pmulhw in order to avoid a loss of precision,
+  // which would result in a green tint (lower pixel values).
+  mmA_lo = _mm256_madd_epi16(mmA_lo, w.recip_lo);
+  mmA_hi = _mm256_madd_epi16(mmA_hi, w.recip_hi);
+
+  mmA_lo = _mm256_srli_epi32(mmA_lo, 9);
+  mmA_hi = _mm256_srli_epi32(mmA_hi, 9);
+
+  mmA_lo = _mm256_mulhi_epi16(mmA_lo, w.lo16_lo);
+  mmA_hi = _mm256_mulhi_epi16(mmA_hi, w.lo16_hi);
+
+  // back to block order
+  return _mm256_packs_epi32(mmA_lo, mmA_hi);
+}
+
+// returns the blended words, mm3 gets the previous contents of esi as words
+static AVS_FORCEINLINE __m256i avx2_4x_blend(const uint8_t* esi, __m256i mmA, const Avx2OverlapWeights &w, __m256i &mm3)
+{
+  mm3 = avx2_load_row16(esi);
+  // tmp= ((esi << 6) * multiplier) >> 16  ( == [esi]/1024 * multiplier)
+  // mmA = (mmA + tmp + rounder_16) / 32
+  auto tmp = _mm256_slli_epi16(mm3, 6);
+  tmp = _mm256_mulhi_epi16(tmp, w.hi16); // vpmulhw, signed
+  mmA = _mm256_adds_epu16(avx2_4x_scale(mmA, w), tmp);
+  mmA = _mm256_adds_epu16(mmA, _mm256_set1_epi16(16));
+  return _mm256_srli_epi16(mmA, 5);
+}
+
+// keep: all ones in the dwords of the blocks which must not be modified
+static AVS_FORCEINLINE void avx2_4x_blend_store4(uint8_t* esi, __m256i mmA, const Avx2OverlapWeights &w, __m128i keep)
+{
+  __m256i mm3;
+  mmA = avx2_4x_blend(esi, mmA, w, mm3);
+
+  auto packed = _mm_packus_epi16(_mm256_castsi256_si128(mmA), _mm256_extracti128_si256(mmA, 1));
+  auto previous = _mm_loadu_si128((const __m128i *)esi);
+  _mm_storeu_si128((__m128i *)esi, _mm_blendv_epi8(packed, previous, keep));
+}
+
+// stores all four blocks, returns the SAD between the new and the previous contents (one quadword per block)
+static AVS_FORCEINLINE __m256i avx2_4x_blend_diff4(uint8_t* esi, __m256i mmA, const Avx2OverlapWeights &w)
+{
+  __m256i mm3;
+  mmA = avx2_4x_blend(esi, mmA, w, mm3);
+
+  auto packed = _mm_packus_epi16(_mm256_castsi256_si128(mmA), _mm256_extracti128_si256(mmA, 1));
+  _mm_storeu_si128((__m128i *)esi, packed);
+
+  return _mm256_sad_epu8(mmA, mm3); // unsaturated words, like the SSE2 version
+}
+
+
+// SrcPtr/DstPtr: uint8_t pointers, or Avx2UVPtr for the *_uv kernels
+template<int R, typename SrcPtr, typename DstPtr> // radius; 3 or 0 is used
+static AVS_FORCEINLINE void frcore_filter_b4r0or2or3_avx2(SrcPtr ptrr, int pitchr, SrcPtr ptra, int pitcha, DstPtr ptrb, int pitchb, int threshold[4], const int* inv_table)
+{
+  // convert to upper left corner of the radius
+  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(0, 0)
+
+  auto thresh = avx2_load_thresh(threshold);
+
+  auto weight_acc = _mm256_setzero_si256();
+
+  // reference pixels
+  auto ref0 = avx2_load_row16(ptrr);
+  auto ref1 = avx2_load_row16(ptrr + pitchr * 1);
+  auto ref2 = avx2_load_row16(ptrr + pitchr * 2);
+  auto ref3 = avx2_load_row16(ptrr + pitchr * 3);
+
+  // accumulators
+  // each collects 16 words (weighted sums)
+  // which will be finally scaled back and stored as 16 bytes
+  auto mm4 = _mm256_setzero_si256();
+  auto mm5 = _mm256_setzero_si256();
+  auto mm6 = _mm256_setzero_si256();
+  auto mm7 = _mm256_setzero_si256();
+
+  if constexpr (R >= 2)
+  {
+    if constexpr (R >= 3)
+    {
+      // -3 // top line of y= -3..+3
+      avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+      avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      ptra += pitcha; // next line
+    }
+
+    // -2
+    avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    if constexpr (R >= 3)
+    {
+      avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    }
+    ptra += pitcha; // next line
+
+    // -1
+    avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    if constexpr (R >= 3)
+    {
+      avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    }
+    ptra += pitcha; // next line
+  }
+
+  //; 0
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 2)
+  {
+    avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    if constexpr (R >= 3)
+    {
+      avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+      avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    }
+  }
+
+  if constexpr (R >= 2)
+  {
+
+    ptra += pitcha;
+
+    // +1
+    avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    if constexpr (R >= 3)
+    {
+      avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    }
+
+    ptra += pitcha;
+    // +2
+    avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+    avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+    avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+    if constexpr (R >= 3)
+    {
+      avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    }
+
+    if constexpr (R >= 3)
+    {
+      ptra += pitcha;
+      avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+      avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 0
+      avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 1
+      avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 2
+      avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7); // base - 3
+    }
+
+  }
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  // scale 4 - 7 by weight
+  auto weight_recip = avx2_4x_weight_recip(weight_acc, inv_table);
+
+  avx2_4x_stor4(ptrb + 0 * pitchb, mm4, weight_recip);
+  avx2_4x_stor4(ptrb + 1 * pitchb, mm5, weight_recip);
+  avx2_4x_stor4(ptrb + 2 * pitchb, mm6, weight_recip);
+  avx2_4x_stor4(ptrb + 3 * pitchb, mm7, weight_recip);
+}
+
+void frcore_filter_b4r3_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_avx2<3, const uint8_t*, uint8_t*>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_b4r2_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_avx2<2, const uint8_t*, uint8_t*>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_b4r0_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_avx2<0, const uint8_t*, uint8_t*>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+// R == 2 or 3
+template<int R, typename SrcPtr, typename DstPtr>
+static AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_avx2(SrcPtr ptrr, int pitchr, SrcPtr ptra, int pitcha, DstPtr ptrb, int pitchb, int threshold[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  // convert to upper left corner of the radius
+  ptra += -1 * pitcha - R; // cpln(-3, -1)
+
+  auto thresh = avx2_load_thresh(threshold);
+
+  auto weight_acc = _mm256_setzero_si256();
+
+  // reference pixels
+  auto ref0 = avx2_load_row16(ptrr);
+  auto ref1 = avx2_load_row16(ptrr + pitchr * 1);
+  auto ref2 = avx2_load_row16(ptrr + pitchr * 2);
+  auto ref3 = avx2_load_row16(ptrr + pitchr * 3);
+
+  // accumulators
+  auto mm4 = _mm256_setzero_si256();
+  auto mm5 = _mm256_setzero_si256();
+  auto mm6 = _mm256_setzero_si256();
+  auto mm7 = _mm256_setzero_si256();
+
+  auto edx_sad_summing = _mm256_setzero_si256();
+
+  // ; -1
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  ptra += pitcha; // next line
+
+  // ; 0
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  ptra += pitcha; // next line
+
+  // ; +1
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+  avx2_4x_acheck(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+
+  // Subtracting 1 because the comparison needs to be >=
+  auto sad_sum_gte_th2 = _mm256_cmpgt_epi32(edx_sad_summing, _mm256_set1_epi64x(sThresh2 - 1));
+
+  if (_mm256_movemask_epi8(sad_sum_gte_th2))
+  {
+    sad_sum_gte_th2 = _mm256_shuffle_epi32(sad_sum_gte_th2, _MM_SHUFFLE(2, 2, 0, 0));
+
+    auto weight_acc_saved = weight_acc;
+    auto mm4_saved = mm4;
+    auto mm5_saved = mm5;
+    auto mm6_saved = mm6;
+    auto mm7_saved = mm7;
+
+    // Expand the search for distances not covered in the first pass
+    ptra -= 3 * pitcha; // move to -2
+
+    // ; -2
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    ptra += pitcha; // next line
+
+    // ; -1
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    ptra += pitcha; // next line
+
+    // ; 0
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    ptra += pitcha; // next line
+
+    // ; +1
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    ptra += pitcha; // next line
+
+    // ; +2
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+    avx2_4x_acheck(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7, edx_sad_summing);
+
+    weight_acc = _mm256_and_si256(weight_acc, sad_sum_gte_th2);
+    mm4 = _mm256_and_si256(mm4, sad_sum_gte_th2);
+    mm5 = _mm256_and_si256(mm5, sad_sum_gte_th2);
+    mm6 = _mm256_and_si256(mm6, sad_sum_gte_th2);
+    mm7 = _mm256_and_si256(mm7, sad_sum_gte_th2);
+    edx_sad_summing = _mm256_and_si256(edx_sad_summing, sad_sum_gte_th2);
+
+    // flip all the bits instead of using pandn five times
+    sad_sum_gte_th2 = _mm256_xor_si256(sad_sum_gte_th2, _mm256_set1_epi8(-1));
+
+    weight_acc_saved = _mm256_and_si256(weight_acc_saved, sad_sum_gte_th2);
+    mm4_saved = _mm256_and_si256(mm4_saved, sad_sum_gte_th2);
+    mm5_saved = _mm256_and_si256(mm5_saved, sad_sum_gte_th2);
+    mm6_saved = _mm256_and_si256(mm6_saved, sad_sum_gte_th2);
+    mm7_saved = _mm256_and_si256(mm7_saved, sad_sum_gte_th2);
+
+    weight_acc = _mm256_or_si256(weight_acc, weight_acc_saved);
+    mm4 = _mm256_or_si256(mm4, mm4_saved);
+    mm5 = _mm256_or_si256(mm5, mm5_saved);
+    mm6 = _mm256_or_si256(mm6, mm6_saved);
+    mm7 = _mm256_or_si256(mm7, mm7_saved);
+    // edx_sad_summing is okay with just the irrelevant quadwords zeroed out
+
+    if constexpr (R >= 3) {
+      // Subtracting 1 because the comparison needs to be >=
+      auto sad_sum_gte_th3 = _mm256_cmpgt_epi32(edx_sad_summing, _mm256_set1_epi64x(sThresh3 - 1));
+
+      if (_mm256_movemask_epi8(sad_sum_gte_th3))
+      {
+        sad_sum_gte_th3 = _mm256_shuffle_epi32(sad_sum_gte_th3, _MM_SHUFFLE(2, 2, 0, 0));
+
+        weight_acc_saved = weight_acc;
+        mm4_saved = mm4;
+        mm5_saved = mm5;
+        mm6_saved = mm6;
+        mm7_saved = mm7;
+
+        // Expand the search for distances not covered in the first-second pass
+        ptra -= 5 * pitcha; // move to -3
+
+        // ; -3
+        avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        ptra += pitcha; // next line
+
+        // ; -2
+        avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        ptra += pitcha; // next line
+
+        // ; -1
+        avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        ptra += pitcha; // next line
+
+        // ; 0
+        avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        ptra += pitcha; // next line
+
+        // ; +1
+        avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        ptra += pitcha; // next line
+
+        // ; +2
+        avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        ptra += pitcha; // next line
+
+        // ; +3
+        avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+        avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+
+        weight_acc = _mm256_and_si256(weight_acc, sad_sum_gte_th3);
+        mm4 = _mm256_and_si256(mm4, sad_sum_gte_th3);
+        mm5 = _mm256_and_si256(mm5, sad_sum_gte_th3);
+        mm6 = _mm256_and_si256(mm6, sad_sum_gte_th3);
+        mm7 = _mm256_and_si256(mm7, sad_sum_gte_th3);
+
+        // flip all the bits instead of using pandn five times
+        sad_sum_gte_th3 = _mm256_xor_si256(sad_sum_gte_th3, _mm256_set1_epi8(-1));
+
+        weight_acc_saved = _mm256_and_si256(weight_acc_saved, sad_sum_gte_th3);
+        mm4_saved = _mm256_and_si256(mm4_saved, sad_sum_gte_th3);
+        mm5_saved = _mm256_and_si256(mm5_saved, sad_sum_gte_th3);
+        mm6_saved = _mm256_and_si256(mm6_saved, sad_sum_gte_th3);
+        mm7_saved = _mm256_and_si256(mm7_saved, sad_sum_gte_th3);
+
+        weight_acc = _mm256_or_si256(weight_acc, weight_acc_saved);
+        mm4 = _mm256_or_si256(mm4, mm4_saved);
+        mm5 = _mm256_or_si256(mm5, mm5_saved);
+        mm6 = _mm256_or_si256(mm6, mm6_saved);
+        mm7 = _mm256_or_si256(mm7, mm7_saved);
+      }
+    }
+  }
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  auto weight_recip = avx2_4x_weight_recip(weight_acc, inv_table);
+
+  avx2_4x_stor4(ptrb + 0 * pitchb, mm4, weight_recip);
+  avx2_4x_stor4(ptrb + 1 * pitchb, mm5, weight_recip);
+  avx2_4x_stor4(ptrb + 2 * pitchb, mm6, weight_recip);
+  avx2_4x_stor4(ptrb + 3 * pitchb, mm7, weight_recip);
+}
+
+void frcore_filter_adapt_b4r3_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_avx2<3, const uint8_t*, uint8_t*>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_b4r2_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_avx2<2, const uint8_t*, uint8_t*>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_uv_b4r3_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_avx2<3, Avx2UVPtr<const uint8_t>, Avx2UVPtr<uint8_t>>({ ptrr_u, ptrr_v }, pitchr, { ptra_u, ptra_v }, pitcha, { ptrb_u, ptrb_v }, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_uv_b4r2_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_avx2<2, Avx2UVPtr<const uint8_t>, Avx2UVPtr<uint8_t>>({ ptrr_u, ptrr_v }, pitchr, { ptra_u, ptra_v }, pitcha, { ptrb_u, ptrb_v }, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_adapt_uv_b4r3_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_avx2<3, Avx2UVPtr<const uint8_t>, Avx2UVPtr<uint8_t>>({ ptrr_u, ptrr_v }, pitchr, { ptra_u, ptra_v }, pitcha, { ptrb_u, ptrb_v }, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_uv_b4r2_avx2(const uint8_t* ptrr_u, const uint8_t* ptrr_v, int pitchr, const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, uint8_t* ptrb_u, uint8_t* ptrb_v, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_avx2<2, Avx2UVPtr<const uint8_t>, Avx2UVPtr<uint8_t>>({ ptrr_u, ptrr_v }, pitchr, { ptra_u, ptra_v }, pitcha, { ptrb_u, ptrb_v }, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+// used in mode_temporal and adaptive overlapping
+// R is 2 or 3
+template<int R>
+static AVS_FORCEINLINE void frcore_filter_overlap_b4r2or3_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[4], const int* inv_table, int weight[4], int process_blocks[4])
+{
+  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(-2, -2)
+
+  auto thresh = avx2_load_thresh(threshold);
+
+  auto weight_acc = _mm256_setzero_si256();
+
+  // reference pixels
+  auto ref0 = avx2_load_row16(ptrr);
+  auto ref1 = avx2_load_row16(ptrr + pitchr * 1);
+  auto ref2 = avx2_load_row16(ptrr + pitchr * 2);
+  auto ref3 = avx2_load_row16(ptrr + pitchr * 3);
+
+  // accumulators
+  auto mm4 = _mm256_setzero_si256();
+  auto mm5 = _mm256_setzero_si256();
+  auto mm6 = _mm256_setzero_si256();
+  auto mm7 = _mm256_setzero_si256();
+
+  if constexpr (R >= 3)
+  {
+    // -3 // top line of y= -3..+3
+    avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    ptra += pitcha; // next line
+  }
+  // -2
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+  ptra += pitcha; // next line
+
+  // -1
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+  ptra += pitcha; // next line
+
+  //; 0
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+  ptra += pitcha;
+
+  // +1
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+
+  ptra += pitcha;
+  // +2
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  if constexpr (R >= 3)
+  {
+    avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+
+  if constexpr (R >= 3)
+  {
+    ptra += pitcha;
+    avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 3, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 4, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 5, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+    avx2_4x_check(ref0, ref1, ref2, ref3, 6, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  }
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  // each block has its own weight, see get_weight
+  // lower 16 and upper 16 bit has separate meaning
+  auto weights = avx2_4x_overlap_weights(weight_acc, inv_table, weight);
+
+  auto keep = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)process_blocks), _mm_setzero_si128());
+
+  avx2_4x_blend_store4(ptrb + 0 * pitchb, mm4, weights, keep);
+  avx2_4x_blend_store4(ptrb + 1 * pitchb, mm5, weights, keep);
+  avx2_4x_blend_store4(ptrb + 2 * pitchb, mm6, weights, keep);
+  avx2_4x_blend_store4(ptrb + 3 * pitchb, mm7, weights, keep);
+}
+
+void frcore_filter_overlap_b4r3_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4])
+{
+  frcore_filter_overlap_b4r2or3_avx2<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_b4r2_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4])
+{
+  frcore_filter_overlap_b4r2or3_avx2<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_diff_b4r1_avx2(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[4], const int* inv_table, int weight[4])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  auto thresh = avx2_load_thresh(threshold);
+
+  auto weight_acc = _mm256_setzero_si256();
+
+  // reference pixels
+  auto ref0 = avx2_load_row16(ptrr);
+  auto ref1 = avx2_load_row16(ptrr + pitchr * 1);
+  auto ref2 = avx2_load_row16(ptrr + pitchr * 2);
+  auto ref3 = avx2_load_row16(ptrr + pitchr * 3);
+
+  // accumulators
+  auto mm4 = _mm256_setzero_si256();
+  auto mm5 = _mm256_setzero_si256();
+  auto mm6 = _mm256_setzero_si256();
+  auto mm7 = _mm256_setzero_si256();
+
+  // -1
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  ptra += pitcha; // next line
+
+  // 0
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  ptra += pitcha; // next line
+
+  // +1
+  avx2_4x_check(ref0, ref1, ref2, ref3, 0, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 1, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+  avx2_4x_check(ref0, ref1, ref2, ref3, 2, ptra, pitcha, weight_acc, thresh, mm4, mm5, mm6, mm7);
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  // only the first weight is used, like in the other versions
+  int prev_weight[4] = { weight[0], weight[0], weight[0], weight[0] };
+  auto weights = avx2_4x_overlap_weights(weight_acc, inv_table, prev_weight);
+
+  // outputs are SAD against the previous contents of ptrb
+  auto sads = avx2_4x_blend_diff4(ptrb + 0 * pitchb, mm4, weights);
+  sads = _mm256_add_epi16(sads, avx2_4x_blend_diff4(ptrb + 1 * pitchb, mm5, weights));
+  sads = _mm256_add_epi16(sads, avx2_4x_blend_diff4(ptrb + 2 * pitchb, mm6, weights));
+  sads = _mm256_add_epi16(sads, avx2_4x_blend_diff4(ptrb + 3 * pitchb, mm7, weights));
+  sads = _mm256_srli_epi16(sads, 4);
+
+  weight[0] = _mm256_extract_epi16(sads, 0);
+  weight[1] = _mm256_extract_epi16(sads, 4);
+  weight[2] = _mm256_extract_epi16(sads, 8);
+  weight[3] = _mm256_extract_epi16(sads, 12);
+}
+
+template <typename SrcPtr>
+static AVS_FORCEINLINE void frcore_dev_4x_b4_avx2(SrcPtr ptra, int pitcha, int dev[4])
+{
+  ptra += - 1; // cpln(-1, 0).ptr;
+
+  // reference pixels
+  auto ref0 = avx2_load_row16(ptra + 1);
+  auto ref1 = avx2_load_row16(ptra + pitcha * 1 + 1);
+  auto ref2 = avx2_load_row16(ptra + pitcha * 2 + 1);
+  auto ref3 = avx2_load_row16(ptra + pitcha * 3 + 1);
+
+  ptra += pitcha;
+
+  __m256i sad1;
+  avx2_4x_sad16(ref0, ref1, ref2, ref3,
+                avx2_load_row16(ptra), avx2_load_row16(ptra + pitcha), avx2_load_row16(ptra + pitcha * 2), avx2_load_row16(ptra + pitcha * 3),
+                sad1);
+
+  __m256i sad2;
+  avx2_4x_sad16(ref0, ref1, ref2, ref3,
+                avx2_load_row16(ptra + 2), avx2_load_row16(ptra + pitcha + 2), avx2_load_row16(ptra + pitcha * 2 + 2), avx2_load_row16(ptra + pitcha * 3 + 2),
+                sad2);
+
+  alignas(32) int devs[8];
+  _mm256_store_si256((__m256i *)devs, _mm256_min_epi32(sad1, sad2));
+
+  dev[0] = devs[0];
+  dev[1] = devs[2];
+  dev[2] = devs[4];
+  dev[3] = devs[6];
+}
+
+void frcore_dev_4x_b4_avx2(const uint8_t* ptra, int pitcha, int dev[4])
+{
+  frcore_dev_4x_b4_avx2<const uint8_t*>(ptra, pitcha, dev);
+}
+
+void frcore_dev_uv_b4_avx2(const uint8_t* ptra_u, const uint8_t* ptra_v, int pitcha, int dev[4])
+{
+  frcore_dev_4x_b4_avx2<Avx2UVPtr<const uint8_t>>({ ptra_u, ptra_v }, pitcha, dev);
+}
+
+void frcore_sad_4x_b4_avx2(const uint8_t* ptra, int pitcha, const uint8_t* ptrb, int pitchb, int sad[4])
+{
+  __m256i sad1;
+  avx2_4x_sad16(avx2_load_row16(ptra), avx2_load_row16(ptra + pitcha), avx2_load_row16(ptra + pitcha * 2), avx2_load_row16(ptra + pitcha * 3),
+                avx2_load_row16(ptrb), avx2_load_row16(ptrb + pitchb), avx2_load_row16(ptrb + pitchb * 2), avx2_load_row16(ptrb + pitchb * 3),
+                sad1);
+
+  alignas(32) int sads[8];
+  _mm256_store_si256((__m256i *)sads, sad1);
+
+  sad[0] = sads[0];
+  sad[1] = sads[2];
+  sad[2] = sads[4];
+  sad[3] = sads[6];
+}
+
+
+// 9 to 16 bit kernels, see frfun7_u16.cpp.
+// One row of the four blocks is a ymm register. As in the 8 bit kernels the unpacks stay inside
+// the 128 bit lanes: the low dword sums of a row hold blocks 0 and 2, the high ones blocks 1 and 3,
+// which vpackusdw puts back in order.
+
+static AVS_FORCEINLINE __m256i avx2_16_load(const uint16_t* ptr) {
+  return _mm256_loadu_si256((const __m256i *)ptr);
+}
+
+static AVS_FORCEINLINE void avx2_16_store(uint16_t* ptr, __m256i value) {
+  _mm256_storeu_si256((__m256i *)ptr, value);
+}
+
+static AVS_FORCEINLINE void avx2_16_load_rows(const uint16_t* ptr, int pitch, __m256i rows[4]) {
+  for (int y = 0; y < 4; y++)
+    rows[y] = avx2_16_load(ptr + pitch * y);
+}
+
+// SAD of four 4x4 blocks, in the low dword of each quadword
+static AVS_FORCEINLINE __m256i avx2_16_4x_sad16(const __m256i ref[4], const __m256i src[4])
+{
+  auto sign = _mm256_set1_epi16(-32768);
+  auto ones = _mm256_set1_epi16(1);
+
+  auto sad = _mm256_setzero_si256();
+
+  for (int y = 0; y < 4; y++) {
+    auto diff = _mm256_or_si256(_mm256_subs_epu16(ref[y], src[y]), _mm256_subs_epu16(src[y], ref[y]));
+    // vpmaddwd is signed, each dword is 2 * 32768 too low
+    sad = _mm256_add_epi32(sad, _mm256_madd_epi16(_mm256_xor_si256(diff, sign), ones));
+  }
+
+  sad = _mm256_add_epi32(sad, _mm256_srli_epi64(sad, 32));
+
+  return _mm256_add_epi32(sad, _mm256_set1_epi32(4 * 4 * 32768));
+}
+
+// process: all ones in the low dword of the quadwords of the blocks to check
+template <bool sum_sads = false>
+static AVS_FORCEINLINE void avx2_16_4x_check(const __m256i ref[4], const uint16_t* rdst, int rdp_aka_pitch, __m256i &racc, __m256i threshold, __m256i acc[8], __m256i process, __m256i* sad_sum = nullptr)
+{
+  __m256i src[4];
+  avx2_16_load_rows(rdst, rdp_aka_pitch, src);
+
+  auto sad = avx2_16_4x_sad16(ref, src);
+
+  if constexpr (sum_sads)
+    *sad_sum = _mm256_add_epi32(*sad_sum, sad);
+
+  auto mask = _mm256_and_si256(_mm256_cmpgt_epi32(threshold, sad), process);
+  racc = _mm256_sub_epi32(racc, mask);
+  mask = _mm256_shuffle_epi32(mask, _MM_SHUFFLE(2, 2, 0, 0));
+
+  auto zero = _mm256_setzero_si256();
+
+  for (int y = 0; y < 4; y++) {
+    auto pixels = _mm256_and_si256(src[y], mask);
+    acc[y * 2] = _mm256_add_epi32(acc[y * 2], _mm256_unpacklo_epi16(pixels, zero));
+    acc[y * 2 + 1] = _mm256_add_epi32(acc[y * 2 + 1], _mm256_unpackhi_epi16(pixels, zero));
+  }
+}
+
+// (acc * multiplier + rounder) >> shift for eight unsigned dwords, the products are 64 bit
+template <int shift>
+static AVS_FORCEINLINE __m256i avx2_16_scale(__m256i acc, __m256i multiplier, __m256i rounder)
+{
+  auto even = _mm256_srli_epi64(_mm256_add_epi64(_mm256_mul_epu32(acc, multiplier), rounder), shift);
+  auto odd = _mm256_srli_epi64(_mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(acc, 32), multiplier), rounder), shift);
+  return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+}
+
+// the match counters of the four blocks
+static AVS_FORCEINLINE void avx2_16_counts(__m256i weight_acc, int count[4])
+{
+  alignas(32) int acc[8];
+  _mm256_store_si256((__m256i *)acc, weight_acc);
+
+  for (int i = 0; i < 4; i++)
+    count[i] = acc[i * 2];
+}
+
+static AVS_FORCEINLINE void avx2_16_4x_store(uint16_t* ptrb, int pitchb, __m256i weight_acc, const __m256i acc[8], const int* inv_table)
+{
+  int count[4];
+  avx2_16_counts(weight_acc, count);
+
+  // blocks 0 and 2, blocks 1 and 3
+  auto weight_recip02 = _mm256_setr_epi32(inv_table[count[0]], 0, inv_table[count[0]], 0, inv_table[count[2]], 0, inv_table[count[2]], 0);
+  auto weight_recip13 = _mm256_setr_epi32(inv_table[count[1]], 0, inv_table[count[1]], 0, inv_table[count[3]], 0, inv_table[count[3]], 0);
+  auto rounder = _mm256_set1_epi64x(1 << 29);
+
+  for (int y = 0; y < 4; y++) {
+    auto lo = avx2_16_scale<30>(acc[y * 2], weight_recip02, rounder);
+    auto hi = avx2_16_scale<30>(acc[y * 2 + 1], weight_recip13, rounder);
+    avx2_16_store(ptrb + pitchb * y, _mm256_packus_epi32(lo, hi));
+  }
+}
+
+// see scalar16_2x_blend
+// All four blocks are computed, those not in process_blocks keep their old pixels.
+// diff: the SADs between the old and the new pixels, in the low dword of each quadword
+template <bool want_diff = false>
+static AVS_FORCEINLINE void avx2_16_4x_blend(uint16_t* ptrb, int pitchb, __m256i weight_acc, const __m256i acc[8], const int* inv_table, const int weight[4], const int process_blocks[4], __m256i* diff = nullptr)
+{
+  int count[4];
+  avx2_16_counts(weight_acc, count);
+
+  int recip[4];
+  for (int i = 0; i < 4; i++)
+    recip[i] = (int)(((int64_t)inv_table[count[i]] * (weight[i] & 0xFFFF) + (1 << 13)) >> 14);
+
+  auto weight_recip02 = _mm256_setr_epi32(recip[0], 0, recip[0], 0, recip[2], 0, recip[2], 0);
+  auto weight_recip13 = _mm256_setr_epi32(recip[1], 0, recip[1], 0, recip[3], 0, recip[3], 0);
+
+  auto weight_hi16 = _mm256_setr_epi64x(0x0001000100010001ll * (weight[0] >> 16), 0x0001000100010001ll * (weight[1] >> 16),
+                                        0x0001000100010001ll * (weight[2] >> 16), 0x0001000100010001ll * (weight[3] >> 16));
+  auto keep = _mm256_setr_epi64x(process_blocks[0] ? 0 : -1, process_blocks[1] ? 0 : -1,
+                                 process_blocks[2] ? 0 : -1, process_blocks[3] ? 0 : -1);
+
+  auto rounder = _mm256_set1_epi64x(1 << 25);
+  auto rounder_sixteen = _mm256_set1_epi32(16);
+
+  __m256i old[4], result[4];
+
+  for (int y = 0; y < 4; y++) {
+    old[y] = avx2_16_load(ptrb + pitchb * y);
+
+    auto lo = avx2_16_scale<26>(acc[y * 2], weight_recip02, rounder);
+    auto hi = avx2_16_scale<26>(acc[y * 2 + 1], weight_recip13, rounder);
+
+    // (old * weight_hi16) >> 10
+    auto product_lo = _mm256_mullo_epi16(old[y], weight_hi16);
+    auto product_hi = _mm256_mulhi_epu16(old[y], weight_hi16);
+    lo = _mm256_add_epi32(lo, _mm256_srli_epi32(_mm256_unpacklo_epi16(product_lo, product_hi), 10));
+    hi = _mm256_add_epi32(hi, _mm256_srli_epi32(_mm256_unpackhi_epi16(product_lo, product_hi), 10));
+
+    lo = _mm256_srli_epi32(_mm256_add_epi32(lo, rounder_sixteen), 5);
+    hi = _mm256_srli_epi32(_mm256_add_epi32(hi, rounder_sixteen), 5);
+
+    result[y] = _mm256_blendv_epi8(_mm256_packus_epi32(lo, hi), old[y], keep);
+
+    avx2_16_store(ptrb + pitchb * y, result[y]);
+  }
+
+  if constexpr (want_diff)
+    *diff = avx2_16_4x_sad16(old, result);
+}
+
+static AVS_FORCEINLINE void avx2_16_zero(__m256i acc[8])
+{
+  for (int i = 0; i < 8; i++)
+    acc[i] = _mm256_setzero_si256();
+}
+
+template<int R> // radius; 3, 2 or 0
+static void frcore_filter_u16_b4r0or2or3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[4], const int* inv_table)
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = avx2_load_thresh(threshold);
+  auto all = _mm256_set1_epi32(-1);
+
+  __m256i ref[4];
+  avx2_16_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256i acc[8];
+  avx2_16_zero(acc);
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      avx2_16_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  avx2_16_4x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_u16_b4r0_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_avx2<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_u16_b4r2_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_avx2<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_u16_b4r3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_avx2<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+// the ring of the displacement (dx, dy) around the center (R, R) of the search window
+template <int R>
+static constexpr int avx2_16_ring(int dx, int dy)
+{
+  int ax = dx < R ? R - dx : dx - R;
+  int ay = dy < R ? R - dy : dy - R;
+  return ax > ay ? ax : ay;
+}
+
+template<int R>
+static void frcore_filter_adapt_u16_b4r2or3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  ptra += -R * pitcha + 3 - 2 * R; // cpln(3 - 2 * R, -R)
+
+  auto thresh = avx2_load_thresh(threshold);
+
+  __m256i ref[4];
+  avx2_16_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256i acc[8];
+  avx2_16_zero(acc);
+
+  auto sad_sum = _mm256_setzero_si256();
+  auto process = _mm256_set1_epi32(-1);
+
+  for (int dy = R - 1; dy <= R + 1; dy++)
+    for (int dx = R - 1; dx <= R + 1; dx++)
+      avx2_16_4x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+  // sad_sum >= sThresh2, only the low dwords count
+  auto low_dwords = _mm256_set1_epi64x(0xFFFFFFFF);
+  process = _mm256_and_si256(_mm256_cmpgt_epi32(sad_sum, _mm256_set1_epi32(sThresh2 - 1)), low_dwords);
+
+  if (!_mm256_testz_si256(process, process)) {
+    for (int dy = R - 2; dy <= R + 2; dy++)
+      for (int dx = R - 2; dx <= R + 2; dx++)
+        if (avx2_16_ring<R>(dx, dy) == 2)
+          avx2_16_4x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+    process = _mm256_and_si256(process, _mm256_cmpgt_epi32(sad_sum, _mm256_set1_epi32(sThresh3 - 1)));
+
+    if (R >= 3 && !_mm256_testz_si256(process, process)) {
+      for (int dy = 0; dy <= 2 * R; dy++)
+        for (int dx = 0; dx <= 2 * R; dx++)
+          if (avx2_16_ring<R>(dx, dy) == 3)
+            avx2_16_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process);
+    }
+  }
+
+  avx2_16_4x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_adapt_u16_b4r2_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_u16_b4r2or3_avx2<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_u16_b4r3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_u16_b4r2or3_avx2<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+template<int R>
+static void frcore_filter_overlap_u16_b4r2or3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[4], const int* inv_table, int weight[4], int process_blocks[4])
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = avx2_load_thresh(threshold);
+  auto all = _mm256_set1_epi32(-1);
+
+  __m256i ref[4];
+  avx2_16_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256i acc[8];
+  avx2_16_zero(acc);
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      avx2_16_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  avx2_16_4x_blend(ptrb, pitchb, weight_acc, acc, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_u16_b4r2_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4])
+{
+  frcore_filter_overlap_u16_b4r2or3_avx2<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_u16_b4r3_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[4], const int* inv_table, int weight[4], int process_blocks[4])
+{
+  frcore_filter_overlap_u16_b4r2or3_avx2<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_diff_u16_b4r1_avx2(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[4], const int* inv_table, int weight[4])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  auto thresh = avx2_load_thresh(threshold);
+  auto all = _mm256_set1_epi32(-1);
+
+  __m256i ref[4];
+  avx2_16_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256i acc[8];
+  avx2_16_zero(acc);
+
+  for (int dy = 0; dy <= 2; dy++)
+    for (int dx = 0; dx <= 2; dx++)
+      avx2_16_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  // only the first weight is used, like in the other versions
+  int prev_weight[4] = { weight[0], weight[0], weight[0], weight[0] };
+  int process_blocks[4] = { 1, 1, 1, 1 };
+  __m256i diff;
+
+  avx2_16_4x_blend<true>(ptrb, pitchb, weight_acc, acc, inv_table, prev_weight, process_blocks, &diff);
+
+  alignas(32) int sads[8];
+  _mm256_store_si256((__m256i *)sads, _mm256_srli_epi32(diff, 4));
+
+  for (int i = 0; i < 4; i++)
+    weight[i] = sads[i * 2];
+}
+
+void frcore_dev_u16_4x_b4_avx2(const uint16_t* ptra, int pitcha, int dev[4])
+{
+  __m256i ref[4], src1[4], src2[4];
+
+  avx2_16_load_rows(ptra, pitcha, ref);
+  avx2_16_load_rows(ptra + pitcha - 1, pitcha, src1);
+  avx2_16_load_rows(ptra + pitcha + 1, pitcha, src2);
+
+  alignas(32) int devs[8];
+  _mm256_store_si256((__m256i *)devs, _mm256_min_epi32(avx2_16_4x_sad16(ref, src1), avx2_16_4x_sad16(ref, src2)));
+
+  for (int i = 0; i < 4; i++)
+    dev[i] = devs[i * 2];
+}
+
+void frcore_sad_u16_4x_b4_avx2(const uint16_t* ptra, int pitcha, const uint16_t* ptrb, int pitchb, int sad[4])
+{
+  __m256i ref[4], src[4];
+
+  avx2_16_load_rows(ptra, pitcha, ref);
+  avx2_16_load_rows(ptrb, pitchb, src);
+
+  alignas(32) int sads[8];
+  _mm256_store_si256((__m256i *)sads, avx2_16_4x_sad16(ref, src));
+
+  for (int i = 0; i < 4; i++)
+    sad[i] = sads[i * 2];
+}
+
+
+// Float kernels, see frfun7_float.cpp.
+// A ymm register holds one row of two blocks, so a row of the four blocks takes two:
+// blocks 0 and 1, and blocks 2 and 3. The horizontal additions stay inside the 128 bit lanes
+// and leave the SADs in the order 0, 2, 0, 2, 1, 3, 1, 3. The match counters and thresholds
+// use the same order.
+
+static AVS_FORCEINLINE void avx2_f_load_rows(const float* ptr, int pitch, __m256 rows[8]) {
+  for (int i = 0; i < 2; i++)
+    for (int y = 0; y < 4; y++)
+      rows[i * 4 + y] = _mm256_loadu_ps(ptr + 8 * i + pitch * y);
+}
+
+// SAD of four 4x4 blocks, in the order above
+static AVS_FORCEINLINE __m256 avx2_f_4x_sad16(const __m256 ref[8], const __m256 src[8])
+{
+  auto sign = _mm256_set1_ps(-0.0f);
+
+  __m256 sad[2];
+
+  for (int i = 0; i < 2; i++) {
+    sad[i] = _mm256_setzero_ps();
+    for (int y = 0; y < 4; y++)
+      sad[i] = _mm256_add_ps(sad[i], _mm256_andnot_ps(sign, _mm256_sub_ps(src[i * 4 + y], ref[i * 4 + y])));
+  }
+
+  // column 0 + column 2 and column 1 + column 3, then their sums
+  auto sums = _mm256_add_ps(_mm256_unpacklo_ps(sad[0], sad[1]), _mm256_unpackhi_ps(sad[0], sad[1]));
+
+  return _mm256_add_ps(sums, _mm256_permute_ps(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// one value per block, in the order of avx2_f_4x_sad16
+static AVS_FORCEINLINE __m256 avx2_f_load_thresh(const float threshold[4])
+{
+  return _mm256_setr_ps(threshold[0], threshold[2], threshold[0], threshold[2], threshold[1], threshold[3], threshold[1], threshold[3]);
+}
+
+// see scalarf_2x_check
+// process: all ones for the blocks to check
+template <bool sum_sads = false>
+static AVS_FORCEINLINE void avx2_f_4x_check(const __m256 ref[8], const float* rdst, int rdp_aka_pitch, __m256i &racc, __m256 threshold, __m256 acc[8], __m256 process, __m256* sad_sum = nullptr)
+{
+  __m256 src[8];
+  avx2_f_load_rows(rdst, rdp_aka_pitch, src);
+
+  auto sad = avx2_f_4x_sad16(ref, src);
+
+  if constexpr (sum_sads)
+    *sad_sum = _mm256_add_ps(*sad_sum, sad);
+
+  auto mask = _mm256_and_ps(_mm256_cmp_ps(sad, threshold, _CMP_LT_OQ), process);
+  racc = _mm256_sub_epi32(racc, _mm256_castps_si256(mask));
+
+  // blocks 0 and 1, blocks 2 and 3
+  auto mask01 = _mm256_permute_ps(mask, _MM_SHUFFLE(0, 0, 0, 0));
+  auto mask23 = _mm256_permute_ps(mask, _MM_SHUFFLE(1, 1, 1, 1));
+
+  for (int y = 0; y < 4; y++) {
+    acc[y] = _mm256_add_ps(acc[y], _mm256_and_ps(src[y], mask01));
+    acc[4 + y] = _mm256_add_ps(acc[4 + y], _mm256_and_ps(src[4 + y], mask23));
+  }
+}
+
+// the match counters of the four blocks
+static AVS_FORCEINLINE void avx2_f_counts(__m256i weight_acc, int count[4])
+{
+  alignas(32) int acc[8];
+  _mm256_store_si256((__m256i *)acc, weight_acc);
+
+  count[0] = acc[0];
+  count[1] = acc[4];
+  count[2] = acc[1];
+  count[3] = acc[5];
+}
+
+static AVS_FORCEINLINE void avx2_f_4x_store(float* ptrb, int pitchb, __m256i weight_acc, const __m256 acc[8], const float* inv_table)
+{
+  int count[4];
+  avx2_f_counts(weight_acc, count);
+
+  __m256 weight_recip[2] = {
+    _mm256_setr_m128(_mm_set1_ps(inv_table[count[0]]), _mm_set1_ps(inv_table[count[1]])),
+    _mm256_setr_m128(_mm_set1_ps(inv_table[count[2]]), _mm_set1_ps(inv_table[count[3]]))
+  };
+
+  for (int i = 0; i < 2; i++)
+    for (int y = 0; y < 4; y++)
+      _mm256_storeu_ps(ptrb + 8 * i + pitchb * y, _mm256_mul_ps(acc[i * 4 + y], weight_recip[i]));
+}
+
+// see scalarf_2x_blend
+// All four blocks are computed, those not in process_blocks keep their old pixels.
+// diff: the SADs between the old and the new pixels, in the order of avx2_f_4x_sad16
+template <bool want_diff = false>
+static AVS_FORCEINLINE void avx2_f_4x_blend(float* ptrb, int pitchb, __m256i weight_acc, const __m256 acc[8], const float* inv_table, const float weight[4], const int process_blocks[4], __m256* diff = nullptr)
+{
+  int count[4];
+  avx2_f_counts(weight_acc, count);
+
+  __m256 old[8], result[8];
+
+  for (int i = 0; i < 2; i++) {
+    int b0 = i * 2, b1 = i * 2 + 1;
+
+    auto weight_recip = _mm256_setr_m128(_mm_set1_ps(inv_table[count[b0]]), _mm_set1_ps(inv_table[count[b1]]));
+    auto total_recip = _mm256_setr_m128(_mm_set1_ps(inv_table[(int)weight[b0] + 1]), _mm_set1_ps(inv_table[(int)weight[b1] + 1]));
+    auto old_weight = _mm256_setr_m128(_mm_set1_ps(weight[b0]), _mm_set1_ps(weight[b1]));
+    auto keep = _mm256_castsi256_ps(_mm256_setr_m128i(_mm_set1_epi32(process_blocks[b0] ? 0 : -1), _mm_set1_epi32(process_blocks[b1] ? 0 : -1)));
+
+    for (int y = 0; y < 4; y++) {
+      old[i * 4 + y] = _mm256_loadu_ps(ptrb + 8 * i + pitchb * y);
+
+      auto average = _mm256_mul_ps(acc[i * 4 + y], weight_recip);
+      auto blended = _mm256_mul_ps(_mm256_add_ps(average, _mm256_mul_ps(old[i * 4 + y], old_weight)), total_recip);
+      result[i * 4 + y] = _mm256_blendv_ps(blended, old[i * 4 + y], keep);
+
+      _mm256_storeu_ps(ptrb + 8 * i + pitchb * y, result[i * 4 + y]);
+    }
+  }
+
+  if constexpr (want_diff)
+    *diff = avx2_f_4x_sad16(old, result);
+}
+
+static AVS_FORCEINLINE void avx2_f_zero(__m256 acc[8])
+{
+  for (int i = 0; i < 8; i++)
+    acc[i] = _mm256_setzero_ps();
+}
+
+// the SADs of the four blocks, from the order of avx2_f_4x_sad16
+static AVS_FORCEINLINE void avx2_f_sads(__m256 sads, float sad[4])
+{
+  alignas(32) float values[8];
+  _mm256_store_ps(values, sads);
+
+  sad[0] = values[0];
+  sad[1] = values[4];
+  sad[2] = values[1];
+  sad[3] = values[5];
+}
+
+template<int R> // radius; 3, 2 or 0
+static void frcore_filter_float_b4r0or2or3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[4], const float* inv_table)
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = avx2_f_load_thresh(threshold);
+  auto all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  __m256 ref[8];
+  avx2_f_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256 acc[8];
+  avx2_f_zero(acc);
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      avx2_f_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  avx2_f_4x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_float_b4r0_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_avx2<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_float_b4r2_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_avx2<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_float_b4r3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_avx2<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+template<int R>
+static void frcore_filter_adapt_float_b4r2or3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[4], float sThresh2, float sThresh3, const float* inv_table)
+{
+  ptra += -R * pitcha + 3 - 2 * R; // cpln(3 - 2 * R, -R)
+
+  auto thresh = avx2_f_load_thresh(threshold);
+
+  __m256 ref[8];
+  avx2_f_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256 acc[8];
+  avx2_f_zero(acc);
+
+  auto sad_sum = _mm256_setzero_ps();
+  auto process = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  for (int dy = R - 1; dy <= R + 1; dy++)
+    for (int dx = R - 1; dx <= R + 1; dx++)
+      avx2_f_4x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+  process = _mm256_cmp_ps(sad_sum, _mm256_set1_ps(sThresh2), _CMP_GE_OQ);
+
+  if (_mm256_movemask_ps(process)) {
+    for (int dy = R - 2; dy <= R + 2; dy++)
+      for (int dx = R - 2; dx <= R + 2; dx++)
+        if (avx2_16_ring<R>(dx, dy) == 2)
+          avx2_f_4x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+    process = _mm256_and_ps(process, _mm256_cmp_ps(sad_sum, _mm256_set1_ps(sThresh3), _CMP_GE_OQ));
+
+    if (R >= 3 && _mm256_movemask_ps(process)) {
+      for (int dy = 0; dy <= 2 * R; dy++)
+        for (int dx = 0; dx <= 2 * R; dx++)
+          if (avx2_16_ring<R>(dx, dy) == 3)
+            avx2_f_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process);
+    }
+  }
+
+  avx2_f_4x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_adapt_float_b4r2_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], float sThresh2, float sThresh3, const float* inv_table)
+{
+  frcore_filter_adapt_float_b4r2or3_avx2<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_float_b4r3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], float sThresh2, float sThresh3, const float* inv_table)
+{
+  frcore_filter_adapt_float_b4r2or3_avx2<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+template<int R>
+static void frcore_filter_overlap_float_b4r2or3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[4], const float* inv_table, float weight[4], int process_blocks[4])
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = avx2_f_load_thresh(threshold);
+  auto all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  __m256 ref[8];
+  avx2_f_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256 acc[8];
+  avx2_f_zero(acc);
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      avx2_f_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  avx2_f_4x_blend(ptrb, pitchb, weight_acc, acc, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_float_b4r2_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table, float weight[4], int process_blocks[4])
+{
+  frcore_filter_overlap_float_b4r2or3_avx2<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_float_b4r3_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[4], const float* inv_table, float weight[4], int process_blocks[4])
+{
+  frcore_filter_overlap_float_b4r2or3_avx2<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_diff_float_b4r1_avx2(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[4], const float* inv_table, float weight[4])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  auto thresh = avx2_f_load_thresh(threshold);
+  auto all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  __m256 ref[8];
+  avx2_f_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm256_setzero_si256();
+  __m256 acc[8];
+  avx2_f_zero(acc);
+
+  for (int dy = 0; dy <= 2; dy++)
+    for (int dx = 0; dx <= 2; dx++)
+      avx2_f_4x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  // only the first weight is used, like in the other versions
+  float prev_weight[4] = { weight[0], weight[0], weight[0], weight[0] };
+  int process_blocks[4] = { 1, 1, 1, 1 };
+  __m256 diff;
+
+  avx2_f_4x_blend<true>(ptrb, pitchb, weight_acc, acc, inv_table, prev_weight, process_blocks, &diff);
+
+  avx2_f_sads(_mm256_mul_ps(diff, _mm256_set1_ps(1.0f / 16)), weight);
+}
+
+void frcore_dev_float_4x_b4_avx2(const float* ptra, int pitcha, float dev[4])
+{
+  __m256 ref[8], src1[8], src2[8];
+
+  avx2_f_load_rows(ptra, pitcha, ref);
+  avx2_f_load_rows(ptra + pitcha - 1, pitcha, src1);
+  avx2_f_load_rows(ptra + pitcha + 1, pitcha, src2);
+
+  float sad1[4], sad2[4];
+  avx2_f_sads(avx2_f_4x_sad16(ref, src1), sad1);
+  avx2_f_sads(avx2_f_4x_sad16(ref, src2), sad2);
+
+  for (int i = 0; i < 4; i++)
+    dev[i] = std::min(sad1[i], sad2[i]);
+}
+
+void frcore_sad_float_4x_b4_avx2(const float* ptra, int pitcha, const float* ptrb, int pitchb, float sad[4])
+{
+  __m256 ref[8], src[8];
+
+  avx2_f_load_rows(ptra, pitcha, ref);
+  avx2_f_load_rows(ptrb, pitchb, src);
+
+  avx2_f_sads(avx2_f_4x_sad16(ref, src), sad);
+}
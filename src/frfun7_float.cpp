@@ -0,0 +1,553 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#ifdef FRFUN7_X86
+#include <emmintrin.h>
+#endif
+
+#include "frfun7.h"
+
+
+// Kernels for 32 bit float video.
+//
+// They do the same as the 9 to 16 bit kernels on float pixels, with the pitches
+// in pixels. The SADs and thresholds are floats in units of the pixel values, the
+// sums of the matched blocks are float, and inv_table holds 1 / k, so the averages
+// are a multiplication.
+//
+// The blends don't need the fixed point weights of the integer kernels either:
+// weight is the number k of blocks already averaged into the old pixels, and the
+// result is (average + old * k) / (k + 1).
+//
+// Float additions depend on their order, so every version adds the absolute
+// differences in the same order: down the four columns of the block first, then
+// (column 0 + column 2) + (column 1 + column 3), which is what the SIMD versions
+// get from their horizontal additions. The output of the plain C++, SSE2 and AVX2
+// versions is identical.
+//
+// The adaptive radius searches the same rings as the 9 to 16 bit kernels.
+
+
+// the ring of the displacement (dx, dy) around the center (R, R) of the search window
+template <int R>
+static constexpr int ring(int dx, int dy)
+{
+  int ax = dx < R ? R - dx : dx - R;
+  int ay = dy < R ? R - dy : dy - R;
+  return ax > ay ? ax : ay;
+}
+
+
+// SAD of 4x4 reference and 4x4 actual pixels
+static float scalarf_sad16(const float *ref, int ref_pitch, const float* rdst, int rdp_aka_pitch)
+{
+  float column[4];
+
+  for (int x = 0; x < 4; x++) {
+    column[x] = 0.0f;
+    for (int y = 0; y < 4; y++)
+      column[x] += std::abs(rdst[x + rdp_aka_pitch * y] - ref[x + ref_pitch * y]);
+  }
+
+  return (column[0] + column[2]) + (column[1] + column[3]);
+}
+
+// Matches the candidate at rdst against both reference blocks, the matching ones are added to acc.
+// process: nullptr or the blocks to check
+// sad_sum: nullptr or the sums of the SADs, for the adaptive radius
+static void scalarf_2x_check(const float *ref, int ref_pitch, const float* rdst, int rdp_aka_pitch, int racc[2], const float threshold[2], float acc[2][16], const int process[2], float sad_sum[2])
+{
+  for (int i = 0; i < 2; i++) {
+      if (process && !process[i])
+          continue;
+
+      float sad = scalarf_sad16(ref + 4 * i, ref_pitch, rdst + 4 * i, rdp_aka_pitch);
+
+      if (sad_sum)
+          sad_sum[i] += sad;
+
+      if (sad < threshold[i]) {
+          racc[i]++;
+
+          for (int y = 0; y < 4; y++)
+            for (int x = 0; x < 4; x++)
+              acc[i][y * 4 + x] += rdst[4 * i + x + rdp_aka_pitch * y];
+      }
+  }
+}
+
+static void scalarf_2x_store(float* ptrb, int pitchb, const int racc[2], const float acc[2][16], const float* inv_table)
+{
+  for (int i = 0; i < 2; i++) {
+      float weight_recip = inv_table[racc[i]];
+
+      for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++)
+          ptrb[4 * i + x + pitchb * y] = acc[i][y * 4 + x] * weight_recip;
+  }
+}
+
+// Blends the averages of the blocks selected by process_blocks into ptrb,
+// (average + old * weight) / (weight + 1).
+// diff: nullptr or the SADs between the old and the new pixels of each block
+static void scalarf_2x_blend(float* ptrb, int pitchb, const int racc[2], const float acc[2][16], const float* inv_table, const float weight[2], const int process_blocks[2], float diff[2])
+{
+  for (int i = 0; i < 2; i++) {
+      if (!process_blocks[i])
+          continue;
+
+      float weight_recip = inv_table[racc[i]];
+      float total_recip = inv_table[(int)weight[i] + 1];
+
+      float old[16];
+
+      for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+          float &pixel = ptrb[4 * i + x + pitchb * y];
+
+          float average = acc[i][y * 4 + x] * weight_recip;
+
+          old[y * 4 + x] = pixel;
+          pixel = (average + pixel * weight[i]) * total_recip;
+        }
+      }
+
+      if (diff)
+          diff[i] = scalarf_sad16(old, 4, ptrb + 4 * i, pitchb);
+  }
+}
+
+template<int R> // radius; 3, 2 or 0
+static void frcore_filter_float_b4r0or2or3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table)
+{
+  // convert to upper left corner of the radius
+  ptra += -R * pitcha - R;
+
+  int weight_acc[2] = { 0 };
+  float acc[2][16] = { { 0 } };
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      scalarf_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, nullptr);
+
+  scalarf_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_float_b4r0_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_scalar<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_float_b4r2_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_float_b4r3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+// R == 2 or 3
+template<int R>
+static void frcore_filter_adapt_float_b4r2or3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table)
+{
+  ptra += -R * pitcha + 3 - 2 * R; // cpln(3 - 2 * R, -R)
+
+  int weight_acc[2] = { 0 };
+  float acc[2][16] = { { 0 } };
+  float sad_sum[2] = { 0 };
+
+  // First try with R=1 then if over threshold R=2 then R=3
+  for (int dy = R - 1; dy <= R + 1; dy++)
+    for (int dx = R - 1; dx <= R + 1; dx++)
+      scalarf_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, sad_sum);
+
+  int process[2] = { sad_sum[0] >= sThresh2, sad_sum[1] >= sThresh2 };
+
+  if (process[0] || process[1]) {
+    for (int dy = R - 2; dy <= R + 2; dy++)
+      for (int dx = R - 2; dx <= R + 2; dx++)
+        if (ring<R>(dx, dy) == 2)
+          scalarf_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, sad_sum);
+
+    process[0] = process[0] && sad_sum[0] >= sThresh3;
+    process[1] = process[1] && sad_sum[1] >= sThresh3;
+
+    if (R >= 3 && (process[0] || process[1])) {
+      for (int dy = 0; dy <= 2 * R; dy++)
+        for (int dx = 0; dx <= 2 * R; dx++)
+          if (ring<R>(dx, dy) == 3)
+            scalarf_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, nullptr);
+    }
+  }
+
+  scalarf_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_adapt_float_b4r2_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table)
+{
+  frcore_filter_adapt_float_b4r2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_float_b4r3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table)
+{
+  frcore_filter_adapt_float_b4r2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+// used in mode_temporal and adaptive overlapping
+template<int R>
+static void frcore_filter_overlap_float_b4r2or3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R;
+
+  int weight_acc[2] = { 0 };
+  float acc[2][16] = { { 0 } };
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      scalarf_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, nullptr);
+
+  scalarf_2x_blend(ptrb, pitchb, weight_acc, acc, inv_table, weight, process_blocks, nullptr);
+}
+
+void frcore_filter_overlap_float_b4r2_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_float_b4r2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_float_b4r3_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_float_b4r2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_diff_float_b4r1_scalar(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  int weight_acc[2] = { 0 };
+  float acc[2][16] = { { 0 } };
+
+  for (int dy = 0; dy <= 2; dy++)
+    for (int dx = 0; dx <= 2; dx++)
+      scalarf_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, nullptr);
+
+  // both blocks with the weight of the first one, like frcore_filter_diff_b4r1_scalar
+  float both_weights[2] = { weight[0], weight[0] };
+  int process_blocks[2] = { 1, 1 };
+  float diff[2];
+
+  scalarf_2x_blend(ptrb, pitchb, weight_acc, acc, inv_table, both_weights, process_blocks, diff);
+
+  weight[0] = diff[0] * (1.0f / 16);
+  weight[1] = diff[1] * (1.0f / 16);
+}
+
+void frcore_dev_float_2x_b4_scalar(const float* ptra, int pitcha, float dev[2])
+{
+  for (int i = 0; i < 2; i++) {
+      float sad1 = scalarf_sad16(ptra + 4 * i, pitcha, ptra + 4 * i + pitcha - 1, pitcha);
+      float sad2 = scalarf_sad16(ptra + 4 * i, pitcha, ptra + 4 * i + pitcha + 1, pitcha);
+
+      dev[i] = std::min(sad1, sad2);
+  }
+}
+
+void frcore_sad_float_2x_b4_scalar(const float* ptra, int pitcha, const float* ptrb, int pitchb, float sad[2])
+{
+  sad[0] = scalarf_sad16(ptra, pitcha, ptrb, pitchb);
+  sad[1] = scalarf_sad16(ptra + 4, pitcha, ptrb + 4, pitchb);
+}
+
+
+#ifdef FRFUN7_X86
+
+// SSE2: one row of one block per register, registers 0..3 hold block 0 and 4..7 block 1.
+// The per block values (SADs, thresholds, match counters) are in floats or dwords 0 and 1.
+
+static AVS_FORCEINLINE void simdf_load_rows(const float* ptr, int pitch, __m128 rows[8])
+{
+  for (int i = 0; i < 2; i++)
+    for (int y = 0; y < 4; y++)
+      rows[i * 4 + y] = _mm_loadu_ps(ptr + 4 * i + pitch * y);
+}
+
+static AVS_FORCEINLINE __m128 simdf_abs(__m128 value)
+{
+  return _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+}
+
+// SAD of two 4x4 blocks, in floats 0 and 1
+static AVS_FORCEINLINE __m128 simdf_2x_sad16(const __m128 ref[8], const __m128 src[8])
+{
+  __m128 sad[2];
+
+  for (int i = 0; i < 2; i++) {
+    sad[i] = _mm_setzero_ps();
+    for (int y = 0; y < 4; y++)
+      sad[i] = _mm_add_ps(sad[i], simdf_abs(_mm_sub_ps(src[i * 4 + y], ref[i * 4 + y])));
+  }
+
+  // column 0 + column 2 and column 1 + column 3 of both blocks, then their sums
+  auto sums = _mm_add_ps(_mm_unpacklo_ps(sad[0], sad[1]), _mm_unpackhi_ps(sad[0], sad[1]));
+
+  return _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+}
+
+// see scalarf_2x_check
+// process: all ones in dwords 0 and 1 for the blocks to check
+template <bool sum_sads = false>
+static AVS_FORCEINLINE void simdf_2x_check(const __m128 ref[8], const float* rdst, int rdp_aka_pitch, __m128i& racc, __m128 threshold, __m128 acc[8], __m128 process, __m128* sad_sum = nullptr)
+{
+  __m128 src[8];
+  simdf_load_rows(rdst, rdp_aka_pitch, src);
+
+  auto sad = simdf_2x_sad16(ref, src);
+
+  if constexpr (sum_sads)
+    *sad_sum = _mm_add_ps(*sad_sum, sad);
+
+  auto mask = _mm_and_ps(_mm_cmplt_ps(sad, threshold), process);
+  racc = _mm_sub_epi32(racc, _mm_castps_si128(mask));
+
+  auto mask1 = _mm_shuffle_ps(mask, mask, _MM_SHUFFLE(0, 0, 0, 0));
+  auto mask2 = _mm_shuffle_ps(mask, mask, _MM_SHUFFLE(1, 1, 1, 1));
+
+  for (int y = 0; y < 4; y++) {
+    acc[y] = _mm_add_ps(acc[y], _mm_and_ps(src[y], mask1));
+    acc[4 + y] = _mm_add_ps(acc[4 + y], _mm_and_ps(src[4 + y], mask2));
+  }
+}
+
+static AVS_FORCEINLINE void simdf_2x_store(float* ptrb, int pitchb, __m128i weight_acc, const __m128 acc[8], const float* inv_table)
+{
+  __m128 weight_recip[2] = {
+    _mm_set1_ps(inv_table[_mm_cvtsi128_si32(weight_acc)]),
+    _mm_set1_ps(inv_table[_mm_cvtsi128_si32(_mm_srli_si128(weight_acc, 4))])
+  };
+
+  for (int i = 0; i < 2; i++)
+    for (int y = 0; y < 4; y++)
+      _mm_storeu_ps(ptrb + 4 * i + pitchb * y, _mm_mul_ps(acc[i * 4 + y], weight_recip[i]));
+}
+
+// see scalarf_2x_blend
+// Both blocks are computed, those not in process_blocks keep their old pixels.
+// diff: the SADs between the old and the new pixels, in floats 0 and 1
+template <bool want_diff = false>
+static AVS_FORCEINLINE void simdf_2x_blend(float* ptrb, int pitchb, __m128i weight_acc, const __m128 acc[8], const float* inv_table, const float weight[2], const int process_blocks[2], __m128* diff = nullptr)
+{
+  int count[2] = { _mm_cvtsi128_si32(weight_acc), _mm_cvtsi128_si32(_mm_srli_si128(weight_acc, 4)) };
+
+  __m128 old[8], result[8];
+
+  for (int i = 0; i < 2; i++) {
+    auto weight_recip = _mm_set1_ps(inv_table[count[i]]);
+    auto total_recip = _mm_set1_ps(inv_table[(int)weight[i] + 1]);
+    auto old_weight = _mm_set1_ps(weight[i]);
+
+    for (int y = 0; y < 4; y++) {
+      old[i * 4 + y] = _mm_loadu_ps(ptrb + 4 * i + pitchb * y);
+
+      auto average = _mm_mul_ps(acc[i * 4 + y], weight_recip);
+      result[i * 4 + y] = process_blocks[i] ? _mm_mul_ps(_mm_add_ps(average, _mm_mul_ps(old[i * 4 + y], old_weight)), total_recip)
+                                            : old[i * 4 + y];
+
+      _mm_storeu_ps(ptrb + 4 * i + pitchb * y, result[i * 4 + y]);
+    }
+  }
+
+  if constexpr (want_diff)
+    *diff = simdf_2x_sad16(old, result);
+}
+
+static AVS_FORCEINLINE __m128 simdf_load_thresh(const float threshold[2])
+{
+  return _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)threshold));
+}
+
+static AVS_FORCEINLINE void simdf_zero(__m128 acc[8])
+{
+  for (int i = 0; i < 8; i++)
+    acc[i] = _mm_setzero_ps();
+}
+
+template<int R> // radius; 3, 2 or 0
+static void frcore_filter_float_b4r0or2or3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[2], const float* inv_table)
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = simdf_load_thresh(threshold);
+  auto all = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+  __m128 ref[8];
+  simdf_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128 acc[8];
+  simdf_zero(acc);
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      simdf_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  simdf_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_float_b4r0_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_simd<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_float_b4r2_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_float_b4r3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table)
+{
+  frcore_filter_float_b4r0or2or3_simd<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+template<int R>
+static void frcore_filter_adapt_float_b4r2or3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[2], float sThresh2, float sThresh3, const float* inv_table)
+{
+  ptra += -R * pitcha + 3 - 2 * R; // cpln(3 - 2 * R, -R)
+
+  auto thresh = simdf_load_thresh(threshold);
+
+  __m128 ref[8];
+  simdf_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128 acc[8];
+  simdf_zero(acc);
+
+  auto sad_sum = _mm_setzero_ps();
+  auto process = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+  for (int dy = R - 1; dy <= R + 1; dy++)
+    for (int dx = R - 1; dx <= R + 1; dx++)
+      simdf_2x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+  process = _mm_cmpge_ps(sad_sum, _mm_set1_ps(sThresh2));
+
+  if (_mm_movemask_ps(process) & 3) {
+    for (int dy = R - 2; dy <= R + 2; dy++)
+      for (int dx = R - 2; dx <= R + 2; dx++)
+        if (ring<R>(dx, dy) == 2)
+          simdf_2x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+    process = _mm_and_ps(process, _mm_cmpge_ps(sad_sum, _mm_set1_ps(sThresh3)));
+
+    if (R >= 3 && (_mm_movemask_ps(process) & 3)) {
+      for (int dy = 0; dy <= 2 * R; dy++)
+        for (int dx = 0; dx <= 2 * R; dx++)
+          if (ring<R>(dx, dy) == 3)
+            simdf_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process);
+    }
+  }
+
+  simdf_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_adapt_float_b4r2_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table)
+{
+  frcore_filter_adapt_float_b4r2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_float_b4r3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], float sThresh2, float sThresh3, const float* inv_table)
+{
+  frcore_filter_adapt_float_b4r2or3_simd<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+template<int R>
+static void frcore_filter_overlap_float_b4r2or3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[2], const float* inv_table, float weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = simdf_load_thresh(threshold);
+  auto all = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+  __m128 ref[8];
+  simdf_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128 acc[8];
+  simdf_zero(acc);
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      simdf_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  simdf_2x_blend(ptrb, pitchb, weight_acc, acc, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_float_b4r2_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_float_b4r2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_float_b4r3_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float thresh[2], const float* inv_table, float weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_float_b4r2or3_simd<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_diff_float_b4r1_simd(const float* ptrr, int pitchr, const float* ptra, int pitcha, float* ptrb, int pitchb, float threshold[2], const float* inv_table, float weight[2])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  auto thresh = simdf_load_thresh(threshold);
+  auto all = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+  __m128 ref[8];
+  simdf_load_rows(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128 acc[8];
+  simdf_zero(acc);
+
+  for (int dy = 0; dy <= 2; dy++)
+    for (int dx = 0; dx <= 2; dx++)
+      simdf_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  float both_weights[2] = { weight[0], weight[0] };
+  int process_blocks[2] = { 1, 1 };
+  __m128 diff;
+
+  simdf_2x_blend<true>(ptrb, pitchb, weight_acc, acc, inv_table, both_weights, process_blocks, &diff);
+
+  diff = _mm_mul_ps(diff, _mm_set1_ps(1.0f / 16));
+
+  weight[0] = _mm_cvtss_f32(diff);
+  weight[1] = _mm_cvtss_f32(_mm_shuffle_ps(diff, diff, _MM_SHUFFLE(1, 1, 1, 1)));
+}
+
+void frcore_dev_float_2x_b4_simd(const float* ptra, int pitcha, float dev[2])
+{
+  __m128 ref[8], src1[8], src2[8];
+
+  simdf_load_rows(ptra, pitcha, ref);
+  simdf_load_rows(ptra + pitcha - 1, pitcha, src1);
+  simdf_load_rows(ptra + pitcha + 1, pitcha, src2);
+
+  alignas(16) float sad1[4], sad2[4];
+  _mm_store_ps(sad1, simdf_2x_sad16(ref, src1));
+  _mm_store_ps(sad2, simdf_2x_sad16(ref, src2));
+
+  dev[0] = std::min(sad1[0], sad2[0]);
+  dev[1] = std::min(sad1[1], sad2[1]);
+}
+
+void frcore_sad_float_2x_b4_simd(const float* ptra, int pitcha, const float* ptrb, int pitchb, float sad[2])
+{
+  __m128 ref[8], src[8];
+
+  simdf_load_rows(ptra, pitcha, ref);
+  simdf_load_rows(ptrb, pitchb, src);
+
+  _mm_storel_pi((__m64 *)sad, simdf_2x_sad16(ref, src));
+}
+
+#endif // FRFUN7_X86
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "frfun7.h"
+
+
+// First pass of the filter for radii larger than the hand unrolled kernels handle.
+//
+// The blocks of a block row are grouped into runs whose search centers advance
+// together with the blocks (all of them, except near the left and right edges).
+// The block matching then goes over one displacement at a time for the whole
+// run: the absolute differences of the four block rows are summed per block,
+// and the matching blocks add the displaced pixels to 32 bit accumulators.
+// The cost per candidate is constant per pixel, and the loops over a run
+// vectorise well.
+
+
+namespace {
+
+struct RunBuffers {
+    std::vector<uint16_t> ad; // absolute differences of one displacement, summed over the 4 rows
+    std::vector<uint32_t> mask; // all ones for the pixels of the matching blocks
+    std::vector<uint32_t> acc; // 4 rows of sums
+    std::vector<int> count;
+    std::vector<int> sad_sum;
+    std::vector<uint8_t> active;
+
+    explicit RunBuffers(int nblocks)
+        : ad(nblocks * 4), mask(nblocks * 4), acc(nblocks * 4 * 4), count(nblocks), sad_sum(nblocks), active(nblocks) {}
+};
+
+} // namespace
+
+
+static int sad_b4(const uint8_t* ptra, int pitcha, const uint8_t* ptrb, int pitchb)
+{
+    int sad = 0;
+
+    for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++)
+            sad += std::abs(ptra[y * pitcha + x] - ptrb[y * pitchb + x]);
+
+    return sad;
+}
+
+// see frcore_dev_b4_scalar
+static int dev_b4(const uint8_t* ptra, int pitcha)
+{
+    return std::min(sad_b4(ptra, pitcha, ptra + pitcha - 1, pitcha),
+                    sad_b4(ptra, pitcha, ptra + pitcha + 1, pitcha));
+}
+
+
+// Block matching of a run of n blocks.
+// ref: the first reference block, center: the first block's search center,
+// both advance by 4 pixels per block.
+// Only the displacements with ring_min <= max(|dx|, |dy|) <= ring_max are checked,
+// and only for the active blocks. sad_sum collects their SADs if sum_sads is set.
+// fast: the SADs only cover rows 0 and 2.
+// pattern: only its displacements are checked, for radius ring_max.
+static void search_run(const uint8_t* ref, int ref_pitch, const uint8_t* center, int center_pitch, int n,
+                       int ring_min, int ring_max, const int* thresh, bool sum_sads, bool fast, int pattern, RunBuffers& buf)
+{
+    const int w = n * 4;
+
+    uint16_t* ad = buf.ad.data();
+    uint32_t* mask = buf.mask.data();
+
+    for (int dy = -ring_max; dy <= ring_max; dy++) {
+        for (int dx = -ring_max; dx <= ring_max; dx++) {
+            if (std::max(std::abs(dx), std::abs(dy)) < ring_min)
+                continue;
+
+            if (!pattern_has(pattern, ring_max, dx, dy))
+                continue;
+
+            const uint8_t* cand = center + dy * center_pitch + dx;
+
+            memset(ad, 0, w * sizeof(ad[0]));
+
+            for (int y = 0; y < 4; y += fast ? 2 : 1) {
+                const uint8_t* r = ref + y * ref_pitch;
+                const uint8_t* c = cand + y * center_pitch;
+
+                for (int x = 0; x < w; x++)
+                    ad[x] += std::abs(r[x] - c[x]);
+            }
+
+            bool any = false;
+
+            for (int k = 0; k < n; k++) {
+                int sad = ad[k * 4] + ad[k * 4 + 1] + ad[k * 4 + 2] + ad[k * 4 + 3];
+
+                bool match = false;
+
+                if (buf.active[k]) {
+                    if (sum_sads)
+                        buf.sad_sum[k] += sad;
+
+                    match = sad < thresh[k];
+                    buf.count[k] += match;
+                    any |= match;
+                }
+
+                uint32_t m = match ? 0xffffffff : 0;
+                for (int x = 0; x < 4; x++)
+                    mask[k * 4 + x] = m;
+            }
+
+            if (!any)
+                continue;
+
+            for (int y = 0; y < 4; y++) {
+                const uint8_t* c = cand + y * center_pitch;
+                uint32_t* acc = buf.acc.data() + y * w;
+
+                for (int x = 0; x < w; x++)
+                    acc[x] += c[x] & mask[x];
+            }
+        }
+    }
+}
+
+static void clear_run(int n, RunBuffers& buf)
+{
+    std::fill_n(buf.acc.begin(), n * 4 * 4, 0);
+    std::fill_n(buf.count.begin(), n, 0);
+    std::fill_n(buf.sad_sum.begin(), n, 0);
+}
+
+// see scalar_stor4
+static void store_run(uint8_t* dstp, int dst_pitch, int n, const int* inv_table, const RunBuffers& buf)
+{
+    const int w = n * 4;
+
+    for (int k = 0; k < n; k++) {
+        int weight_recip = inv_table[buf.count[k]];
+
+        for (int y = 0; y < 4; y++) {
+            for (int x = k * 4; x < k * 4 + 4; x++) {
+                int mmA = (int)buf.acc[y * w + x];
+                mmA = (mmA * weight_recip) >> 14;
+                mmA = (mmA + 1) >> 1;
+                dstp[y * dst_pitch + x] = mmA;
+            }
+        }
+    }
+}
+
+// see frcore_filter_overlap_b4r2or3_scalar
+static void blend_run(uint8_t* dstp, int dst_pitch, int n, const int* inv_table, const int* weight, const RunBuffers& buf)
+{
+    const int w = n * 4;
+
+    for (int k = 0; k < n; k++) {
+        if (!buf.active[k])
+            continue;
+
+        int weight_lo16 = weight[k] & 0xFFFF; // lower 16 bit
+        int weight_hi16 = weight[k] >> 16; // upper 16 bit
+
+        int weight_recip = inv_table[buf.count[k]];
+
+        for (int y = 0; y < 4; y++) {
+            for (int x = k * 4; x < k * 4 + 4; x++) {
+                int mmA = (int)buf.acc[y * w + x];
+                mmA = (mmA * weight_recip + 256) >> 9;
+                mmA = (mmA * weight_lo16) >> 16;
+
+                int mm3 = dstp[y * dst_pitch + x];
+                mm3 = (mm3 * weight_hi16) >> 10;
+                dstp[y * dst_pitch + x] = (mmA + mm3 + 16) >> 5;
+            }
+        }
+    }
+}
+
+
+void frcore_1stpass_plane(const uint8_t* srcp, int src_pitch,
+                          const uint8_t* srcp_prev, int src_prev_pitch,
+                          const uint8_t* srcp_next, int src_next_pitch,
+                          uint8_t* dstp, int dst_pitch,
+                          bool mode_temporal, bool mode_adaptive_radius, bool fast, int pattern,
+                          int dim_x, int dim_y,
+                          int R, int lambda, int tmax,
+                          const int* inv_table)
+{
+    constexpr int B = 4;
+    constexpr int S = 4;
+
+    const int nblocks = (dim_x + S - 1) / S;
+
+    std::vector<int> bx(nblocks), sx(nblocks);
+    std::vector<int> thresh(nblocks), devp(nblocks), devn(nblocks), weight(nblocks), k(nblocks);
+    // half the rows, half the threshold
+    std::vector<int> search_thresh(nblocks);
+
+    for (int i = 0; i < nblocks; i++) {
+        bx[i] = std::min(i * S, dim_x - B);
+        sx[i] = std::max(R, std::min(i * S, dim_x - R - B));
+    }
+
+    RunBuffers buf(nblocks);
+
+    for (int y = 0; y < dim_y; y += S)
+    {
+      int by = std::min(y, dim_y - B);
+      int sy = std::max(R, std::min(y, dim_y - R - B));
+
+      const uint8_t* srcp_curr_by = srcp + src_pitch * by;
+      const uint8_t* srcp_curr_sy = srcp + src_pitch * sy;
+      uint8_t* dstp_curr_by = dstp + dst_pitch * by;
+      uint8_t* dstp_curr_sy = dstp + dst_pitch * sy;
+
+      for (int i = 0; i < nblocks; i++) {
+          int dev = dev_b4(srcp_curr_sy + sx[i], src_pitch);
+
+          // a missing neighbour is nullptr
+          if (mode_temporal && srcp_prev) {
+              devp[i] = sad_b4(srcp_curr_sy + sx[i], src_pitch, srcp_prev + src_prev_pitch * sy + sx[i], src_prev_pitch);
+              dev = std::min(dev, devp[i]);
+          }
+
+          if (mode_temporal && srcp_next) {
+              devn[i] = sad_b4(srcp_curr_sy + sx[i], src_pitch, srcp_next + src_next_pitch * sy + sx[i], src_next_pitch);
+              dev = std::min(dev, devn[i]);
+          }
+
+          thresh[i] = ((dev * lambda) >> 10);
+          thresh[i] = (thresh[i] > tmax) ? tmax : thresh[i];
+          if (thresh[i] < 1) thresh[i] = 1;
+
+          search_thresh[i] = fast ? (thresh[i] + 1) >> 1 : thresh[i];
+      }
+
+      for (int first = 0; first < nblocks; ) {
+        // blocks whose search centers move along with them
+        int n = 1;
+        while (first + n < nblocks &&
+               bx[first + n] == bx[first] + n * S &&
+               sx[first + n] == sx[first] + n * S)
+            n++;
+
+        const uint8_t* ref_b = srcp_curr_by + bx[first];
+        const uint8_t* ref_s = srcp_curr_sy + sx[first];
+
+        if (mode_temporal) {
+            // the R=0 search only matches the block itself, which is stored unchanged
+            for (int yy = 0; yy < B; yy++)
+                memcpy(dstp_curr_by + dst_pitch * yy + bx[first], ref_b + src_pitch * yy, n * B);
+
+            for (int i = 0; i < n; i++) {
+                k[first + i] = 1;
+                weight[first + i] = get_weight(1); // two 16 bit values inside
+            }
+
+            if (srcp_prev) {
+                for (int i = 0; i < n; i++)
+                    buf.active[i] = devp[first + i] < thresh[first + i];
+
+                clear_run(n, buf);
+                search_run(ref_s, src_pitch, srcp_prev + src_prev_pitch * sy + sx[first], src_prev_pitch, n, 0, R, &search_thresh[first], false, fast, pattern, buf);
+                blend_run(dstp_curr_sy + sx[first], dst_pitch, n, inv_table, &weight[first], buf);
+
+                for (int i = 0; i < n; i++) {
+                    k[first + i] += buf.active[i];
+                    weight[first + i] = get_weight(k[first + i]);
+                }
+            }
+
+            if (srcp_next) {
+                for (int i = 0; i < n; i++)
+                    buf.active[i] = devn[first + i] < thresh[first + i];
+
+                clear_run(n, buf);
+                search_run(ref_s, src_pitch, srcp_next + src_next_pitch * sy + sx[first], src_next_pitch, n, 0, R, &search_thresh[first], false, fast, pattern, buf);
+                blend_run(dstp_curr_sy + sx[first], dst_pitch, n, inv_table, &weight[first], buf);
+            }
+        } else {
+            clear_run(n, buf);
+            std::fill_n(buf.active.begin(), n, 1);
+
+            if (mode_adaptive_radius && sx[first] == bx[first] && sy == by) {
+                // First try with R=1 then if over threshold R=2, then the rest
+                const int thresh2 = fast ? (16 * 9 + 1) >> 1 : 16 * 9;
+                const int thresh3 = fast ? (16 * 25 + 1) >> 1 : 16 * 25;
+
+                search_run(ref_b, src_pitch, ref_s, src_pitch, n, 0, 1, &search_thresh[first], true, fast, PatternDense, buf);
+
+                for (int i = 0; i < n; i++)
+                    buf.active[i] = buf.sad_sum[i] >= thresh2;
+
+                search_run(ref_b, src_pitch, ref_s, src_pitch, n, 2, 2, &search_thresh[first], true, fast, PatternDense, buf);
+
+                for (int i = 0; i < n; i++)
+                    buf.active[i] = buf.active[i] && buf.sad_sum[i] >= thresh3;
+
+                search_run(ref_b, src_pitch, ref_s, src_pitch, n, 3, R, &search_thresh[first], false, fast, PatternDense, buf);
+            } else {
+                search_run(ref_b, src_pitch, ref_s, src_pitch, n, 0, R, &search_thresh[first], false, fast, pattern, buf);
+            }
+
+            store_run(dstp_curr_by + bx[first], dst_pitch, n, inv_table, buf);
+        }
+
+        first += n;
+      }
+    }
+}
@@ -0,0 +1,452 @@
+#include <smmintrin.h>
+
+#include "frfun7.h"
+
+
+// The SSE2 kernels compute the SAD of every candidate separately.
+// Here one mpsadbw per reference row produces the SADs of all eight horizontal
+// offsets of a candidate row at once, for one block. The accepted candidates are
+// then accumulated the same way as in the SSE2 kernels.
+//
+// Every candidate row is loaded as 16 bytes starting at offset 0, so
+// the caller must make sure ptra - R + 16 stays inside the plane.
+
+// set bit n: horizontal offset n is a candidate in this row
+enum {
+  offsets_r2 = 0x1f, // 0..4
+  offsets_r3 = 0x7f, // 0..6
+};
+
+template <int offsets>
+static AVS_FORCEINLINE __m128i sse41_offset_lanes() {
+  return _mm_setr_epi16(offsets & 1 ? -1 : 0, offsets & 2 ? -1 : 0, offsets & 4 ? -1 : 0, offsets & 8 ? -1 : 0,
+                        offsets & 16 ? -1 : 0, offsets & 32 ? -1 : 0, offsets & 64 ? -1 : 0, 0);
+}
+
+// thresholds as words, the SADs never exceed 16 * 255
+static AVS_FORCEINLINE __m128i sse41_load_thresh(int threshold) {
+  return _mm_set1_epi16(threshold > 32767 ? 32767 : threshold);
+}
+
+// SADs of the two reference blocks against the 8 horizontal offsets of one candidate row
+// block 0 (low dwords of the ref rows) in sads0, block 1 in sads1
+static AVS_FORCEINLINE void sse41_2x_row_sads(__m128i ref0, __m128i ref1, __m128i ref2, __m128i ref3, const uint8_t* rdst, int rdp_aka_pitch, __m128i &sads0, __m128i &sads1)
+{
+  auto src = _mm_loadu_si128((const __m128i *)rdst);
+  sads0 = _mm_mpsadbw_epu8(src, ref0, 0); // offsets 0..7 against bytes 0..3 of ref
+  sads1 = _mm_mpsadbw_epu8(src, ref0, 5); // offsets 4..11 against bytes 4..7 of ref
+
+  src = _mm_loadu_si128((const __m128i *)(rdst + rdp_aka_pitch));
+  sads0 = _mm_add_epi16(sads0, _mm_mpsadbw_epu8(src, ref1, 0));
+  sads1 = _mm_add_epi16(sads1, _mm_mpsadbw_epu8(src, ref1, 5));
+
+  src = _mm_loadu_si128((const __m128i *)(rdst + rdp_aka_pitch * 2));
+  sads0 = _mm_add_epi16(sads0, _mm_mpsadbw_epu8(src, ref2, 0));
+  sads1 = _mm_add_epi16(sads1, _mm_mpsadbw_epu8(src, ref2, 5));
+
+  src = _mm_loadu_si128((const __m128i *)(rdst + rdp_aka_pitch * 3));
+  sads0 = _mm_add_epi16(sads0, _mm_mpsadbw_epu8(src, ref3, 0));
+  sads1 = _mm_add_epi16(sads1, _mm_mpsadbw_epu8(src, ref3, 5));
+}
+
+static AVS_FORCEINLINE void sse41_acc4(__m128i &mmA, __m128i mm3, __m128i mask_by_sadcomp)
+{
+  mm3 = _mm_unpacklo_epi8(mm3, _mm_setzero_si128());
+  mm3 = _mm_and_si128(mm3, mask_by_sadcomp);
+  mmA = _mm_add_epi16(mmA, mm3);
+}
+
+// adds the candidate at the given offset to mm4..mm7 where mask is set
+// mask: byte n is 0xff if offset n matched block 0, byte 8 + n for block 1
+template <int offset>
+static AVS_FORCEINLINE void sse41_2x_acc16(const uint8_t* rdst, int rdp_aka_pitch, __m128i mask, __m128i &mm4, __m128i &mm5, __m128i &mm6, __m128i &mm7)
+{
+  // 4 words of block 0's flag, 4 words of block 1's flag
+  auto mask_by_sadcomp = _mm_shuffle_epi8(mask, _mm_setr_epi8(offset, offset, offset, offset, offset, offset, offset, offset,
+                                                              offset + 8, offset + 8, offset + 8, offset + 8, offset + 8, offset + 8, offset + 8, offset + 8));
+
+  sse41_acc4(mm4, _mm_load_si64(rdst + offset), mask_by_sadcomp);
+  sse41_acc4(mm5, _mm_load_si64(rdst + 1 * rdp_aka_pitch + offset), mask_by_sadcomp);
+  sse41_acc4(mm6, _mm_load_si64(rdst + 2 * rdp_aka_pitch + offset), mask_by_sadcomp);
+  sse41_acc4(mm7, _mm_load_si64(rdst + 3 * rdp_aka_pitch + offset), mask_by_sadcomp);
+}
+
+// Checks the given offsets of one candidate row.
+// racc0/racc1: per offset match counters of the two blocks
+// sad_sum0/sad_sum1: per offset SAD sums, only when sum_sads (adaptive radius)
+template <int offsets, bool sum_sads>
+static AVS_FORCEINLINE void sse41_2x_check_row(__m128i ref0, __m128i ref1, __m128i ref2, __m128i ref3, const uint8_t* rdst, int rdp_aka_pitch,
+  __m128i &racc0, __m128i &racc1, __m128i thresh0, __m128i thresh1,
+  __m128i &mm4, __m128i &mm5, __m128i &mm6, __m128i &mm7,
+  __m128i &sad_sum0, __m128i &sad_sum1)
+{
+  __m128i sads0, sads1;
+  sse41_2x_row_sads(ref0, ref1, ref2, ref3, rdst, rdp_aka_pitch, sads0, sads1);
+
+  auto lanes = sse41_offset_lanes<offsets>();
+
+  if constexpr (sum_sads) {
+    sad_sum0 = _mm_add_epi16(sad_sum0, _mm_and_si128(sads0, lanes));
+    sad_sum1 = _mm_add_epi16(sad_sum1, _mm_and_si128(sads1, lanes));
+  }
+
+  auto match0 = _mm_and_si128(_mm_cmpgt_epi16(thresh0, sads0), lanes);
+  auto match1 = _mm_and_si128(_mm_cmpgt_epi16(thresh1, sads1), lanes);
+
+  racc0 = _mm_sub_epi16(racc0, match0);
+  racc1 = _mm_sub_epi16(racc1, match1);
+
+  auto mask = _mm_packs_epi16(match0, match1);
+
+  // nothing to accumulate from this row
+  if (_mm_testz_si128(mask, mask))
+    return;
+
+  if constexpr ((offsets & 1) != 0) sse41_2x_acc16<0>(rdst, rdp_aka_pitch, mask, mm4, mm5, mm6, mm7);
+  if constexpr ((offsets & 2) != 0) sse41_2x_acc16<1>(rdst, rdp_aka_pitch, mask, mm4, mm5, mm6, mm7);
+  if constexpr ((offsets & 4) != 0) sse41_2x_acc16<2>(rdst, rdp_aka_pitch, mask, mm4, mm5, mm6, mm7);
+  if constexpr ((offsets & 8) != 0) sse41_2x_acc16<3>(rdst, rdp_aka_pitch, mask, mm4, mm5, mm6, mm7);
+  if constexpr ((offsets & 16) != 0) sse41_2x_acc16<4>(rdst, rdp_aka_pitch, mask, mm4, mm5, mm6, mm7);
+  if constexpr ((offsets & 32) != 0) sse41_2x_acc16<5>(rdst, rdp_aka_pitch, mask, mm4, mm5, mm6, mm7);
+  if constexpr ((offsets & 64) != 0) sse41_2x_acc16<6>(rdst, rdp_aka_pitch, mask, mm4, mm5, mm6, mm7);
+}
+
+template <int offsets>
+static AVS_FORCEINLINE void sse41_2x_check_row(__m128i ref0, __m128i ref1, __m128i ref2, __m128i ref3, const uint8_t* rdst, int rdp_aka_pitch,
+  __m128i &racc0, __m128i &racc1, __m128i thresh0, __m128i thresh1,
+  __m128i &mm4, __m128i &mm5, __m128i &mm6, __m128i &mm7)
+{
+  __m128i unused;
+  sse41_2x_check_row<offsets, false>(ref0, ref1, ref2, ref3, rdst, rdp_aka_pitch, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7, unused, unused);
+}
+
+// total number of matches of each block
+static AVS_FORCEINLINE void sse41_2x_count(__m128i racc0, __m128i racc1, int weight_acc[2])
+{
+  // at most one match per row in each lane, so they fit in bytes
+  auto counts = _mm_sad_epu8(_mm_packus_epi16(racc0, racc1), _mm_setzero_si128());
+  weight_acc[0] = _mm_cvtsi128_si32(counts);
+  weight_acc[1] = _mm_extract_epi16(counts, 4);
+}
+
+// total of the SAD sums of a block
+static AVS_FORCEINLINE int sse41_hsum(__m128i sad_sum)
+{
+  auto sums = _mm_madd_epi16(sad_sum, _mm_set1_epi16(1));
+  sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+  sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sums);
+}
+
+static AVS_FORCEINLINE void sse41_2x_stor4(uint8_t* esi, __m128i mmA, __m128i mm0_multiplier)
+{
+  // ((((mm1 << 2) * multiplier) >> 16 ) + 1) >> 1
+  auto mm1 = _mm_slli_epi16(mmA, 2);
+  mm1 = _mm_mulhi_epu16(mm1, mm0_multiplier); // pmulhuw, really unsigned
+  mm1 = _mm_adds_epu16(mm1, _mm_set1_epi16(1));
+  mm1 = _mm_srli_epi16(mm1, 1);
+  mm1 = _mm_packus_epi16(mm1, _mm_setzero_si128()); // 8 words to 8 bytes
+  _mm_storel_epi64((__m128i *)esi, mm1);
+}
+
+static AVS_FORCEINLINE void sse41_2x_store(uint8_t* ptrb, int pitchb, const int weight_acc[2], const int* inv_table,
+  __m128i mm4, __m128i mm5, __m128i mm6, __m128i mm7)
+{
+  int weight_block1 = inv_table[weight_acc[0]];
+  int weight_block2 = inv_table[weight_acc[1]];
+
+  // scale 4 - 7 by weight
+  auto weight_recip = _mm_setr_epi16(weight_block1, weight_block1, weight_block1, weight_block1,
+                                     weight_block2, weight_block2, weight_block2, weight_block2);
+
+  sse41_2x_stor4(ptrb + 0 * pitchb, mm4, weight_recip);
+  sse41_2x_stor4(ptrb + 1 * pitchb, mm5, weight_recip);
+  sse41_2x_stor4(ptrb + 2 * pitchb, mm6, weight_recip);
+  sse41_2x_stor4(ptrb + 3 * pitchb, mm7, weight_recip);
+}
+
+
+template<int R> // radius; 2 or 3
+static AVS_FORCEINLINE void frcore_filter_b4r2or3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table)
+{
+  constexpr int offsets = R == 3 ? offsets_r3 : offsets_r2;
+
+  // convert to upper left corner of the radius
+  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(-2, -2)
+
+  auto thresh0 = sse41_load_thresh(threshold[0]);
+  auto thresh1 = sse41_load_thresh(threshold[1]);
+
+  auto racc0 = _mm_setzero_si128();
+  auto racc1 = _mm_setzero_si128();
+
+  // reference pixels, block 0 in bytes 0..3, block 1 in bytes 4..7
+  auto ref0 = _mm_load_si64(ptrr);
+  auto ref1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto ref2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto ref3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  // accumulators
+  // each collects 8 words (weighted sums)
+  // which will be finally scaled back and stored as 8 bytes
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  for (int y = -R; y <= R; y++) {
+    sse41_2x_check_row<offsets>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7);
+    ptra += pitcha; // next line
+  }
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  int weight_acc[2];
+  sse41_2x_count(racc0, racc1, weight_acc);
+
+  sse41_2x_store(ptrb, pitchb, weight_acc, inv_table, mm4, mm5, mm6, mm7);
+}
+
+void frcore_filter_b4r3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r2or3_sse41<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_b4r2_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r2or3_sse41<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+
+// R == 2 or 3
+// The same rings of candidates as in frcore_filter_adapt_b4r2or3_simd.
+template<int R>
+static AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  // convert to upper left corner of the radius
+  ptra += -1 * pitcha - R; // cpln(-3, -1)
+
+  auto thresh0 = sse41_load_thresh(threshold[0]);
+  auto thresh1 = sse41_load_thresh(threshold[1]);
+
+  auto racc0 = _mm_setzero_si128();
+  auto racc1 = _mm_setzero_si128();
+
+  // reference pixels
+  auto ref0 = _mm_load_si64(ptrr);
+  auto ref1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto ref2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto ref3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  // accumulators
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  auto sad_sum0 = _mm_setzero_si128();
+  auto sad_sum1 = _mm_setzero_si128();
+
+  // ; -1 .. +1, offsets 2..4
+  for (int y = -1; y <= 1; y++) {
+    sse41_2x_check_row<0x1c, true>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7, sad_sum0, sad_sum1);
+    ptra += pitcha; // next line
+  }
+
+  int process[2] = { sse41_hsum(sad_sum0) >= sThresh2, sse41_hsum(sad_sum1) >= sThresh2 };
+
+  if (process[0] || process[1])
+  {
+    auto racc0_saved = racc0;
+    auto racc1_saved = racc1;
+    auto mm4_saved = mm4;
+    auto mm5_saved = mm5;
+    auto mm6_saved = mm6;
+    auto mm7_saved = mm7;
+
+    // Expand the search for distances not covered in the first pass
+    ptra -= 4 * pitcha; // move to -2
+
+    // ; -2
+    sse41_2x_check_row<0x3e, true>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7, sad_sum0, sad_sum1);
+    ptra += pitcha; // next line
+
+    // ; -1 .. +1, offsets 1 and 5
+    for (int y = -1; y <= 1; y++) {
+      sse41_2x_check_row<0x22, true>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7, sad_sum0, sad_sum1);
+      ptra += pitcha; // next line
+    }
+
+    // ; +2
+    sse41_2x_check_row<0x3e, true>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7, sad_sum0, sad_sum1);
+
+    // blocks which didn't need the wider search get their previous sums back
+    auto process_mask = _mm_set_epi64x(process[1] ? -1 : 0, process[0] ? -1 : 0);
+
+    mm4 = _mm_blendv_epi8(mm4_saved, mm4, process_mask);
+    mm5 = _mm_blendv_epi8(mm5_saved, mm5, process_mask);
+    mm6 = _mm_blendv_epi8(mm6_saved, mm6, process_mask);
+    mm7 = _mm_blendv_epi8(mm7_saved, mm7, process_mask);
+    if (!process[0])
+      racc0 = racc0_saved;
+    if (!process[1])
+      racc1 = racc1_saved;
+
+    process[0] = process[0] && sse41_hsum(sad_sum0) >= sThresh3;
+    process[1] = process[1] && sse41_hsum(sad_sum1) >= sThresh3;
+
+    if constexpr (R >= 3) {
+      if (process[0] || process[1])
+      {
+        racc0_saved = racc0;
+        racc1_saved = racc1;
+        mm4_saved = mm4;
+        mm5_saved = mm5;
+        mm6_saved = mm6;
+        mm7_saved = mm7;
+
+        // Expand the search for distances not covered in the first-second pass
+        ptra -= 5 * pitcha; // move to -3
+
+        // ; -3
+        sse41_2x_check_row<offsets_r3>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7);
+        ptra += pitcha; // next line
+
+        // ; -2 .. +2, offsets 0 and 6
+        for (int y = -2; y <= 2; y++) {
+          sse41_2x_check_row<0x41>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7);
+          ptra += pitcha; // next line
+        }
+
+        // ; +3
+        sse41_2x_check_row<offsets_r3>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7);
+
+        process_mask = _mm_set_epi64x(process[1] ? -1 : 0, process[0] ? -1 : 0);
+
+        mm4 = _mm_blendv_epi8(mm4_saved, mm4, process_mask);
+        mm5 = _mm_blendv_epi8(mm5_saved, mm5, process_mask);
+        mm6 = _mm_blendv_epi8(mm6_saved, mm6, process_mask);
+        mm7 = _mm_blendv_epi8(mm7_saved, mm7, process_mask);
+        if (!process[0])
+          racc0 = racc0_saved;
+        if (!process[1])
+          racc1 = racc1_saved;
+      }
+    }
+  }
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  int weight_acc[2];
+  sse41_2x_count(racc0, racc1, weight_acc);
+
+  sse41_2x_store(ptrb, pitchb, weight_acc, inv_table, mm4, mm5, mm6, mm7);
+}
+
+void frcore_filter_adapt_b4r3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_sse41<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_b4r2_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_sse41<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+
+// scales the sums of one block (low 4 words of mmA) and blends them into esi
+// see frcore_filter_overlap_b4r2or3_simd
+static AVS_FORCEINLINE void sse41_blend_store4(uint8_t* esi, __m128i mmA, __m128i weight_recip, __m128i weight_lo16, __m128i weight_hi16)
+{
+  mmA = _mm_unpacklo_epi16(mmA, _mm_set1_epi16(256));
+
+  // We do this instead of pmulhw in order to avoid a loss of precision,
+  // which would result in a green tint (lower pixel values).
+  mmA = _mm_madd_epi16(mmA, weight_recip);
+  mmA = _mm_srli_epi32(mmA, 9);
+  mmA = _mm_mulhi_epi16(mmA, weight_lo16);
+  mmA = _mm_packs_epi32(mmA, _mm_setzero_si128());
+
+  auto mm3 = _mm_cvtepu8_epi16(_mm_load_si32(esi));
+  // tmp= ((esi << 6) * multiplier) >> 16  ( == [esi]/1024 * multiplier)
+  // mmA = (mmA + tmp + rounder_16) / 32
+  mm3 = _mm_slli_epi16(mm3, 6);
+  mm3 = _mm_mulhi_epi16(mm3, weight_hi16); // pmulhw, signed
+  mmA = _mm_adds_epu16(mmA, mm3);
+  mmA = _mm_adds_epu16(mmA, _mm_set1_epi16(16));
+  mmA = _mm_srli_epi16(mmA, 5);
+  mmA = _mm_packus_epi16(mmA, _mm_setzero_si128()); // 4 words to 4 bytes
+  *(uint32_t*)(esi) = _mm_cvtsi128_si32(mmA);
+}
+
+static AVS_FORCEINLINE void sse41_blend_block(uint8_t* ptrb, int pitchb, __m128i mm4, __m128i mm5, __m128i mm6, __m128i mm7, int weight, int weight_acc, const int* inv_table)
+{
+  // weight variable is a multi-purpose one, here we get a 32 bit value,
+  // which is really two 16 bit words
+  // lower 16 and upper 16 bit has separate meaning
+  auto weight_lo16 = _mm_set1_epi32(weight & 0xFFFF); // lower 16 bit
+  auto weight_hi16 = _mm_set1_epi16(weight >> 16); // upper 16 bit
+
+  auto weight_recip = _mm_set1_epi32(inv_table[weight_acc] + (1 << 16));
+
+  sse41_blend_store4(ptrb + 0 * pitchb, mm4, weight_recip, weight_lo16, weight_hi16);
+  sse41_blend_store4(ptrb + 1 * pitchb, mm5, weight_recip, weight_lo16, weight_hi16);
+  sse41_blend_store4(ptrb + 2 * pitchb, mm6, weight_recip, weight_lo16, weight_hi16);
+  sse41_blend_store4(ptrb + 3 * pitchb, mm7, weight_recip, weight_lo16, weight_hi16);
+}
+
+// used in mode_temporal and adaptive overlapping
+// R is 2 or 3
+template<int R>
+static AVS_FORCEINLINE void frcore_filter_overlap_b4r2or3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  constexpr int offsets = R == 3 ? offsets_r3 : offsets_r2;
+
+  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(-2, -2)
+
+  auto thresh0 = sse41_load_thresh(threshold[0]);
+  auto thresh1 = sse41_load_thresh(threshold[1]);
+
+  auto racc0 = _mm_setzero_si128();
+  auto racc1 = _mm_setzero_si128();
+
+  // reference pixels
+  auto ref0 = _mm_load_si64(ptrr);
+  auto ref1 = _mm_load_si64(ptrr + pitchr * 1);
+  auto ref2 = _mm_load_si64(ptrr + pitchr * 2);
+  auto ref3 = _mm_load_si64(ptrr + pitchr * 3);
+
+  // accumulators
+  auto mm4 = _mm_setzero_si128();
+  auto mm5 = _mm_setzero_si128();
+  auto mm6 = _mm_setzero_si128();
+  auto mm7 = _mm_setzero_si128();
+
+  for (int y = -R; y <= R; y++) {
+    sse41_2x_check_row<offsets>(ref0, ref1, ref2, ref3, ptra, pitcha, racc0, racc1, thresh0, thresh1, mm4, mm5, mm6, mm7);
+    ptra += pitcha; // next line
+  }
+
+  // mm4 - mm7 has accumulated sum, weight is ready here
+
+  int weight_acc[2];
+  sse41_2x_count(racc0, racc1, weight_acc);
+
+  if (process_blocks[0])
+    sse41_blend_block(ptrb, pitchb, mm4, mm5, mm6, mm7, weight[0], weight_acc[0], inv_table);
+
+  if (process_blocks[1])
+    sse41_blend_block(ptrb + 4, pitchb,
+                      _mm_unpackhi_epi64(mm4, mm4), _mm_unpackhi_epi64(mm5, mm5), _mm_unpackhi_epi64(mm6, mm6), _mm_unpackhi_epi64(mm7, mm7),
+                      weight[1], weight_acc[1], inv_table);
+}
+
+void frcore_filter_overlap_b4r3_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_sse41<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_b4r2_sse41(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_sse41<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
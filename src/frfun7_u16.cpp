@@ -0,0 +1,594 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef FRFUN7_X86
+#include <emmintrin.h>
+#endif
+
+#include "frfun7.h"
+
+
+// Kernels for 9 to 16 bit video.
+//
+// They do the same as the 8 bit kernels on uint16_t pixels, with the pitches
+// in pixels. The SADs and thresholds are in units of the bit depth. The sums of
+// the matched blocks are 32 bit, and inv_table is the wider table built for them
+// in frfun7Create: 2^30 / k rounded up, so the averages take 64 bit products.
+//
+// The candidates are checked in loops over the search window instead of being
+// unrolled by hand. The order doesn't change the sums, the output of the plain
+// C++, SSE2 and AVX2 versions is identical.
+//
+// With the adaptive radius the search grows by one ring of displacements at a
+// time, like in the 8 bit kernels, and around the same center: the block with
+// R=3, but one pixel to its right with R=2, from 1 column left to 3 right.
+
+
+// the ring of the displacement (dx, dy) around the center (R, R) of the search window
+template <int R>
+static constexpr int ring(int dx, int dy)
+{
+  int ax = dx < R ? R - dx : dx - R;
+  int ay = dy < R ? R - dy : dy - R;
+  return ax > ay ? ax : ay;
+}
+
+
+// SAD of 4x4 reference and 4x4 actual pixels
+static int scalar16_sad16(const uint16_t *ref, int ref_pitch, const uint16_t* rdst, int rdp_aka_pitch)
+{
+  int sad = 0;
+
+  for (int y = 0; y < 4; y++)
+    for (int x = 0; x < 4; x++)
+      sad += std::abs(rdst[x + rdp_aka_pitch * y] - ref[x + ref_pitch * y]);
+
+  return sad;
+}
+
+// Matches the candidate at rdst against both reference blocks, the matching ones are added to acc.
+// process: nullptr or the blocks to check
+// sad_sum: nullptr or the sums of the SADs, for the adaptive radius
+static void scalar16_2x_check(const uint16_t *ref, int ref_pitch, const uint16_t* rdst, int rdp_aka_pitch, int racc[2], const int threshold[2], int acc[2][16], const int process[2], int sad_sum[2])
+{
+  for (int i = 0; i < 2; i++) {
+      if (process && !process[i])
+          continue;
+
+      int sad = scalar16_sad16(ref + 4 * i, ref_pitch, rdst + 4 * i, rdp_aka_pitch);
+
+      if (sad_sum)
+          sad_sum[i] += sad;
+
+      if (sad < threshold[i]) {
+          racc[i]++;
+
+          for (int y = 0; y < 4; y++)
+            for (int x = 0; x < 4; x++)
+              acc[i][y * 4 + x] += rdst[4 * i + x + rdp_aka_pitch * y];
+      }
+  }
+}
+
+static void scalar16_2x_store(uint16_t* ptrb, int pitchb, const int racc[2], const int acc[2][16], const int* inv_table)
+{
+  for (int i = 0; i < 2; i++) {
+      int64_t weight_recip = inv_table[racc[i]];
+
+      for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++)
+          ptrb[4 * i + x + pitchb * y] = (uint16_t)((acc[i][y * 4 + x] * weight_recip + (1 << 29)) >> 30);
+  }
+}
+
+// Blends the averages of the blocks selected by process_blocks into ptrb, like scalar_2x_blend:
+// the lower 16 bits of weight are folded into the reciprocal, so the average times weight_lo16 / 1024
+// takes a single product.
+// diff: nullptr or the SADs between the old and the new pixels of each block
+static void scalar16_2x_blend(uint16_t* ptrb, int pitchb, const int racc[2], const int acc[2][16], const int* inv_table, const int weight[2], const int process_blocks[2], int diff[2])
+{
+  for (int i = 0; i < 2; i++) {
+      if (!process_blocks[i])
+          continue;
+
+      int64_t weight_recip = ((int64_t)inv_table[racc[i]] * (weight[i] & 0xFFFF) + (1 << 13)) >> 14;
+      int weight_hi16 = weight[i] >> 16;
+
+      int sad = 0;
+
+      for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+          uint16_t &pixel = ptrb[4 * i + x + pitchb * y];
+
+          int mmA = (int)((acc[i][y * 4 + x] * weight_recip + (1 << 25)) >> 26);
+          int mm3 = (pixel * weight_hi16) >> 10;
+          int result = (mmA + mm3 + 16) >> 5;
+
+          sad += std::abs(result - pixel);
+          pixel = (uint16_t)result;
+        }
+      }
+
+      if (diff)
+          diff[i] = sad;
+  }
+}
+
+template<int R> // radius; 3, 2 or 0
+static void frcore_filter_u16_b4r0or2or3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  // convert to upper left corner of the radius
+  ptra += -R * pitcha - R;
+
+  int weight_acc[2] = { 0 };
+  int acc[2][16] = { { 0 } };
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      scalar16_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, nullptr);
+
+  scalar16_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_u16_b4r0_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_scalar<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_u16_b4r2_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_u16_b4r3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+// R == 2 or 3
+template<int R>
+static void frcore_filter_adapt_u16_b4r2or3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  ptra += -R * pitcha + 3 - 2 * R; // cpln(3 - 2 * R, -R)
+
+  int weight_acc[2] = { 0 };
+  int acc[2][16] = { { 0 } };
+  int sad_sum[2] = { 0 };
+
+  // First try with R=1 then if over threshold R=2 then R=3
+  for (int dy = R - 1; dy <= R + 1; dy++)
+    for (int dx = R - 1; dx <= R + 1; dx++)
+      scalar16_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, sad_sum);
+
+  int process[2] = { sad_sum[0] >= sThresh2, sad_sum[1] >= sThresh2 };
+
+  if (process[0] || process[1]) {
+    for (int dy = R - 2; dy <= R + 2; dy++)
+      for (int dx = R - 2; dx <= R + 2; dx++)
+        if (ring<R>(dx, dy) == 2)
+          scalar16_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, sad_sum);
+
+    process[0] = process[0] && sad_sum[0] >= sThresh3;
+    process[1] = process[1] && sad_sum[1] >= sThresh3;
+
+    if (R >= 3 && (process[0] || process[1])) {
+      for (int dy = 0; dy <= 2 * R; dy++)
+        for (int dx = 0; dx <= 2 * R; dx++)
+          if (ring<R>(dx, dy) == 3)
+            scalar16_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, nullptr);
+    }
+  }
+
+  scalar16_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_adapt_u16_b4r2_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_u16_b4r2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_u16_b4r3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_u16_b4r2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+// used in mode_temporal and adaptive overlapping
+template<int R>
+static void frcore_filter_overlap_u16_b4r2or3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R;
+
+  int weight_acc[2] = { 0 };
+  int acc[2][16] = { { 0 } };
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      scalar16_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, nullptr);
+
+  scalar16_2x_blend(ptrb, pitchb, weight_acc, acc, inv_table, weight, process_blocks, nullptr);
+}
+
+void frcore_filter_overlap_u16_b4r2_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_u16_b4r2or3_scalar<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_u16_b4r3_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_u16_b4r2or3_scalar<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_diff_u16_b4r1_scalar(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  int weight_acc[2] = { 0 };
+  int acc[2][16] = { { 0 } };
+
+  for (int dy = 0; dy <= 2; dy++)
+    for (int dx = 0; dx <= 2; dx++)
+      scalar16_2x_check(ptrr, pitchr, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, nullptr, nullptr);
+
+  // both blocks with the weight of the first one, like frcore_filter_diff_b4r1_scalar
+  int both_weights[2] = { weight[0], weight[0] };
+  int process_blocks[2] = { 1, 1 };
+  int diff[2];
+
+  scalar16_2x_blend(ptrb, pitchb, weight_acc, acc, inv_table, both_weights, process_blocks, diff);
+
+  weight[0] = diff[0] / 16;
+  weight[1] = diff[1] / 16;
+}
+
+void frcore_dev_u16_2x_b4_scalar(const uint16_t* ptra, int pitcha, int dev[2])
+{
+  for (int i = 0; i < 2; i++) {
+      int sad1 = scalar16_sad16(ptra + 4 * i, pitcha, ptra + 4 * i + pitcha - 1, pitcha);
+      int sad2 = scalar16_sad16(ptra + 4 * i, pitcha, ptra + 4 * i + pitcha + 1, pitcha);
+
+      dev[i] = std::min(sad1, sad2);
+  }
+}
+
+void frcore_sad_u16_2x_b4_scalar(const uint16_t* ptra, int pitcha, const uint16_t* ptrb, int pitchb, int sad[2])
+{
+  sad[0] = scalar16_sad16(ptra, pitcha, ptrb, pitchb);
+  sad[1] = scalar16_sad16(ptra + 4, pitcha, ptrb + 4, pitchb);
+}
+
+
+#ifdef FRFUN7_X86
+
+// SSE2: one row of both blocks per register, words 0..3 belong to block 0 and words 4..7 to block 1.
+// The per block values (SADs, thresholds, match counters) are in dwords 0 and 2, like the
+// results of psadbw in the 8 bit kernels. The sums are kept in two dword registers per row,
+// one per block.
+
+static AVS_FORCEINLINE __m128i simd16_load(const uint16_t* ptr) {
+  return _mm_loadu_si128((const __m128i *)ptr);
+}
+
+static AVS_FORCEINLINE void simd16_store(uint16_t* ptr, __m128i value) {
+  _mm_storeu_si128((__m128i *)ptr, value);
+}
+
+// SAD of two 4x4 blocks, in dwords 0 and 2
+static AVS_FORCEINLINE __m128i simd16_2x_sad16(const __m128i ref[4], const __m128i src[4])
+{
+  auto sign = _mm_set1_epi16(-32768);
+  auto ones = _mm_set1_epi16(1);
+
+  auto sad = _mm_setzero_si128();
+
+  for (int y = 0; y < 4; y++) {
+    auto diff = _mm_or_si128(_mm_subs_epu16(ref[y], src[y]), _mm_subs_epu16(src[y], ref[y]));
+    // pmaddwd is signed, each dword is 2 * 32768 too low
+    sad = _mm_add_epi32(sad, _mm_madd_epi16(_mm_xor_si128(diff, sign), ones));
+  }
+
+  sad = _mm_add_epi32(sad, _mm_srli_epi64(sad, 32));
+
+  return _mm_add_epi32(sad, _mm_set1_epi32(4 * 4 * 32768));
+}
+
+// see scalar16_2x_check
+// process: all ones in dwords 0 and 2 for the blocks to check
+template <bool sum_sads = false>
+static AVS_FORCEINLINE void simd16_2x_check(const __m128i ref[4], const uint16_t* rdst, int rdp_aka_pitch, __m128i& racc, __m128i threshold, __m128i acc[8], __m128i process, __m128i* sad_sum = nullptr)
+{
+  __m128i src[4];
+  for (int y = 0; y < 4; y++)
+    src[y] = simd16_load(rdst + rdp_aka_pitch * y);
+
+  auto sad = simd16_2x_sad16(ref, src);
+
+  if constexpr (sum_sads)
+    *sad_sum = _mm_add_epi32(*sad_sum, sad);
+
+  auto mask = _mm_and_si128(_mm_cmpgt_epi32(threshold, sad), process);
+  racc = _mm_sub_epi32(racc, mask);
+  mask = _mm_shuffle_epi32(mask, _MM_SHUFFLE(2, 2, 0, 0));
+
+  auto zero = _mm_setzero_si128();
+
+  for (int y = 0; y < 4; y++) {
+    auto pixels = _mm_and_si128(src[y], mask);
+    acc[y * 2] = _mm_add_epi32(acc[y * 2], _mm_unpacklo_epi16(pixels, zero));
+    acc[y * 2 + 1] = _mm_add_epi32(acc[y * 2 + 1], _mm_unpackhi_epi16(pixels, zero));
+  }
+}
+
+// (acc * multiplier + rounder) >> shift for four unsigned dwords, the products are 64 bit
+template <int shift>
+static AVS_FORCEINLINE __m128i simd16_scale(__m128i acc, __m128i multiplier, __m128i rounder)
+{
+  auto even = _mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(acc, multiplier), rounder), shift);
+  auto odd = _mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(acc, 32), multiplier), rounder), shift);
+  return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+// packusdw, which SSE2 doesn't have. The dwords are between 0 and 65535.
+static AVS_FORCEINLINE __m128i simd16_packus_epi32(__m128i lo, __m128i hi)
+{
+  auto bias = _mm_set1_epi32(32768);
+  auto packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+  return _mm_xor_si128(packed, _mm_set1_epi16(-32768));
+}
+
+static AVS_FORCEINLINE void simd16_2x_store(uint16_t* ptrb, int pitchb, __m128i weight_acc, const __m128i acc[8], const int* inv_table)
+{
+  auto weight_recip1 = _mm_set1_epi32(inv_table[_mm_cvtsi128_si32(weight_acc)]);
+  auto weight_recip2 = _mm_set1_epi32(inv_table[_mm_cvtsi128_si32(_mm_srli_si128(weight_acc, 8))]);
+  auto rounder = _mm_set1_epi64x(1 << 29);
+
+  for (int y = 0; y < 4; y++) {
+    auto lo = simd16_scale<30>(acc[y * 2], weight_recip1, rounder);
+    auto hi = simd16_scale<30>(acc[y * 2 + 1], weight_recip2, rounder);
+    simd16_store(ptrb + pitchb * y, simd16_packus_epi32(lo, hi));
+  }
+}
+
+// see scalar16_2x_blend
+// Both blocks are computed, those not in process_blocks keep their old pixels.
+// diff: the SADs between the old and the new pixels, in dwords 0 and 2
+template <bool want_diff = false>
+static AVS_FORCEINLINE void simd16_2x_blend(uint16_t* ptrb, int pitchb, __m128i weight_acc, const __m128i acc[8], const int* inv_table, const int weight[2], const int process_blocks[2], __m128i* diff = nullptr)
+{
+  int64_t recip1 = inv_table[_mm_cvtsi128_si32(weight_acc)];
+  int64_t recip2 = inv_table[_mm_cvtsi128_si32(_mm_srli_si128(weight_acc, 8))];
+
+  auto weight_recip1 = _mm_set1_epi32((int)((recip1 * (weight[0] & 0xFFFF) + (1 << 13)) >> 14));
+  auto weight_recip2 = _mm_set1_epi32((int)((recip2 * (weight[1] & 0xFFFF) + (1 << 13)) >> 14));
+
+  auto weight_hi16 = _mm_unpacklo_epi64(_mm_set1_epi16(weight[0] >> 16), _mm_set1_epi16(weight[1] >> 16));
+  auto keep = _mm_unpacklo_epi64(_mm_set1_epi16(process_blocks[0] ? 0 : -1), _mm_set1_epi16(process_blocks[1] ? 0 : -1));
+
+  auto rounder = _mm_set1_epi64x(1 << 25);
+  auto rounder_sixteen = _mm_set1_epi32(16);
+
+  __m128i old[4], result[4];
+
+  for (int y = 0; y < 4; y++) {
+    old[y] = simd16_load(ptrb + pitchb * y);
+
+    auto lo = simd16_scale<26>(acc[y * 2], weight_recip1, rounder);
+    auto hi = simd16_scale<26>(acc[y * 2 + 1], weight_recip2, rounder);
+
+    // (old * weight_hi16) >> 10
+    auto product_lo = _mm_mullo_epi16(old[y], weight_hi16);
+    auto product_hi = _mm_mulhi_epu16(old[y], weight_hi16);
+    lo = _mm_add_epi32(lo, _mm_srli_epi32(_mm_unpacklo_epi16(product_lo, product_hi), 10));
+    hi = _mm_add_epi32(hi, _mm_srli_epi32(_mm_unpackhi_epi16(product_lo, product_hi), 10));
+
+    lo = _mm_srli_epi32(_mm_add_epi32(lo, rounder_sixteen), 5);
+    hi = _mm_srli_epi32(_mm_add_epi32(hi, rounder_sixteen), 5);
+
+    result[y] = simd16_packus_epi32(lo, hi);
+    result[y] = _mm_or_si128(_mm_and_si128(keep, old[y]), _mm_andnot_si128(keep, result[y]));
+
+    simd16_store(ptrb + pitchb * y, result[y]);
+  }
+
+  if constexpr (want_diff)
+    *diff = simd16_2x_sad16(old, result);
+}
+
+static AVS_FORCEINLINE void simd16_load_ref(const uint16_t* ptrr, int pitchr, __m128i ref[4])
+{
+  for (int y = 0; y < 4; y++)
+    ref[y] = simd16_load(ptrr + pitchr * y);
+}
+
+static AVS_FORCEINLINE __m128i simd16_load_thresh(const int threshold[2])
+{
+  return _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)threshold), _mm_setzero_si128());
+}
+
+template<int R> // radius; 3, 2 or 0
+static void frcore_filter_u16_b4r0or2or3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[2], const int* inv_table)
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = simd16_load_thresh(threshold);
+  auto all = _mm_set1_epi32(-1);
+
+  __m128i ref[4];
+  simd16_load_ref(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128i acc[8];
+  for (int i = 0; i < 8; i++)
+    acc[i] = _mm_setzero_si128();
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      simd16_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  simd16_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_u16_b4r0_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_simd<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_u16_b4r2_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_u16_b4r3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_u16_b4r0or2or3_simd<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+template<int R>
+static void frcore_filter_adapt_u16_b4r2or3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  ptra += -R * pitcha + 3 - 2 * R; // cpln(3 - 2 * R, -R)
+
+  auto thresh = simd16_load_thresh(threshold);
+
+  __m128i ref[4];
+  simd16_load_ref(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128i acc[8];
+  for (int i = 0; i < 8; i++)
+    acc[i] = _mm_setzero_si128();
+
+  auto sad_sum = _mm_setzero_si128();
+  auto process = _mm_set1_epi32(-1);
+
+  for (int dy = R - 1; dy <= R + 1; dy++)
+    for (int dx = R - 1; dx <= R + 1; dx++)
+      simd16_2x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+  // sad_sum >= sThresh2
+  process = _mm_cmpgt_epi32(sad_sum, _mm_set1_epi32(sThresh2 - 1));
+
+  if (_mm_movemask_epi8(_mm_shuffle_epi32(process, _MM_SHUFFLE(2, 2, 0, 0)))) {
+    for (int dy = R - 2; dy <= R + 2; dy++)
+      for (int dx = R - 2; dx <= R + 2; dx++)
+        if (ring<R>(dx, dy) == 2)
+          simd16_2x_check<true>(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process, &sad_sum);
+
+    process = _mm_and_si128(process, _mm_cmpgt_epi32(sad_sum, _mm_set1_epi32(sThresh3 - 1)));
+
+    if (R >= 3 && _mm_movemask_epi8(_mm_shuffle_epi32(process, _MM_SHUFFLE(2, 2, 0, 0)))) {
+      for (int dy = 0; dy <= 2 * R; dy++)
+        for (int dx = 0; dx <= 2 * R; dx++)
+          if (ring<R>(dx, dy) == 3)
+            simd16_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, process);
+    }
+  }
+
+  simd16_2x_store(ptrb, pitchb, weight_acc, acc, inv_table);
+}
+
+void frcore_filter_adapt_u16_b4r2_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_u16_b4r2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_u16_b4r3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_u16_b4r2or3_simd<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+template<int R>
+static void frcore_filter_overlap_u16_b4r2or3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R;
+
+  auto thresh = simd16_load_thresh(threshold);
+  auto all = _mm_set1_epi32(-1);
+
+  __m128i ref[4];
+  simd16_load_ref(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128i acc[8];
+  for (int i = 0; i < 8; i++)
+    acc[i] = _mm_setzero_si128();
+
+  for (int dy = 0; dy <= 2 * R; dy++)
+    for (int dx = 0; dx <= 2 * R; dx++)
+      simd16_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  simd16_2x_blend(ptrb, pitchb, weight_acc, acc, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_u16_b4r2_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_u16_b4r2or3_simd<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_u16_b4r3_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_u16_b4r2or3_simd<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_diff_u16_b4r1_simd(const uint16_t* ptrr, int pitchr, const uint16_t* ptra, int pitcha, uint16_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  auto thresh = simd16_load_thresh(threshold);
+  auto all = _mm_set1_epi32(-1);
+
+  __m128i ref[4];
+  simd16_load_ref(ptrr, pitchr, ref);
+
+  auto weight_acc = _mm_setzero_si128();
+  __m128i acc[8];
+  for (int i = 0; i < 8; i++)
+    acc[i] = _mm_setzero_si128();
+
+  for (int dy = 0; dy <= 2; dy++)
+    for (int dx = 0; dx <= 2; dx++)
+      simd16_2x_check(ref, ptra + pitcha * dy + dx, pitcha, weight_acc, thresh, acc, all);
+
+  int both_weights[2] = { weight[0], weight[0] };
+  int process_blocks[2] = { 1, 1 };
+  __m128i diff;
+
+  simd16_2x_blend<true>(ptrb, pitchb, weight_acc, acc, inv_table, both_weights, process_blocks, &diff);
+
+  diff = _mm_srli_epi32(diff, 4);
+
+  weight[0] = _mm_cvtsi128_si32(diff);
+  weight[1] = _mm_cvtsi128_si32(_mm_srli_si128(diff, 8));
+}
+
+void frcore_dev_u16_2x_b4_simd(const uint16_t* ptra, int pitcha, int dev[2])
+{
+  __m128i ref[4], src1[4], src2[4];
+
+  for (int y = 0; y < 4; y++) {
+    ref[y] = simd16_load(ptra + pitcha * y);
+    src1[y] = simd16_load(ptra + pitcha * (y + 1) - 1);
+    src2[y] = simd16_load(ptra + pitcha * (y + 1) + 1);
+  }
+
+  auto sad1 = simd16_2x_sad16(ref, src1);
+  auto sad2 = simd16_2x_sad16(ref, src2);
+
+  dev[0] = std::min(_mm_cvtsi128_si32(sad1), _mm_cvtsi128_si32(sad2));
+  dev[1] = std::min(_mm_cvtsi128_si32(_mm_srli_si128(sad1, 8)), _mm_cvtsi128_si32(_mm_srli_si128(sad2, 8)));
+}
+
+void frcore_sad_u16_2x_b4_simd(const uint16_t* ptra, int pitcha, const uint16_t* ptrb, int pitchb, int sad[2])
+{
+  __m128i ref[4], src[4];
+
+  simd16_load_ref(ptra, pitcha, ref);
+  simd16_load_ref(ptrb, pitchb, src);
+
+  auto sad1 = simd16_2x_sad16(ref, src);
+
+  sad[0] = _mm_cvtsi128_si32(sad1);
+  sad[1] = _mm_cvtsi128_si32(_mm_srli_si128(sad1, 8));
+}
+
+#endif // FRFUN7_X86
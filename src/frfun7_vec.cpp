@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cstring>
+
+#include "frfun7.h"
+
+
+// Portable versions of the *_simd kernels, written with the vector extensions
+// of GCC and Clang. They follow the SSE2 kernels closely, but the arithmetic
+// of the scaling and blending steps is the one from the scalar kernels, so the
+// output is identical to both.
+//
+// Two horizontally adjacent blocks are processed per call, one row of both
+// blocks per vector: words 0..3 belong to block 0, words 4..7 to block 1.
+// Per block values (SADs, thresholds, match counters) live in the two lanes
+// of a 64 bit vector. The scaling is done one block at a time in 32 bits.
+
+typedef uint8_t u8x4 __attribute__((vector_size(4)));
+typedef uint8_t u8x8 __attribute__((vector_size(8)));
+typedef int16_t i16x4 __attribute__((vector_size(8)));
+typedef int16_t i16x8 __attribute__((vector_size(16)));
+typedef int32_t i32x4 __attribute__((vector_size(16)));
+typedef int64_t i64x2 __attribute__((vector_size(16)));
+typedef uint64_t u64x2 __attribute__((vector_size(16)));
+
+
+static AVS_FORCEINLINE i16x8 vec_load8(const uint8_t* ptr) {
+  u8x8 bytes;
+  memcpy(&bytes, ptr, sizeof(bytes));
+  return __builtin_convertvector(bytes, i16x8);
+}
+
+static AVS_FORCEINLINE i32x4 vec_load4(const uint8_t* ptr) {
+  u8x4 bytes;
+  memcpy(&bytes, ptr, sizeof(bytes));
+  return __builtin_convertvector(bytes, i32x4);
+}
+
+static AVS_FORCEINLINE void vec_store4(uint8_t* ptr, i32x4 value) {
+  u8x4 bytes = __builtin_convertvector(value, u8x4);
+  memcpy(ptr, &bytes, sizeof(bytes));
+}
+
+// the four words of one block, widened
+static AVS_FORCEINLINE i32x4 vec_block(i16x8 words, int block) {
+  i16x4 half;
+  memcpy(&half, (const int16_t *)&words + 4 * block, sizeof(half));
+  return __builtin_convertvector(half, i32x4);
+}
+
+static AVS_FORCEINLINE i64x2 vec_set2(int64_t block0, int64_t block1) {
+  i64x2 value = { block0, block1 };
+  return value;
+}
+
+static AVS_FORCEINLINE i16x8 vec_absdiff(i16x8 a, i16x8 b) {
+  i16x8 diff = a - b;
+  i16x8 sign = diff >> 15;
+  return (diff ^ sign) - sign;
+}
+
+// sum of the four words of each block
+static AVS_FORCEINLINE i64x2 vec_2x_hsum(i16x8 words) {
+  u64x2 sums = (u64x2)words;
+  sums = (sums & 0x0000ffff0000ffffull) + ((sums >> 16) & 0x0000ffff0000ffffull);
+  sums = (sums & 0xffffffffull) + (sums >> 32);
+  return (i64x2)sums;
+}
+
+static AVS_FORCEINLINE void vec_load_ref(const uint8_t* ptrr, int pitchr, i16x8 ref[4]) {
+  for (int i = 0; i < 4; i++)
+    ref[i] = vec_load8(ptrr + pitchr * i);
+}
+
+// SADs of the two 4x4 reference blocks and the two 4x4 blocks at rdst + offset
+static AVS_FORCEINLINE i64x2 vec_2x_sad16(const i16x8 ref[4], int offset, const uint8_t* rdst, int rdp_aka_pitch)
+{
+  i16x8 sum = vec_absdiff(ref[0], vec_load8(rdst + offset));
+  sum += vec_absdiff(ref[1], vec_load8(rdst + rdp_aka_pitch + offset));
+  sum += vec_absdiff(ref[2], vec_load8(rdst + rdp_aka_pitch * 2 + offset));
+  sum += vec_absdiff(ref[3], vec_load8(rdst + rdp_aka_pitch * 3 + offset));
+
+  return vec_2x_hsum(sum);
+}
+
+// sad < thresh for both blocks
+// Both are below 2^31, so 32 bit compares suffice: many targets have no 64 bit one.
+// The upper halves are zero and never match, the mask is spread to the whole lane afterwards.
+static AVS_FORCEINLINE i64x2 vec_2x_less(i64x2 sad, i64x2 thresh)
+{
+  u64x2 mask = (u64x2)((i32x4)sad < (i32x4)thresh);
+  return (i64x2)(mask | (mask << 32) | (mask >> 32));
+}
+
+// fills mm[0..3] (mm4..mm7) with the matching candidate
+static AVS_FORCEINLINE void vec_2x_acc16(int offset, const uint8_t* rdst, int rdp_aka_pitch, i64x2 mask_by_sadcomp, i16x8 mm[4])
+{
+  i16x8 mask = (i16x8)mask_by_sadcomp;
+
+  for (int i = 0; i < 4; i++)
+    mm[i] += vec_load8(rdst + rdp_aka_pitch * i + offset) & mask;
+}
+
+// process: all ones for the blocks which take part
+static AVS_FORCEINLINE void vec_2x_check(const i16x8 ref[4], int offset, const uint8_t* rdst, int rdp_aka_pitch, i64x2 &racc, i64x2 thresh, i16x8 mm[4], i64x2 process = vec_set2(-1, -1))
+{
+  i64x2 sad = vec_2x_sad16(ref, offset, rdst, rdp_aka_pitch);
+
+  i64x2 mask_by_sadcomp = vec_2x_less(sad, thresh) & process;
+  racc -= mask_by_sadcomp;
+
+  vec_2x_acc16(offset, rdst, rdp_aka_pitch, mask_by_sadcomp, mm);
+}
+
+static AVS_FORCEINLINE void vec_2x_acheck(const i16x8 ref[4], int offset, const uint8_t* rdst, int rdp_aka_pitch, i64x2 &racc, i64x2 thresh, i16x8 mm[4], i64x2 &edx_sad_summing, i64x2 process = vec_set2(-1, -1))
+{
+  i64x2 sad = vec_2x_sad16(ref, offset, rdst, rdp_aka_pitch);
+  edx_sad_summing += sad & process;
+
+  i64x2 mask_by_sadcomp = vec_2x_less(sad, thresh) & process;
+  racc -= mask_by_sadcomp;
+
+  vec_2x_acc16(offset, rdst, rdp_aka_pitch, mask_by_sadcomp, mm);
+}
+
+static AVS_FORCEINLINE void vec_2x_store(uint8_t* ptrb, int pitchb, i64x2 weight_acc, const int* inv_table, const i16x8 mm[4])
+{
+  // scale mm4 - mm7 by weight
+  for (int block = 0; block < 2; block++) {
+    int weight_recip = inv_table[weight_acc[block]];
+
+    for (int i = 0; i < 4; i++) {
+      // ((((mmA << 2) * multiplier) >> 16 ) + 1) >> 1
+      i32x4 mmA = vec_block(mm[i], block);
+      mmA = (mmA * weight_recip) >> 14;
+      mmA = (mmA + 1) >> 1;
+      vec_store4(ptrb + pitchb * i + 4 * block, mmA);
+    }
+  }
+}
+
+// scales mm4 - mm7 for blending, see frcore_filter_overlap_b4r2or3_scalar
+static AVS_FORCEINLINE i32x4 vec_scale(i32x4 mmA, int weight_recip, int weight_lo16)
+{
+  mmA = (mmA * weight_recip + 256) >> 9;
+  return (mmA * weight_lo16) >> 16;
+}
+
+// tmp= ((esi << 6) * multiplier) >> 16  ( == [esi]/1024 * multiplier)
+// mmA = (mmA + tmp + rounder_16) / 32
+static AVS_FORCEINLINE i32x4 vec_blend(i32x4 mmA, i32x4 mm3, int weight_hi16)
+{
+  return (mmA + ((mm3 * weight_hi16) >> 10) + 16) >> 5;
+}
+
+
+template<int R> // radius; 0, 2 or 3
+static AVS_FORCEINLINE void frcore_filter_b4r0or2or3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table)
+{
+  // convert to upper left corner of the radius
+  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(0, 0)
+
+  i64x2 thresh = vec_set2(threshold[0], threshold[1]);
+  i64x2 weight_acc = vec_set2(0, 0);
+
+  i16x8 ref[4];
+  vec_load_ref(ptrr, pitchr, ref);
+
+  // accumulators, mm4 - mm7 in the SSE2 version
+  i16x8 mm[4] = { };
+
+  for (int y = -R; y <= R; y++) {
+    for (int offset = 0; offset <= 2 * R; offset++)
+      vec_2x_check(ref, offset, ptra, pitcha, weight_acc, thresh, mm);
+    ptra += pitcha; // next line
+  }
+
+  vec_2x_store(ptrb, pitchb, weight_acc, inv_table, mm);
+}
+
+void frcore_filter_b4r3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_vec<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_b4r2_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_vec<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+void frcore_filter_b4r0_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table)
+{
+  frcore_filter_b4r0or2or3_vec<0>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table);
+}
+
+
+// R == 2 or 3
+template<int R>
+static AVS_FORCEINLINE void frcore_filter_adapt_b4r2or3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  // convert to upper left corner of the radius
+  ptra += -1 * pitcha - R; // cpln(-3, -1)
+
+  i64x2 thresh = vec_set2(threshold[0], threshold[1]);
+  i64x2 weight_acc = vec_set2(0, 0);
+
+  i16x8 ref[4];
+  vec_load_ref(ptrr, pitchr, ref);
+
+  // accumulators
+  i16x8 mm[4] = { };
+
+  i64x2 edx_sad_summing = vec_set2(0, 0);
+
+  // ; -1 .. +1
+  for (int y = -1; y <= 1; y++) {
+    for (int offset = 2; offset <= 4; offset++)
+      vec_2x_acheck(ref, offset, ptra, pitcha, weight_acc, thresh, mm, edx_sad_summing);
+    if (y < 1)
+      ptra += pitcha; // next line
+  }
+
+  i64x2 process = edx_sad_summing >= vec_set2(sThresh2, sThresh2);
+
+  if (process[0] || process[1])
+  {
+    // Expand the search for distances not covered in the first pass
+    ptra -= 3 * pitcha; // move to -2
+
+    // ; -2
+    for (int offset = 1; offset <= 5; offset++)
+      vec_2x_acheck(ref, offset, ptra, pitcha, weight_acc, thresh, mm, edx_sad_summing, process);
+    ptra += pitcha; // next line
+
+    // ; -1 .. +1
+    for (int y = -1; y <= 1; y++) {
+      vec_2x_acheck(ref, 1, ptra, pitcha, weight_acc, thresh, mm, edx_sad_summing, process);
+      vec_2x_acheck(ref, 5, ptra, pitcha, weight_acc, thresh, mm, edx_sad_summing, process);
+      ptra += pitcha; // next line
+    }
+
+    // ; +2
+    for (int offset = 1; offset <= 5; offset++)
+      vec_2x_acheck(ref, offset, ptra, pitcha, weight_acc, thresh, mm, edx_sad_summing, process);
+
+    process &= edx_sad_summing >= vec_set2(sThresh3, sThresh3);
+
+    if constexpr (R >= 3) {
+      if (process[0] || process[1])
+      {
+        // Expand the search for distances not covered in the first-second pass
+        ptra -= 5 * pitcha; // move to -3
+
+        // ; -3
+        for (int offset = 0; offset <= 6; offset++)
+          vec_2x_check(ref, offset, ptra, pitcha, weight_acc, thresh, mm, process);
+        ptra += pitcha; // next line
+
+        // ; -2 .. +2
+        for (int y = -2; y <= 2; y++) {
+          vec_2x_check(ref, 0, ptra, pitcha, weight_acc, thresh, mm, process);
+          vec_2x_check(ref, 6, ptra, pitcha, weight_acc, thresh, mm, process);
+          ptra += pitcha; // next line
+        }
+
+        // ; +3
+        for (int offset = 0; offset <= 6; offset++)
+          vec_2x_check(ref, offset, ptra, pitcha, weight_acc, thresh, mm, process);
+      }
+    }
+  }
+
+  vec_2x_store(ptrb, pitchb, weight_acc, inv_table, mm);
+}
+
+void frcore_filter_adapt_b4r3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_vec<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+void frcore_filter_adapt_b4r2_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], int sThresh2, int sThresh3, const int* inv_table)
+{
+  frcore_filter_adapt_b4r2or3_vec<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, sThresh2, sThresh3, inv_table);
+}
+
+
+// used in mode_temporal and adaptive overlapping
+// R is 2 or 3
+template<int R>
+static AVS_FORCEINLINE void frcore_filter_overlap_b4r2or3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  ptra += -R * pitcha - R; // cpln(-3, -3) or cpln(-2, -2)
+
+  i64x2 thresh = vec_set2(threshold[0], threshold[1]);
+  i64x2 weight_acc = vec_set2(0, 0);
+
+  i16x8 ref[4];
+  vec_load_ref(ptrr, pitchr, ref);
+
+  // accumulators
+  i16x8 mm[4] = { };
+
+  for (int y = -R; y <= R; y++) {
+    for (int offset = 0; offset <= 2 * R; offset++)
+      vec_2x_check(ref, offset, ptra, pitcha, weight_acc, thresh, mm);
+    ptra += pitcha; // next line
+  }
+
+  // scale mm4 - mm7 by weight and store (here with blending)
+  for (int block = 0; block < 2; block++) {
+    if (!process_blocks[block])
+      continue;
+
+    // weight variable is a multi-purpose one, here we get a 32 bit value,
+    // which is really two 16 bit words
+    // lower 16 and upper 16 bit has separate meaning
+    int weight_lo16 = weight[block] & 0xFFFF; // lower 16 bit
+    int weight_hi16 = weight[block] >> 16; // upper 16 bit
+
+    int weight_recip = inv_table[weight_acc[block]];
+
+    for (int i = 0; i < 4; i++) {
+      uint8_t* esi = ptrb + pitchb * i + 4 * block;
+
+      i32x4 mmA = vec_scale(vec_block(mm[i], block), weight_recip, weight_lo16);
+      mmA = vec_blend(mmA, vec_load4(esi), weight_hi16);
+      vec_store4(esi, mmA);
+    }
+  }
+}
+
+void frcore_filter_overlap_b4r3_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_vec<3>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+void frcore_filter_overlap_b4r2_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int thresh[2], const int* inv_table, int weight[2], int process_blocks[2])
+{
+  frcore_filter_overlap_b4r2or3_vec<2>(ptrr, pitchr, ptra, pitcha, ptrb, pitchb, thresh, inv_table, weight, process_blocks);
+}
+
+
+void frcore_filter_diff_b4r1_vec(const uint8_t* ptrr, int pitchr, const uint8_t* ptra, int pitcha, uint8_t* ptrb, int pitchb, int threshold[2], const int* inv_table, int weight[2])
+{
+  ptra += -1 * pitcha - 1; //  cpln(-1, -1)
+
+  i64x2 thresh = vec_set2(threshold[0], threshold[1]);
+  i64x2 weight_acc = vec_set2(0, 0);
+
+  i16x8 ref[4];
+  vec_load_ref(ptrr, pitchr, ref);
+
+  // accumulators
+  i16x8 mm[4] = { };
+
+  for (int y = -1; y <= 1; y++) {
+    for (int offset = 0; offset <= 2; offset++)
+      vec_2x_check(ref, offset, ptra, pitcha, weight_acc, thresh, mm);
+    ptra += pitcha; // next line
+  }
+
+  // weight variable is a multi-purpose one, here we get a 32 bit value,
+  // which is really two 16 bit words
+  // lower 16 and upper 16 bit has separate meaning
+  int prev_weight = *weight;
+
+  int weight_lo16 = prev_weight & 0xFFFF; // lower 16 bit
+  int weight_hi16 = prev_weight >> 16; // upper 16 bit
+
+  // scale mm4 - mm7 by weight and store (here with blending)
+  // the outputs are the SADs between the old and the new pixels
+  for (int block = 0; block < 2; block++) {
+    int weight_recip = inv_table[weight_acc[block]];
+
+    i32x4 diff = { };
+
+    for (int i = 0; i < 4; i++) {
+      uint8_t* esi = ptrb + pitchb * i + 4 * block;
+
+      i32x4 mm3 = vec_load4(esi);
+
+      i32x4 mmA = vec_scale(vec_block(mm[i], block), weight_recip, weight_lo16);
+      mmA = vec_blend(mmA, mm3, weight_hi16);
+      vec_store4(esi, mmA);
+
+      i32x4 sign = (mmA - mm3) >> 31;
+      diff += ((mmA - mm3) ^ sign) - sign;
+    }
+
+    weight[block] = (diff[0] + diff[1] + diff[2] + diff[3]) / 16;
+  }
+}
+
+
+void frcore_dev_2x_b4_vec(const uint8_t* ptra, int pitcha, int dev[2])
+{
+  i16x8 ref[4];
+  vec_load_ref(ptra, pitcha, ref);
+
+  ptra += pitcha - 1; // cpln(-1, 1)
+
+  i64x2 sad1 = vec_2x_sad16(ref, 0, ptra, pitcha);
+  i64x2 sad2 = vec_2x_sad16(ref, 2, ptra, pitcha);
+
+  dev[0] = (int)std::min(sad1[0], sad2[0]);
+  dev[1] = (int)std::min(sad1[1], sad2[1]);
+}
+
+void frcore_sad_2x_b4_vec(const uint8_t* ptra, int pitcha, const uint8_t* ptrb, int pitchb, int sad[2])
+{
+  i16x8 ref[4];
+  vec_load_ref(ptra, pitcha, ref);
+
+  i64x2 sads = vec_2x_sad16(ref, 0, ptrb, pitchb);
+
+  sad[0] = (int)sads[0];
+  sad[1] = (int)sads[1];
+}